@@ -0,0 +1,438 @@
+// Copyright Cartesi and individual authors (see AUTHORS)
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+/// \file
+/// \brief Microbenchmarks of the Merkle trees and hashers used for epoch proofs.
+/// \details Measures, for epochs of increasing number of inputs, the operations the server manager performs on the
+/// epoch output trees, and compares the hasher backends on the hashing of a tree level. Results are written as JSON,
+/// so they can be compared between releases.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "back-merkle-tree.h"
+#include "complete-merkle-tree.h"
+#include "cryptopp-keccak-256-hasher.h"
+#include "keccak-256-hasher.h"
+#include "merkle-tree-proof.h"
+
+using clock_type = std::chrono::steady_clock;
+using hasher_type = cartesi::keccak_256_hasher;
+using hash_type = hasher_type::hash_type;
+using proof_type = cartesi::merkle_tree_proof<hash_type, uint64_t>;
+
+/// \brief Same tree geometry as the epoch output trees of the server manager
+constexpr const int LOG2_ROOT_SIZE = 37;
+constexpr const int LOG2_KECCAK_SIZE = 5;
+
+/// \brief Type holding the command-line configuration
+struct bench_config_type {
+    uint64_t max_inputs{};     ///< Number of inputs in the largest epoch
+    uint64_t growth{};         ///< Factor between the number of inputs of consecutive epochs
+    uint64_t repetitions{};    ///< Number of repetitions of each measurement, of which the fastest is reported
+    uint64_t min_operations{}; ///< Minimum number of operations timed in each repetition
+    uint64_t proof_samples{};  ///< Maximum number of leaves sampled for proof latencies
+    std::string output;        ///< File receiving the results, or empty for stdout
+};
+
+/// \brief Type holding the results for an epoch with a given number of inputs, in nanoseconds per operation
+struct epoch_results_type {
+    uint64_t inputs{};                   ///< Number of inputs in epoch
+    double back_push_back{};             ///< back_merkle_tree::push_back
+    double back_get_next_leaf_proof{};   ///< back_merkle_tree::get_next_leaf_proof
+    double back_get_root_hash{};         ///< back_merkle_tree::get_root_hash
+    double complete_build{};             ///< complete_merkle_tree construction from leaves, per leaf
+    double complete_get_root_hash{};     ///< complete_merkle_tree::get_root_hash
+    double complete_get_proof{};         ///< complete_merkle_tree::get_proof of a leaf
+    double proof_slice{};                ///< merkle_tree_proof::slice of a leaf proof
+    double finish_epoch{};               ///< Both output trees and their proofs, per input
+    double concat_hashes_cryptopp{};     ///< cryptopp_keccak_256_hasher::concat_hashes, per parent
+    double concat_hashes_multi_buffer{}; ///< multi_buffer_keccak_256_hasher::concat_hashes, per parent
+};
+
+/// \brief Keeps the compiler from optimizing away a computed value
+/// \param value Value to keep
+template <typename T>
+static void do_not_optimize(const T &value) {
+    __asm__ volatile("" : : "r"(&value) : "memory");
+}
+
+/// \brief Returns nanoseconds elapsed since a time point
+/// \param start Time point
+static double elapsed_ns(clock_type::time_point start) {
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+/// \brief Measures the time per operation of a timed run
+/// \param config Command-line configuration
+/// \param operations Number of operations in each run
+/// \param run Function that performs the operations and returns the nanoseconds they took, excluding its setup
+/// \returns Nanoseconds per operation in the fastest repetition
+/// \details Each repetition calls run as many times as needed to time at least config.min_operations operations
+template <typename F>
+static double measure(const bench_config_type &config, uint64_t operations, F run) {
+    auto runs = std::max<uint64_t>(1, (config.min_operations + operations - 1) / operations);
+    double best = std::numeric_limits<double>::max();
+    for (uint64_t r = 0; r < config.repetitions; ++r) {
+        double ns = 0.0;
+        for (uint64_t i = 0; i < runs; ++i) {
+            ns += run();
+        }
+        best = std::min(best, ns / static_cast<double>(runs * operations));
+    }
+    return best;
+}
+
+/// \brief Returns random leaf hashes
+/// \param gen Random number generator
+/// \param count Number of leaves
+static std::vector<hash_type> get_leaves(std::mt19937_64 &gen, uint64_t count) {
+    std::vector<hash_type> leaves(count);
+    for (auto &leaf : leaves) {
+        for (auto &byte : leaf) {
+            byte = static_cast<unsigned char>(gen());
+        }
+    }
+    return leaves;
+}
+
+/// \brief Returns the indices of the leaves sampled for proof latencies, spread evenly across the epoch
+/// \param config Command-line configuration
+/// \param inputs Number of inputs in epoch
+static std::vector<uint64_t> get_samples(const bench_config_type &config, uint64_t inputs) {
+    auto count = std::min(inputs, config.proof_samples);
+    std::vector<uint64_t> samples(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        samples[i] = i * inputs / count;
+    }
+    return samples;
+}
+
+/// \brief Measures the hashing of a tree level with a hasher backend
+/// \param config Command-line configuration
+/// \param children Pairs of hashes to concatenate
+/// \returns Nanoseconds per parent hash
+template <typename H>
+static double measure_concat_hashes(const bench_config_type &config, const std::vector<hash_type> &children) {
+    H h;
+    std::vector<hash_type> parents(children.size() / 2);
+    return measure(config, parents.size(), [&]() {
+        auto start = clock_type::now();
+        h.concat_hashes(children.data(), parents.size(), parents.data());
+        auto ns = elapsed_ns(start);
+        do_not_optimize(parents);
+        return ns;
+    });
+}
+
+/// \brief Runs all measurements for an epoch
+/// \param config Command-line configuration
+/// \param inputs Number of inputs in epoch
+static epoch_results_type bench_epoch(const bench_config_type &config, uint64_t inputs) {
+    std::mt19937_64 gen{inputs};
+    auto leaves = get_leaves(gen, inputs);
+    auto samples = get_samples(config, inputs);
+    epoch_results_type results;
+    results.inputs = inputs;
+
+    results.back_push_back = measure(config, inputs, [&]() {
+        cartesi::back_merkle_tree tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE};
+        auto start = clock_type::now();
+        for (const auto &leaf : leaves) {
+            tree.push_back(leaf);
+        }
+        auto ns = elapsed_ns(start);
+        do_not_optimize(tree);
+        return ns;
+    });
+
+    // Leave the last input out, so the back tree still has room for the next leaf
+    cartesi::back_merkle_tree back_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE};
+    for (uint64_t i = 0; i + 1 < inputs; ++i) {
+        back_tree.push_back(leaves[i]);
+    }
+    results.back_get_next_leaf_proof = measure(config, 1, [&]() {
+        auto start = clock_type::now();
+        auto proof = back_tree.get_next_leaf_proof();
+        auto ns = elapsed_ns(start);
+        do_not_optimize(proof);
+        return ns;
+    });
+    results.back_get_root_hash = measure(config, 1, [&]() {
+        auto start = clock_type::now();
+        auto root_hash = back_tree.get_root_hash();
+        auto ns = elapsed_ns(start);
+        do_not_optimize(root_hash);
+        return ns;
+    });
+
+    results.complete_build = measure(config, inputs, [&]() {
+        auto copy = leaves;
+        auto start = clock_type::now();
+        cartesi::complete_merkle_tree tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE, std::move(copy)};
+        auto ns = elapsed_ns(start);
+        do_not_optimize(tree);
+        return ns;
+    });
+
+    cartesi::complete_merkle_tree complete_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE, leaves};
+    results.complete_get_root_hash = measure(config, 1, [&]() {
+        auto start = clock_type::now();
+        auto root_hash = complete_tree.get_root_hash();
+        auto ns = elapsed_ns(start);
+        do_not_optimize(root_hash);
+        return ns;
+    });
+    results.complete_get_proof = measure(config, samples.size(), [&]() {
+        auto start = clock_type::now();
+        for (auto i : samples) {
+            auto proof = complete_tree.get_proof(i << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            do_not_optimize(proof);
+        }
+        return elapsed_ns(start);
+    });
+
+    std::vector<proof_type> proofs;
+    proofs.reserve(samples.size());
+    for (auto i : samples) {
+        proofs.push_back(complete_tree.get_proof(i << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE));
+    }
+    results.proof_slice = measure(config, proofs.size(), [&]() {
+        hasher_type h;
+        auto start = clock_type::now();
+        for (const auto &proof : proofs) {
+            auto sliced = proof.slice(h, LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE + 1);
+            do_not_optimize(sliced);
+        }
+        return elapsed_ns(start);
+    });
+
+    // Same work as finish_epoch in the server manager, on a single thread: build the vouchers and notices trees
+    // from their leaves and get the proof of every input in both. Proofs are not retained, to bound memory usage.
+    results.finish_epoch = measure(config, inputs, [&]() {
+        auto vouchers_leaves = leaves;
+        auto notices_leaves = leaves;
+        auto start = clock_type::now();
+        cartesi::complete_merkle_tree vouchers_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE,
+            std::move(vouchers_leaves)};
+        cartesi::complete_merkle_tree notices_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE,
+            std::move(notices_leaves)};
+        for (uint64_t i = 0; i < inputs; ++i) {
+            auto voucher_proof = vouchers_tree.get_proof(i << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            auto notice_proof = notices_tree.get_proof(i << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            do_not_optimize(voucher_proof);
+            do_not_optimize(notice_proof);
+        }
+        return elapsed_ns(start);
+    });
+
+    // The leaf level of a tree with twice as many inputs has the same number of parents as this epoch has inputs
+    auto children = get_leaves(gen, 2 * inputs);
+    results.concat_hashes_cryptopp = measure_concat_hashes<cartesi::cryptopp_keccak_256_hasher>(config, children);
+    results.concat_hashes_multi_buffer =
+        measure_concat_hashes<cartesi::multi_buffer_keccak_256_hasher>(config, children);
+    return results;
+}
+
+/// \brief Writes the results as JSON
+/// \param out Output stream
+/// \param config Command-line configuration
+/// \param epochs Results of each epoch
+static void write_results(std::ostream &out, const bench_config_type &config,
+    const std::vector<epoch_results_type> &epochs) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"config\": {\"max_inputs\": " << config.max_inputs << ", \"growth\": " << config.growth
+        << ", \"repetitions\": " << config.repetitions << ", \"min_operations\": " << config.min_operations
+        << ", \"proof_samples\": " << config.proof_samples << "},\n";
+    out << "  \"multi_buffer_lanes\": " << cartesi::multi_buffer_keccak_256_lanes() << ",\n";
+    out << "  \"ns_per_operation\": [";
+    const char *separator = "\n";
+    for (const auto &e : epochs) {
+        out << separator << "    {\"inputs\": " << e.inputs << ",\n";
+        out << "     \"back_merkle_tree\": {\"push_back\": " << e.back_push_back
+            << ", \"get_next_leaf_proof\": " << e.back_get_next_leaf_proof
+            << ", \"get_root_hash\": " << e.back_get_root_hash << "},\n";
+        out << "     \"complete_merkle_tree\": {\"build_per_leaf\": " << e.complete_build
+            << ", \"get_root_hash\": " << e.complete_get_root_hash << ", \"get_proof\": " << e.complete_get_proof
+            << "},\n";
+        out << "     \"proof_slice\": " << e.proof_slice << ",\n";
+        out << "     \"finish_epoch_per_input\": " << e.finish_epoch << ",\n";
+        out << "     \"concat_hashes_per_parent\": {\"cryptopp\": " << e.concat_hashes_cryptopp
+            << ", \"multi_buffer\": " << e.concat_hashes_multi_buffer << "}}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+static void help(const char *name) {
+    (void) fprintf(stderr,
+        R"(Usage:
+
+    %s [--max-inputs=<n>] [--growth=<n>] [--repetitions=<n>]
+        [--min-operations=<n>] [--proof-samples=<n>] [--output=<path>] [--help]
+
+where
+
+    --max-inputs=<n>
+      number of inputs in the largest epoch. epochs start with a single
+      input and grow by --growth until reaching it
+      default: 1048576
+
+    --growth=<n>
+      factor between the number of inputs of consecutive epochs
+      default: 16
+
+    --repetitions=<n>
+      number of repetitions of each measurement. the fastest is reported
+      default: 3
+
+    --min-operations=<n>
+      minimum number of operations timed in each repetition. runs over
+      small epochs are repeated until reaching it
+      default: 65536
+
+    --proof-samples=<n>
+      maximum number of leaves, spread evenly across the epoch, whose
+      proofs are timed for get_proof and proof_slice
+      default: 4096
+
+    --output=<path>
+      file receiving the results as JSON, instead of stdout. results are
+      in nanoseconds per operation. finish_epoch_per_input is the time to
+      build the vouchers and notices trees of an epoch and get the proofs
+      of all its inputs, divided by the number of inputs
+
+    --help
+      prints this message and exits
+
+)",
+        name);
+}
+
+/// \brief Checks if string matches prefix and captures remaninder
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix, points to remaninder
+/// \returns True if string matches prefix, false otherwise
+static bool stringval(const char *pre, const char *str, const char **val) {
+    size_t len = strlen(pre);
+    if (strncmp(pre, str, len) == 0) {
+        *val = str + len;
+        return true;
+    }
+    return false;
+}
+
+/// \brief Checks if string matches prefix and captures an unsigned integer after it
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix and has a valid number, receives it
+/// \returns True if string matches prefix, false otherwise. Exits on invalid numbers.
+static bool uintval(const char *pre, const char *str, uint64_t *val) {
+    const char *digits = nullptr;
+    if (!stringval(pre, str, &digits)) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    *val = strtoull(digits, &end, 0);
+    if (errno != 0 || *digits == '\0' || *end != '\0') {
+        std::cerr << "invalid " << pre << '\n';
+        exit(1);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) try {
+    bench_config_type config;
+    config.max_inputs = UINT64_C(1) << 20;
+    config.growth = 16;
+    config.repetitions = 3;
+    config.min_operations = UINT64_C(1) << 16;
+    config.proof_samples = 4096;
+
+    for (int i = 1; i < argc; i++) {
+        const char *str = nullptr;
+        if (uintval("--max-inputs=", argv[i], &config.max_inputs)) {
+            ;
+        } else if (uintval("--growth=", argv[i], &config.growth)) {
+            ;
+        } else if (uintval("--repetitions=", argv[i], &config.repetitions)) {
+            ;
+        } else if (uintval("--min-operations=", argv[i], &config.min_operations)) {
+            ;
+        } else if (uintval("--proof-samples=", argv[i], &config.proof_samples)) {
+            ;
+        } else if (stringval("--output=", argv[i], &str)) {
+            config.output = str;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            help(argv[0]);
+            exit(0);
+        } else {
+            std::cerr << "invalid option " << argv[i] << '\n';
+            exit(1);
+        }
+    }
+
+    if (config.max_inputs == 0 || config.max_inputs > (UINT64_C(1) << (LOG2_ROOT_SIZE - LOG2_KECCAK_SIZE)) ||
+        config.growth < 2 || config.repetitions == 0 || config.proof_samples == 0) {
+        std::cerr << "invalid max-inputs, growth, repetitions, or proof-samples\n";
+        exit(1);
+    }
+
+    std::vector<epoch_results_type> epochs;
+    for (uint64_t inputs = 1;;) {
+        std::cerr << "Measuring epoch with " << inputs << " inputs\n";
+        epochs.push_back(bench_epoch(config, inputs));
+        if (inputs == config.max_inputs) {
+            break;
+        }
+        inputs = inputs > config.max_inputs / config.growth ? config.max_inputs : inputs * config.growth;
+    }
+
+    if (config.output.empty()) {
+        write_results(std::cout, config, epochs);
+    } else {
+        std::ofstream out(config.output);
+        write_results(out, config, epochs);
+        if (!out) {
+            std::cerr << "failed writing " << config.output << '\n';
+            return 1;
+        }
+    }
+    return 0;
+} catch (std::exception &e) {
+    std::cerr << "Caught exception: " << e.what() << '\n';
+    return 1;
+} catch (...) {
+    std::cerr << "Caught unknown exception\n";
+    return 1;
+}
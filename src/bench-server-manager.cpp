@@ -0,0 +1,518 @@
+// Copyright Cartesi and individual authors (see AUTHORS)
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+/// \file
+/// \brief Throughput and latency benchmark of the server manager RPCs.
+/// \details Drives several sessions concurrently, each in its own thread, through a number of epochs. Results are
+/// written as JSON, so they can be compared between releases.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#pragma GCC diagnostic ignored "-Wdeprecated-copy"
+#pragma GCC diagnostic ignored "-Wtype-limits"
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-builtins"
+#endif
+#include <grpc++/grpc++.h>
+
+#include "server-manager.grpc.pb.h"
+#pragma GCC diagnostic pop
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+using CartesiMachine::Void;
+using namespace CartesiServerManager;
+
+using clock_type = std::chrono::steady_clock;
+using time_point_type = clock_type::time_point;
+
+constexpr const uint64_t EVM_ADDRESS_LENGTH = 20;
+constexpr const uint64_t EPOCH_STATUS_WAIT_MS = 1000;
+constexpr const auto ABORTED_RETRY_INTERVAL = std::chrono::milliseconds(1);
+
+/// \brief Type holding the command-line configuration
+struct bench_config_type {
+    std::string manager_address;   ///< Address of the server manager
+    std::string machine_directory; ///< Machine directory passed to StartSession
+    uint64_t sessions{};           ///< Number of concurrent sessions
+    uint64_t epochs{};             ///< Number of epochs finished in each session
+    uint64_t epoch_length{};       ///< Number of inputs in each epoch
+    uint64_t input_size{};         ///< Size of each input and query payload
+    uint64_t inspect_percent{};    ///< Percentage of requests that are InspectState instead of AdvanceState
+    std::string output;            ///< File receiving the results, or empty for stdout
+};
+
+/// \brief Type holding the results of a session, later merged with those of other sessions
+struct bench_results_type {
+    std::map<std::string, std::vector<uint64_t>> latencies_us; ///< Latency samples by RPC, in microseconds
+    std::map<std::string, uint64_t> aborted;                   ///< Calls retried because the session was busy
+    uint64_t inputs{};                                          ///< Inputs processed
+    uint64_t queries{};                                         ///< Queries answered
+    uint64_t vouchers{};                                        ///< Vouchers in processed inputs
+    uint64_t notices{};                                         ///< Notices in processed inputs
+    uint64_t reports{};                                         ///< Reports in processed inputs
+    uint64_t proofs{};                                          ///< Proofs returned by FinishEpoch
+    time_point_type start{time_point_type::max()};              ///< When the first AdvanceState was sent
+    time_point_type end{time_point_type::min()};                ///< When the last input was processed
+};
+
+/// \brief Returns microseconds elapsed since a time point
+/// \param start Time point
+static uint64_t elapsed_us(time_point_type start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count());
+}
+
+/// \brief Calls an RPC, recording its latency and retrying while the session is busy
+/// \param results Results receiving the latency
+/// \param name RPC name
+/// \param call Function that receives a ClientContext and calls the RPC
+/// \details Throws std::runtime_error if the call fails
+template <typename F>
+static void timed_call(bench_results_type &results, const std::string &name, F call) {
+    for (;;) {
+        grpc::ClientContext client_context;
+        auto start = clock_type::now();
+        auto status = call(client_context);
+        auto us = elapsed_us(start);
+        if (status.error_code() == grpc::StatusCode::ABORTED) {
+            ++results.aborted[name];
+            std::this_thread::sleep_for(ABORTED_RETRY_INTERVAL);
+            continue;
+        }
+        if (!status.ok()) {
+            throw std::runtime_error(name + " failed (" + std::to_string(status.error_code()) + ", " +
+                status.error_message() + ")");
+        }
+        results.latencies_us[name].push_back(us);
+        return;
+    }
+}
+
+/// \brief Returns a payload with pseudo-random contents
+/// \param gen Random number generator
+/// \param size Payload size
+static std::string get_payload(std::mt19937_64 &gen, uint64_t size) {
+    std::string payload(size, '\0');
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::generate(payload.begin(), payload.end(), [&]() { return static_cast<char>(byte(gen)); });
+    return payload;
+}
+
+/// \brief Waits for all inputs of an epoch to be processed, recording the latency of each input
+/// \param stub Server manager stub
+/// \param results Results receiving latencies and output counts
+/// \param session_id Session id
+/// \param epoch_index Epoch index
+/// \param sent When each input in the epoch was sent
+/// \details Uses the inputs-offset and inputs-wait metadata of GetEpochStatus, so the manager answers as soon as
+/// there are new processed inputs, without their payloads
+static void wait_processed_inputs(ServerManager::Stub &stub, bench_results_type &results,
+    const std::string &session_id, uint64_t epoch_index, const std::vector<time_point_type> &sent) {
+    GetEpochStatusRequest request;
+    request.set_session_id(session_id);
+    request.set_epoch_index(epoch_index);
+    uint64_t processed = 0;
+    while (processed < sent.size()) {
+        GetEpochStatusResponse response;
+        timed_call(results, "GetEpochStatus", [&](grpc::ClientContext &client_context) {
+            client_context.AddMetadata("inputs-offset", std::to_string(processed));
+            client_context.AddMetadata("inputs-wait", std::to_string(EPOCH_STATUS_WAIT_MS));
+            client_context.AddMetadata("inputs-without-payloads", "1");
+            return stub.GetEpochStatus(&client_context, request, &response);
+        });
+        if (response.has_taint_status()) {
+            throw std::runtime_error("session tainted (" + response.taint_status().error_message() + ")");
+        }
+        auto now = clock_type::now();
+        for (const auto &input : response.processed_inputs()) {
+            if (processed >= sent.size()) {
+                break;
+            }
+            results.latencies_us["InputProcessing"].push_back(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - sent[processed]).count()));
+            if (input.has_accepted_data()) {
+                results.vouchers += input.accepted_data().vouchers_size();
+                results.notices += input.accepted_data().notices_size();
+            }
+            results.reports += input.reports_size();
+            ++processed;
+        }
+        results.end = std::max(results.end, now);
+    }
+    results.inputs += processed;
+}
+
+/// \brief Drives a session through all its epochs
+/// \param config Command-line configuration
+/// \param session_index Index of session, used to build its id and seed its payloads
+/// \param results Receives the results of the session
+static void run_session(const bench_config_type &config, uint64_t session_index, bench_results_type &results) {
+    auto stub = ServerManager::NewStub(grpc::CreateChannel(config.manager_address, grpc::InsecureChannelCredentials()));
+    std::mt19937_64 gen(session_index);
+    std::uniform_int_distribution<uint64_t> percent(0, 99);
+    const auto session_id = "bench-" + std::to_string(getpid()) + "-" + std::to_string(session_index);
+
+    StartSessionRequest start_request;
+    start_request.set_session_id(session_id);
+    start_request.set_machine_directory(config.machine_directory);
+    start_request.set_active_epoch_index(0);
+    auto *server_cycles = start_request.mutable_server_cycles();
+    server_cycles->set_max_advance_state(UINT64_MAX >> 2);
+    server_cycles->set_advance_state_increment(1 << 22);
+    server_cycles->set_max_inspect_state(UINT64_MAX >> 2);
+    server_cycles->set_inspect_state_increment(1 << 22);
+    auto *server_deadline = start_request.mutable_server_deadline();
+    server_deadline->set_checkin(1000ULL * 60);
+    server_deadline->set_advance_state(1000ULL * 60 * 3);
+    server_deadline->set_advance_state_increment(1000ULL * 10);
+    server_deadline->set_inspect_state(1000ULL * 60 * 3);
+    server_deadline->set_inspect_state_increment(1000ULL * 10);
+    server_deadline->set_machine(1000ULL * 60);
+    server_deadline->set_store(1000ULL * 60 * 3);
+    server_deadline->set_fast(1000ULL * 5);
+    StartSessionResponse start_response;
+    timed_call(results, "StartSession", [&](grpc::ClientContext &client_context) {
+        return stub->StartSession(&client_context, start_request, &start_response);
+    });
+
+    uint64_t input_index = 0;
+    for (uint64_t epoch_index = 0; epoch_index < config.epochs; ++epoch_index) {
+        std::vector<time_point_type> sent;
+        sent.reserve(config.epoch_length);
+        while (sent.size() < config.epoch_length) {
+            if (percent(gen) < config.inspect_percent) {
+                InspectStateRequest inspect_request;
+                inspect_request.set_session_id(session_id);
+                inspect_request.set_query_payload(get_payload(gen, config.input_size));
+                InspectStateResponse inspect_response;
+                timed_call(results, "InspectState", [&](grpc::ClientContext &client_context) {
+                    return stub->InspectState(&client_context, inspect_request, &inspect_response);
+                });
+                ++results.queries;
+                continue;
+            }
+            AdvanceStateRequest advance_request;
+            advance_request.set_session_id(session_id);
+            advance_request.set_active_epoch_index(epoch_index);
+            advance_request.set_current_input_index(input_index);
+            auto *metadata = advance_request.mutable_input_metadata();
+            metadata->mutable_msg_sender()->set_data(get_payload(gen, EVM_ADDRESS_LENGTH));
+            metadata->set_block_number(input_index);
+            metadata->set_timestamp(static_cast<uint64_t>(std::time(nullptr)));
+            metadata->set_epoch_index(0);
+            metadata->set_input_index(input_index);
+            advance_request.set_input_payload(get_payload(gen, config.input_size));
+            Void advance_response;
+            auto start = clock_type::now();
+            results.start = std::min(results.start, start);
+            timed_call(results, "AdvanceState", [&](grpc::ClientContext &client_context) {
+                return stub->AdvanceState(&client_context, advance_request, &advance_response);
+            });
+            sent.push_back(start);
+            ++input_index;
+        }
+        wait_processed_inputs(*stub, results, session_id, epoch_index, sent);
+        FinishEpochRequest finish_request;
+        finish_request.set_session_id(session_id);
+        finish_request.set_active_epoch_index(epoch_index);
+        finish_request.set_processed_input_count_within_epoch(config.epoch_length);
+        FinishEpochResponse finish_response;
+        timed_call(results, "FinishEpoch", [&](grpc::ClientContext &client_context) {
+            return stub->FinishEpoch(&client_context, finish_request, &finish_response);
+        });
+        results.proofs += finish_response.proofs_size();
+    }
+
+    EndSessionRequest end_request;
+    end_request.set_session_id(session_id);
+    Void end_response;
+    timed_call(results, "EndSession", [&](grpc::ClientContext &client_context) {
+        return stub->EndSession(&client_context, end_request, &end_response);
+    });
+}
+
+/// \brief Merges the results of a session into the total
+/// \param total Total results
+/// \param results Results of a session
+static void merge_results(bench_results_type &total, bench_results_type &results) {
+    for (auto &[name, samples] : results.latencies_us) {
+        auto &total_samples = total.latencies_us[name];
+        total_samples.insert(total_samples.end(), samples.begin(), samples.end());
+    }
+    for (const auto &[name, count] : results.aborted) {
+        total.aborted[name] += count;
+    }
+    total.inputs += results.inputs;
+    total.queries += results.queries;
+    total.vouchers += results.vouchers;
+    total.notices += results.notices;
+    total.reports += results.reports;
+    total.proofs += results.proofs;
+    total.start = std::min(total.start, results.start);
+    total.end = std::max(total.end, results.end);
+}
+
+/// \brief Returns a percentile of sorted samples, using the nearest rank
+/// \param sorted Sorted samples
+/// \param p Percentile, between 0 and 1
+static uint64_t get_percentile(const std::vector<uint64_t> &sorted, double p) {
+    auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+/// \brief Writes the results as JSON
+/// \param out Output stream
+/// \param config Command-line configuration
+/// \param total Results of all sessions
+static void write_results(std::ostream &out, const bench_config_type &config, bench_results_type &total) {
+    double seconds = 0.0;
+    if (total.end > total.start) {
+        seconds = std::chrono::duration<double>(total.end - total.start).count();
+    }
+    auto per_second = [seconds](uint64_t count) { return seconds > 0.0 ? static_cast<double>(count) / seconds : 0.0; };
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"config\": {\"sessions\": " << config.sessions << ", \"epochs\": " << config.epochs
+        << ", \"epoch_length\": " << config.epoch_length << ", \"input_size\": " << config.input_size
+        << ", \"inspect_percent\": " << config.inspect_percent << "},\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"inputs\": " << total.inputs << ",\n";
+    out << "  \"inputs_per_second\": " << per_second(total.inputs) << ",\n";
+    out << "  \"queries\": " << total.queries << ",\n";
+    out << "  \"outputs\": {\"vouchers\": " << total.vouchers << ", \"notices\": " << total.notices
+        << ", \"reports\": " << total.reports << ", \"proofs\": " << total.proofs << "},\n";
+    out << "  \"latency_us\": {";
+    const char *separator = "\n";
+    for (auto &[name, samples] : total.latencies_us) {
+        if (samples.empty()) {
+            continue;
+        }
+        std::sort(samples.begin(), samples.end());
+        uint64_t sum = 0;
+        for (auto us : samples) {
+            sum += us;
+        }
+        out << separator << "    \"" << name << "\": {\"count\": " << samples.size()
+            << ", \"mean\": " << static_cast<double>(sum) / static_cast<double>(samples.size())
+            << ", \"p50\": " << get_percentile(samples, 0.5) << ", \"p99\": " << get_percentile(samples, 0.99)
+            << ", \"p999\": " << get_percentile(samples, 0.999) << ", \"max\": " << samples.back()
+            << ", \"aborted\": " << total.aborted[name] << "}";
+        separator = ",\n";
+    }
+    out << "\n  }\n";
+    out << "}\n";
+}
+
+static void help(const char *name) {
+    (void) fprintf(stderr,
+        R"(Usage:
+
+    %s [--sessions=<n>] [--epochs=<n>] [--epoch-length=<n>] [--input-size=<bytes>]
+        [--inspect-percent=<percent>] [--machine-directory=<path>] [--output=<path>]
+        [--help] <manager-address>
+
+where
+
+    <manager-address>
+      server manager address, where <manager-address> can be
+        <ipv4-hostname/address>:<port>
+        <ipv6-hostname/address>:<port>
+        unix:<path>
+
+    --sessions=<n>
+      number of sessions driven concurrently, each by its own thread
+      default: 4
+
+    --epochs=<n>
+      number of epochs finished in each session
+      default: 2
+
+    --epoch-length=<n>
+      number of inputs in each epoch. all inputs of an epoch are sent
+      before waiting for them to be processed and finishing the epoch
+      default: 64
+
+    --input-size=<bytes>
+      size of the payload of each input and query
+      default: 256
+
+    --inspect-percent=<percent>
+      percentage of the requests that are InspectState instead of
+      AdvanceState
+      default: 0
+
+    --machine-directory=<path>
+      machine started in each session. ignored by
+      mock-remote-cartesi-machine, whose options choose the outputs
+      default: /tmp/server-manager-root/tests/advance-state-machine
+
+    --output=<path>
+      file receiving the results as JSON, instead of stdout. latencies
+      are in microseconds, for each RPC and for InputProcessing, the time
+      from sending an input until GetEpochStatus reports it processed
+
+    --help
+      prints this message and exits
+
+)",
+        name);
+}
+
+/// \brief Checks if string matches prefix and captures remaninder
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix, points to remaninder
+/// \returns True if string matches prefix, false otherwise
+static bool stringval(const char *pre, const char *str, const char **val) {
+    size_t len = strlen(pre);
+    if (strncmp(pre, str, len) == 0) {
+        *val = str + len;
+        return true;
+    }
+    return false;
+}
+
+/// \brief Checks if string matches prefix and captures an unsigned integer after it
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix and has a valid number, receives it
+/// \returns True if string matches prefix, false otherwise. Exits on invalid numbers.
+static bool uintval(const char *pre, const char *str, uint64_t *val) {
+    const char *digits = nullptr;
+    if (!stringval(pre, str, &digits)) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    *val = strtoull(digits, &end, 0);
+    if (errno != 0 || *digits == '\0' || *end != '\0') {
+        std::cerr << "invalid " << pre << '\n';
+        exit(1);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) try {
+    bench_config_type config;
+    config.machine_directory = "/tmp/server-manager-root/tests/advance-state-machine";
+    config.sessions = 4;
+    config.epochs = 2;
+    config.epoch_length = 64;
+    config.input_size = 256;
+
+    for (int i = 1; i < argc; i++) {
+        const char *str = nullptr;
+        if (uintval("--sessions=", argv[i], &config.sessions)) {
+            ;
+        } else if (uintval("--epochs=", argv[i], &config.epochs)) {
+            ;
+        } else if (uintval("--epoch-length=", argv[i], &config.epoch_length)) {
+            ;
+        } else if (uintval("--input-size=", argv[i], &config.input_size)) {
+            ;
+        } else if (uintval("--inspect-percent=", argv[i], &config.inspect_percent)) {
+            ;
+        } else if (stringval("--machine-directory=", argv[i], &str)) {
+            config.machine_directory = str;
+        } else if (stringval("--output=", argv[i], &str)) {
+            config.output = str;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            help(argv[0]);
+            exit(0);
+        } else {
+            config.manager_address = argv[i];
+        }
+    }
+
+    if (config.manager_address.empty()) {
+        std::cerr << "missing manager-address\n";
+        exit(1);
+    }
+    if (config.sessions == 0 || config.epoch_length == 0 || config.inspect_percent >= 100) {
+        std::cerr << "invalid sessions, epoch-length, or inspect-percent\n";
+        exit(1);
+    }
+
+    std::vector<bench_results_type> results(config.sessions);
+    std::vector<std::exception_ptr> errors(config.sessions);
+    std::vector<std::thread> threads;
+    threads.reserve(config.sessions);
+    for (uint64_t i = 0; i < config.sessions; ++i) {
+        threads.emplace_back([&config, &results, &errors, i]() {
+            try {
+                run_session(config, i, results[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bench_results_type total;
+    for (auto &session_results : results) {
+        merge_results(total, session_results);
+    }
+    if (config.output.empty()) {
+        write_results(std::cout, config, total);
+    } else {
+        std::ofstream out(config.output);
+        write_results(out, config, total);
+        if (!out) {
+            std::cerr << "failed writing " << config.output << '\n';
+            return 1;
+        }
+    }
+    return 0;
+} catch (std::exception &e) {
+    std::cerr << "Caught exception: " << e.what() << '\n';
+    return 1;
+} catch (...) {
+    std::cerr << "Caught unknown exception\n";
+    return 1;
+}
@@ -207,6 +207,8 @@ if rollup_init then
   create_machine("one-report-machine", "-- rollup-init echo-dapp --vouchers=0 --notices=0 --reports=1 --verbose");
   create_machine("one-voucher-machine", "-- rollup-init echo-dapp --vouchers=1 --notices=0 --reports=0 --verbose");
   create_machine("advance-rejecting-machine", "-- rollup-init echo-dapp --reject=0 --verbose");
+  create_machine("third-input-rejecting-machine",
+    "-- rollup-init echo-dapp --vouchers=1 --notices=1 --reports=0 --reject=2 --verbose");
   create_machine("inspect-rejecting-machine", "-- rollup-init echo-dapp --reports=0 --reject-inspects --verbose");
 else
   create_machine("advance-state-machine", "-- ioctl-echo-loop --vouchers=2 --notices=2 --reports=2 --verbose=1");
@@ -215,6 +217,8 @@ else
   create_machine("one-report-machine", "-- ioctl-echo-loop --vouchers=0 --notices=0 --reports=1 --verbose=1");
   create_machine("one-voucher-machine", "-- ioctl-echo-loop --vouchers=1 --notices=0 --reports=0 --verbose=1");
   create_machine("advance-rejecting-machine", "-- ioctl-echo-loop --reject=0 --verbose=1");
+  create_machine("third-input-rejecting-machine",
+    "-- ioctl-echo-loop --vouchers=1 --notices=1 --reports=0 --reject=2 --verbose=1");
   create_machine("inspect-rejecting-machine", "-- ioctl-echo-loop --reports=0 --reject-inspects --verbose=1");
 end
 
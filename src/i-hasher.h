@@ -60,6 +60,25 @@ public:
     void end(hash_type &hash) {
         return derived().do_end(hash);
     }
+
+    /// \brief Computes the hashes of the concatenations of consecutive pairs of hashes
+    /// \param children Pointer to 2*count hashes, where each pair is concatenated left to right
+    /// \param count Number of pairs
+    /// \param parents Receives count hashes
+    void concat_hashes(const hash_type *children, size_t count, hash_type *parents) {
+        return derived().do_concat_hashes(children, count, parents);
+    }
+
+protected:
+    /// \brief Default implementation, for hashers that cannot do better than one pair at a time
+    void do_concat_hashes(const hash_type *children, size_t count, hash_type *parents) {
+        for (size_t i = 0; i < count; ++i) {
+            begin();
+            add_data(children[2 * i].data(), children[2 * i].size());
+            add_data(children[2 * i + 1].data(), children[2 * i + 1].size());
+            end(parents[i]);
+        }
+    }
 };
 
 template <typename DERIVED>
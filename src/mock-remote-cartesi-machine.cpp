@@ -0,0 +1,889 @@
+// Copyright Cartesi and individual authors (see AUTHORS)
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+/// \file
+/// \brief Stand-in for remote-cartesi-machine that does not emulate anything.
+/// \details It implements the part of the Machine and MachineCheckIn contract used by the server manager. Only the
+/// rollup memory ranges exist, kept in memory. Each advance or inspect request follows a script of yields, so the
+/// manager can be benchmarked without the emulator and without the machines built by create-machines.lua.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#pragma GCC diagnostic ignored "-Wdeprecated-copy"
+#pragma GCC diagnostic ignored "-Wtype-limits"
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-builtins"
+#endif
+#include <boost/endian/conversion.hpp>
+#include <grpc++/grpc++.h>
+
+#include "cartesi-machine-checkin.grpc.pb.h"
+#include "cartesi-machine.grpc.pb.h"
+#pragma GCC diagnostic pop
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+#include <htif-defines.h>
+
+#include "complete-merkle-tree.h"
+#include "keccak-256-hasher.h"
+#include "pristine-merkle-tree.h"
+#include "protobuf-util.h"
+
+using namespace CartesiMachine;
+using namespace Versioning;
+
+using hasher_type = cartesi::keccak_256_hasher;
+using hash_type = hasher_type::hash_type;
+using proof_type = cartesi::complete_merkle_tree::proof_type;
+
+static constexpr uint32_t machine_version_major = 0;
+static constexpr uint32_t machine_version_minor = 7;
+static constexpr uint32_t machine_version_patch = 0;
+
+constexpr const uint64_t ROLLUP_INSPECT_STATE = 1;
+
+constexpr const int LOG2_MACHINE_SIZE = 64;
+constexpr const int LOG2_WORD_SIZE = 3;
+constexpr const uint64_t WORD_SIZE = UINT64_C(1) << LOG2_WORD_SIZE;
+constexpr const uint64_t KECCAK_SIZE = 32;
+constexpr const uint64_t EVM_ADDRESS_LENGTH = 20;
+constexpr const uint64_t EVM_ABI_WORD_LENGTH = 32;
+constexpr const uint64_t EVM_ABI_STRING_HEADER_LENGTH = 2 * EVM_ABI_WORD_LENGTH;
+
+constexpr const int CHECKIN_RETRIES = 500;
+constexpr const auto CHECKIN_RETRY_INTERVAL = std::chrono::milliseconds(10);
+
+/// \brief Indices of the rollup memory ranges
+enum range_index : size_t { rx_buffer, tx_buffer, input_metadata, voucher_hashes, notice_hashes, range_count };
+
+/// \brief Type holding a memory range
+struct memory_range_type {
+    uint64_t start{};  ///< Start of range in machine address space
+    uint64_t length{}; ///< Length of range, a power of two
+    std::string data;  ///< Contents of range
+    /// Merkle tree of range contents, built when first needed after the contents change
+    std::optional<cartesi::complete_merkle_tree> tree;
+};
+
+/// \brief Type holding everything that is rolled back to a snapshot
+struct machine_state_type {
+    std::array<memory_range_type, range_count> ranges; ///< Rollup memory ranges
+    uint64_t mcycle{};                                  ///< Value of mcycle
+    uint64_t tohost{};                                  ///< Value of htif.tohost
+    uint64_t fromhost{};                                ///< Value of htif.fromhost
+    bool iflags_h{};                                    ///< Machine is halted
+    bool iflags_y{};                                    ///< Machine yielded manually
+    bool iflags_x{};                                    ///< Machine yielded automatically
+    bool serving{};                                     ///< Machine is serving an advance or inspect request
+    const std::string *script{};                        ///< Script of yields for request being served
+    size_t script_position{};                           ///< Next yield in script
+    uint64_t next_yield_mcycle{};                       ///< Value of mcycle at next yield
+    uint64_t voucher_count{};                           ///< Vouchers emitted for request being served
+    uint64_t notice_count{};                            ///< Notices emitted for request being served
+};
+
+/// \brief Type holding the command-line configuration
+struct mock_config_type {
+    std::string session_id;       ///< Id used when checking in
+    std::string checkin_address;  ///< Address of the server manager
+    std::string server_address;   ///< Address the machine server binds to, with the port picked by the OS
+    std::string advance_script;   ///< Yields for each advance state request
+    std::string inspect_script;   ///< Yields for each inspect state request
+    uint64_t cycles_per_yield{};  ///< Cycles between consecutive yields
+    uint64_t latency_us{};        ///< Delay before serving each call
+    uint64_t run_latency_us{};    ///< Additional delay before serving each Run
+};
+
+/// \brief Builds the value of htif.tohost or htif.fromhost for a yield
+/// \param cmd Yield command (manual or automatic)
+/// \param data Data field
+static constexpr uint64_t htif_yield(uint64_t cmd, uint64_t data) {
+    return (static_cast<uint64_t>(HTIF_DEVICE_YIELD_DEF) << HTIF_DEV_SHIFT_DEF) |
+        ((cmd << HTIF_CMD_SHIFT_DEF) & HTIF_CMD_MASK_DEF) | ((data << HTIF_DATA_SHIFT_DEF) & HTIF_DATA_MASK_DEF);
+}
+
+/// \brief Extracts the data field from htif.tohost or htif.fromhost
+/// \param reg Register value
+static constexpr uint64_t htif_data_field(uint64_t reg) {
+    return (reg & HTIF_DATA_MASK_DEF) >> HTIF_DATA_SHIFT_DEF;
+}
+
+/// \brief Returns the mask of all bits below a node of a given size
+/// \param log2_size Log<sub>2</sub> of node size
+static constexpr uint64_t node_mask(int log2_size) {
+    return log2_size >= 64 ? UINT64_MAX : (UINT64_C(1) << log2_size) - 1;
+}
+
+/// \brief Returns the pristine hashes for every node size in the machine
+static const cartesi::pristine_merkle_tree &get_pristine() {
+    static const cartesi::pristine_merkle_tree pristine{LOG2_MACHINE_SIZE, LOG2_WORD_SIZE};
+    return pristine;
+}
+
+/// \brief Returns the Merkle tree of a memory range, building it if its contents changed
+/// \param range Memory range
+/// \details Words past the last non-null word are pristine and are not hashed
+static const cartesi::complete_merkle_tree &get_range_tree(memory_range_type &range) {
+    if (!range.tree.has_value()) {
+        auto word_count = range.length / WORD_SIZE;
+        while (word_count > 0) {
+            const char *word = &range.data[(word_count - 1) * WORD_SIZE];
+            if (std::any_of(word, word + WORD_SIZE, [](char c) { return c != 0; })) {
+                break;
+            }
+            --word_count;
+        }
+        cartesi::complete_merkle_tree::level_type leaves(word_count);
+        hasher_type h;
+        for (uint64_t word_index = 0; word_index < word_count; ++word_index) {
+            h.begin();
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            h.add_data(reinterpret_cast<const unsigned char *>(&range.data[word_index * WORD_SIZE]), WORD_SIZE);
+            h.end(leaves[word_index]);
+        }
+        auto log2_size = __builtin_ctzll(range.length);
+        range.tree.emplace(log2_size, LOG2_WORD_SIZE, LOG2_WORD_SIZE, std::move(leaves));
+    }
+    return range.tree.value();
+}
+
+/// \brief Returns the hash of a node in the machine Merkle tree
+/// \param state Machine state
+/// \param address Node address, aligned to its size
+/// \param log2_size Log<sub>2</sub> of node size
+/// \details Memory outside the rollup memory ranges is pristine, so only nodes on the paths from the root to the
+/// ranges are hashed
+static hash_type get_node_hash(machine_state_type &state, uint64_t address, int log2_size) {
+    const uint64_t last = address + node_mask(log2_size);
+    bool intersects = false;
+    for (auto &range : state.ranges) {
+        const uint64_t range_last = range.start + range.length - 1;
+        if (address >= range.start && last <= range_last) {
+            return get_range_tree(range).get_node_hash(address - range.start, log2_size);
+        }
+        intersects = intersects || (address <= range_last && range.start <= last);
+    }
+    if (!intersects) {
+        return get_pristine().get_hash(log2_size);
+    }
+    const uint64_t half = UINT64_C(1) << (log2_size - 1);
+    hasher_type h;
+    return cartesi::get_concat_hash(h, get_node_hash(state, address, log2_size - 1),
+        get_node_hash(state, address + half, log2_size - 1));
+}
+
+/// \brief Finds the memory range that contains an interval of addresses
+/// \param state Machine state
+/// \param address Start of interval
+/// \param length Length of interval
+/// \return Pointer to memory range, or nullptr if there is none
+static memory_range_type *find_range(machine_state_type &state, uint64_t address, uint64_t length) {
+    for (auto &range : state.ranges) {
+        if (address >= range.start && length <= range.length && address - range.start <= range.length - length) {
+            return &range;
+        }
+    }
+    return nullptr;
+}
+
+/// \brief Encodes a 64-bit integer as an EVM ABI uint256
+/// \param value Value to encode
+static std::string evm_abi_uint(uint64_t value) {
+    std::string word(EVM_ABI_WORD_LENGTH, '\0');
+    boost::endian::endian_store<uint64_t, sizeof(uint64_t), boost::endian::order::big>(
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        reinterpret_cast<unsigned char *>(&word[EVM_ABI_WORD_LENGTH - sizeof(uint64_t)]), value);
+    return word;
+}
+
+/// \brief Returns the payload of the request being served, read from the rx buffer
+/// \param state Machine state
+/// \details The payload is echoed in every output, as the echo dapp does
+static std::string get_rx_payload(const machine_state_type &state) {
+    const auto &rx = state.ranges[rx_buffer].data;
+    if (rx.size() < EVM_ABI_STRING_HEADER_LENGTH) {
+        return {};
+    }
+    const auto length = boost::endian::endian_load<uint64_t, sizeof(uint64_t), boost::endian::order::big>(
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        reinterpret_cast<const unsigned char *>(&rx[EVM_ABI_STRING_HEADER_LENGTH - sizeof(uint64_t)]));
+    const auto max_length = rx.size() - EVM_ABI_STRING_HEADER_LENGTH;
+    return rx.substr(EVM_ABI_STRING_HEADER_LENGTH, std::min<uint64_t>(length, max_length));
+}
+
+/// \brief Writes an entry to the start of the tx buffer
+/// \param state Machine state
+/// \param entry Entry header followed by payload
+/// \details The payload is truncated if it does not fit, but its length in the header is left alone
+static void write_tx_entry(machine_state_type &state, const std::string &entry) {
+    auto &tx = state.ranges[tx_buffer];
+    tx.data.replace(0, std::min<uint64_t>(entry.size(), tx.length), entry, 0, tx.length);
+    tx.tree.reset();
+}
+
+/// \brief Appends the hash of an output to a hashes memory range
+/// \param state Machine state
+/// \param index Index of hashes memory range
+/// \param count Number of hashes already in memory range
+/// \param entry Output whose hash is appended
+static void write_output_hash(machine_state_type &state, range_index index, uint64_t &count,
+    const std::string &entry) {
+    auto &range = state.ranges[index];
+    if ((count + 1) * KECCAK_SIZE > range.length) {
+        return;
+    }
+    hasher_type h;
+    hash_type hash;
+    h.begin();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    h.add_data(reinterpret_cast<const unsigned char *>(entry.data()), entry.size());
+    h.end(hash);
+    std::copy(hash.begin(), hash.end(), range.data.begin() + static_cast<std::ptrdiff_t>(count * KECCAK_SIZE));
+    range.tree.reset();
+    ++count;
+}
+
+/// \brief Performs the yield given by a character of a script
+/// \param state Machine state
+/// \param what Character from script
+static void yield(machine_state_type &state, char what) {
+    auto payload = get_rx_payload(state);
+    auto string = evm_abi_uint(EVM_ABI_WORD_LENGTH) + evm_abi_uint(payload.size()) + payload;
+    // Pad payload to a multiple of the EVM ABI word length
+    string.resize((string.size() + EVM_ABI_WORD_LENGTH - 1) / EVM_ABI_WORD_LENGTH * EVM_ABI_WORD_LENGTH);
+    uint64_t cmd = HTIF_YIELD_AUTOMATIC_DEF;
+    uint64_t reason = HTIF_YIELD_REASON_PROGRESS_DEF;
+    switch (what) {
+        case 'v': {
+            // Vouchers go to the msg_sender in the input metadata
+            const auto &metadata = state.ranges[input_metadata].data;
+            auto entry = metadata.substr(0, EVM_ABI_WORD_LENGTH);
+            entry.resize(EVM_ABI_WORD_LENGTH);
+            entry += evm_abi_uint(2 * EVM_ABI_WORD_LENGTH) + string.substr(EVM_ABI_WORD_LENGTH);
+            write_tx_entry(state, entry);
+            write_output_hash(state, voucher_hashes, state.voucher_count, entry);
+            reason = HTIF_YIELD_REASON_TX_VOUCHER_DEF;
+            break;
+        }
+        case 'n':
+            write_tx_entry(state, string);
+            write_output_hash(state, notice_hashes, state.notice_count, string);
+            reason = HTIF_YIELD_REASON_TX_NOTICE_DEF;
+            break;
+        case 'r':
+            write_tx_entry(state, string);
+            reason = HTIF_YIELD_REASON_TX_REPORT_DEF;
+            break;
+        case 'e':
+            write_tx_entry(state, string);
+            cmd = HTIF_YIELD_MANUAL_DEF;
+            reason = HTIF_YIELD_REASON_TX_EXCEPTION_DEF;
+            break;
+        case 'a':
+            cmd = HTIF_YIELD_MANUAL_DEF;
+            reason = HTIF_YIELD_REASON_RX_ACCEPTED_DEF;
+            break;
+        case 'j':
+            cmd = HTIF_YIELD_MANUAL_DEF;
+            reason = HTIF_YIELD_REASON_RX_REJECTED_DEF;
+            break;
+        default:
+            break;
+    }
+    // The yield reason goes in bits 32 to 47 of htif.tohost
+    state.tohost = htif_yield(cmd, reason << 32);
+    if (cmd == HTIF_YIELD_MANUAL_DEF) {
+        state.iflags_y = true;
+        state.serving = false;
+        // The next request is an advance state, unless the manager writes an inspect state request over it
+        state.fromhost = htif_yield(HTIF_YIELD_MANUAL_DEF, 0);
+    } else {
+        state.iflags_x = true;
+    }
+}
+
+/// \brief Runs the script of the request being served until the given mcycle or the next yield
+/// \param config Command-line configuration
+/// \param state Machine state
+/// \param limit mcycle limit
+/// \details Once the script is over, the machine keeps running without yielding, as if it were in an infinite loop
+static void run(const mock_config_type &config, machine_state_type &state, uint64_t limit) {
+    if (state.iflags_h || state.iflags_y) {
+        return;
+    }
+    state.iflags_x = false;
+    if (!state.serving) {
+        state.serving = true;
+        state.script = htif_data_field(state.fromhost) == ROLLUP_INSPECT_STATE ? &config.inspect_script :
+                                                                                  &config.advance_script;
+        state.script_position = 0;
+        state.next_yield_mcycle = state.mcycle + config.cycles_per_yield;
+        state.voucher_count = 0;
+        state.notice_count = 0;
+    }
+    if (state.script_position >= state.script->size() || state.next_yield_mcycle > limit) {
+        state.mcycle = std::max(state.mcycle, limit);
+        return;
+    }
+    state.mcycle = state.next_yield_mcycle;
+    state.next_yield_mcycle += config.cycles_per_yield;
+    yield(state, (*state.script)[state.script_position++]);
+}
+
+/// \brief Machine service that keeps the rollup memory ranges in memory and follows scripts of yields
+class MockMachineServiceImpl final : public Machine::Service {
+public:
+    explicit MockMachineServiceImpl(const mock_config_type &config) :
+        m_config(config),
+        m_checkin_stub(
+            MachineCheckIn::NewStub(grpc::CreateChannel(config.checkin_address, grpc::InsecureChannelCredentials()))) {}
+
+    MockMachineServiceImpl(const MockMachineServiceImpl &other) = delete;
+    MockMachineServiceImpl(MockMachineServiceImpl &&other) = delete;
+    MockMachineServiceImpl &operator=(const MockMachineServiceImpl &other) = delete;
+    MockMachineServiceImpl &operator=(MockMachineServiceImpl &&other) = delete;
+
+    /// \brief Destructor, waiting for the last check-in to be done with this service
+    ~MockMachineServiceImpl() override {
+        if (m_checkin_thread.joinable()) {
+            m_checkin_thread.join();
+        }
+    }
+
+    /// \brief Sets the address to check in with, once the port is known
+    void set_address(std::string address) {
+        m_address = std::move(address);
+    }
+
+    /// \brief Checks in with the server manager, retrying until it is waiting for the check-in
+    bool checkin() {
+        CheckInRequest request;
+        request.set_session_id(m_config.session_id);
+        request.set_address(m_address);
+        for (int i = 0; i < CHECKIN_RETRIES; ++i) {
+            grpc::ClientContext client_context;
+            Void response;
+            if (m_checkin_stub->CheckIn(&client_context, request, &response).ok()) {
+                return true;
+            }
+            std::this_thread::sleep_for(CHECKIN_RETRY_INTERVAL);
+        }
+        std::cerr << "check-in failed for session " << m_config.session_id << '\n';
+        return false;
+    }
+
+    /// \brief Blocks until a Shutdown RPC is received
+    void wait_shutdown() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_shutdown_condition.wait(lock, [this]() { return m_shutdown; });
+    }
+
+private:
+    /// \brief Delays the current call by the configured latency
+    void delay(uint64_t us) const {
+        if (us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(us));
+        }
+    }
+
+    /// \brief Checks in from another thread, after the reply to the current call is sent
+    /// \details The server manager waits for each check-in before sending another Snapshot or Rollback, so the
+    /// thread of the previous check-in is done by now
+    void checkin_later() {
+        if (m_checkin_thread.joinable()) {
+            m_checkin_thread.join();
+        }
+        m_checkin_thread = std::thread([this]() { (void) checkin(); });
+    }
+
+    grpc::Status GetVersion(grpc::ServerContext * /*context*/, const Void * /*request*/,
+        GetVersionResponse *response) override {
+        delay(m_config.latency_us);
+        auto *version = response->mutable_version();
+        version->set_major(machine_version_major);
+        version->set_minor(machine_version_minor);
+        version->set_patch(machine_version_patch);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Machine(grpc::ServerContext * /*context*/, const MachineRequest * /*request*/,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // The machine directory is ignored: every machine has the default rollup memory ranges and starts yielded
+        // manually after accepting, as machines built with the rollup init do
+        static constexpr std::array<std::pair<uint64_t, uint64_t>, range_count> layout{{
+            {UINT64_C(0x60000000), UINT64_C(2) << 20},
+            {UINT64_C(0x60200000), UINT64_C(2) << 20},
+            {UINT64_C(0x60400000), UINT64_C(4096)},
+            {UINT64_C(0x60600000), UINT64_C(2) << 20},
+            {UINT64_C(0x60800000), UINT64_C(2) << 20},
+        }};
+        m_state = machine_state_type{};
+        for (size_t i = 0; i < range_count; ++i) {
+            auto &range = m_state.ranges[i];
+            range.start = layout[i].first;
+            range.length = layout[i].second;
+            range.data.assign(range.length, '\0');
+        }
+        m_state.tohost = htif_yield(HTIF_YIELD_MANUAL_DEF, uint64_t{HTIF_YIELD_REASON_RX_ACCEPTED_DEF} << 32);
+        m_state.fromhost = htif_yield(HTIF_YIELD_MANUAL_DEF, 0);
+        m_state.iflags_y = true;
+        m_snapshot.reset();
+        m_initialized = true;
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Run(grpc::ServerContext * /*context*/, const RunRequest *request, RunResponse *response) override {
+        delay(m_config.latency_us + m_config.run_latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return no_machine();
+        }
+        run(m_config, m_state, request->limit());
+        response->set_mcycle(m_state.mcycle);
+        response->set_tohost(m_state.tohost);
+        response->set_iflags_h(m_state.iflags_h);
+        response->set_iflags_y(m_state.iflags_y);
+        response->set_iflags_x(m_state.iflags_x);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Store(grpc::ServerContext * /*context*/, const StoreRequest * /*request*/,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        return {grpc::StatusCode::UNIMPLEMENTED, "mock machine cannot be stored"};
+    }
+
+    grpc::Status Destroy(grpc::ServerContext * /*context*/, const Void * /*request*/, Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_initialized = false;
+        m_snapshot.reset();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Snapshot(grpc::ServerContext * /*context*/, const Void * /*request*/, Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return no_machine();
+        }
+        // There is no fork: the same server keeps serving with the same address
+        m_snapshot = m_state;
+        checkin_later();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Rollback(grpc::ServerContext * /*context*/, const Void * /*request*/, Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_snapshot.has_value()) {
+            return {grpc::StatusCode::FAILED_PRECONDITION, "no snapshot to roll back to"};
+        }
+        m_state = std::move(m_snapshot.value());
+        m_snapshot.reset();
+        checkin_later();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Shutdown(grpc::ServerContext * /*context*/, const Void * /*request*/, Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+        m_shutdown_condition.notify_all();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status ReadMemory(grpc::ServerContext * /*context*/, const ReadMemoryRequest *request,
+        ReadMemoryResponse *response) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto *range = find_range(m_state, request->address(), request->length());
+        if (!range) {
+            return out_of_ranges();
+        }
+        response->set_data(range->data.substr(request->address() - range->start, request->length()));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status WriteMemory(grpc::ServerContext * /*context*/, const WriteMemoryRequest *request,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto *range = find_range(m_state, request->address(), request->data().size());
+        if (!range) {
+            return out_of_ranges();
+        }
+        range->data.replace(request->address() - range->start, request->data().size(), request->data());
+        range->tree.reset();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status ReadCsr(grpc::ServerContext * /*context*/, const ReadCsrRequest *request,
+        ReadCsrResponse *response) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        switch (request->csr()) {
+            case Csr::MCYCLE:
+                response->set_value(m_state.mcycle);
+                return grpc::Status::OK;
+            case Csr::HTIF_TOHOST:
+                response->set_value(m_state.tohost);
+                return grpc::Status::OK;
+            case Csr::HTIF_FROMHOST:
+                response->set_value(m_state.fromhost);
+                return grpc::Status::OK;
+            default:
+                return unknown_csr();
+        }
+    }
+
+    grpc::Status WriteCsr(grpc::ServerContext * /*context*/, const WriteCsrRequest *request,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        switch (request->csr()) {
+            case Csr::MCYCLE:
+                m_state.mcycle = request->value();
+                return grpc::Status::OK;
+            case Csr::HTIF_TOHOST:
+                m_state.tohost = request->value();
+                return grpc::Status::OK;
+            case Csr::HTIF_FROMHOST:
+                m_state.fromhost = request->value();
+                return grpc::Status::OK;
+            default:
+                return unknown_csr();
+        }
+    }
+
+    grpc::Status GetInitialConfig(grpc::ServerContext * /*context*/, const Void * /*request*/,
+        GetInitialConfigResponse *response) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return no_machine();
+        }
+        auto *config = response->mutable_config();
+        auto *htif = config->mutable_htif();
+        htif->set_yield_manual(true);
+        htif->set_yield_automatic(true);
+        htif->set_console_getchar(false);
+        auto *rollup = config->mutable_rollup();
+        std::array<MemoryRangeConfig *, range_count> range_configs{rollup->mutable_rx_buffer(),
+            rollup->mutable_tx_buffer(), rollup->mutable_input_metadata(), rollup->mutable_voucher_hashes(),
+            rollup->mutable_notice_hashes()};
+        for (size_t i = 0; i < range_count; ++i) {
+            range_configs[i]->set_start(m_state.ranges[i].start);
+            range_configs[i]->set_length(m_state.ranges[i].length);
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status ReplaceMemoryRange(grpc::ServerContext * /*context*/, const ReplaceMemoryRangeRequest *request,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto &config = request->config();
+        auto *range = find_range(m_state, config.start(), config.length());
+        if (!range || range->start != config.start() || range->length != config.length()) {
+            return out_of_ranges();
+        }
+        if (!config.image_filename().empty() || config.shared()) {
+            return {grpc::StatusCode::UNIMPLEMENTED, "mock machine can only clear memory ranges"};
+        }
+        std::fill(range->data.begin(), range->data.end(), '\0');
+        range->tree.reset();
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetRootHash(grpc::ServerContext * /*context*/, const Void * /*request*/,
+        GetRootHashResponse *response) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return no_machine();
+        }
+        cartesi::set_proto_hash(get_node_hash(m_state, 0, LOG2_MACHINE_SIZE), response->mutable_hash());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetProof(grpc::ServerContext * /*context*/, const GetProofRequest *request,
+        GetProofResponse *response) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return no_machine();
+        }
+        const auto address = request->address();
+        const auto log2_size = static_cast<int>(request->log2_size());
+        if (log2_size < LOG2_WORD_SIZE || log2_size > LOG2_MACHINE_SIZE || (address & node_mask(log2_size)) != 0) {
+            return {grpc::StatusCode::INVALID_ARGUMENT, "invalid proof target"};
+        }
+        proof_type proof{LOG2_MACHINE_SIZE, log2_size};
+        proof.set_target_address(address);
+        proof.set_target_hash(get_node_hash(m_state, address, log2_size));
+        for (int log2_sibling_size = log2_size; log2_sibling_size < LOG2_MACHINE_SIZE; ++log2_sibling_size) {
+            const uint64_t sibling_address =
+                (address & ~node_mask(log2_sibling_size)) ^ (UINT64_C(1) << log2_sibling_size);
+            proof.set_sibling_hash(get_node_hash(m_state, sibling_address, log2_sibling_size), log2_sibling_size);
+        }
+        proof.set_root_hash(get_node_hash(m_state, 0, LOG2_MACHINE_SIZE));
+        cartesi::set_proto_merkle_tree_proof(proof, response->mutable_proof());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status ResetIflagsY(grpc::ServerContext * /*context*/, const Void * /*request*/,
+        Void * /*response*/) override {
+        delay(m_config.latency_us);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state.iflags_y = false;
+        return grpc::Status::OK;
+    }
+
+    static grpc::Status no_machine() {
+        return {grpc::StatusCode::FAILED_PRECONDITION, "no machine"};
+    }
+
+    static grpc::Status out_of_ranges() {
+        return {grpc::StatusCode::INVALID_ARGUMENT, "mock machine only has the rollup memory ranges"};
+    }
+
+    static grpc::Status unknown_csr() {
+        return {grpc::StatusCode::INVALID_ARGUMENT, "mock machine only has mcycle, htif.tohost, and htif.fromhost"};
+    }
+
+    const mock_config_type &m_config;
+    std::unique_ptr<MachineCheckIn::Stub> m_checkin_stub;
+    std::string m_address;
+    std::mutex m_mutex;
+    std::condition_variable m_shutdown_condition;
+    bool m_shutdown{false};
+    bool m_initialized{false};
+    machine_state_type m_state;
+    std::optional<machine_state_type> m_snapshot;
+    std::thread m_checkin_thread;
+};
+
+/// \brief Replaces the port specification (i.e., after ':') in an address
+/// with a new port
+/// \param address Original address
+/// \param port New port
+/// \return New address with replaced port
+static std::string replace_port(const std::string &address, int port) {
+    // Unix address?
+    if (address.find("unix:") == 0) {
+        return address;
+    }
+    auto pos = address.find_last_of(':');
+    // If already has a port, replace
+    if (pos != std::string::npos) {
+        return address.substr(0, pos) + ":" + std::to_string(port);
+        // Otherwise, concatenate
+    } else {
+        return address + ":" + std::to_string(port);
+    }
+}
+
+static void help(const char *name) {
+    (void) fprintf(stderr,
+        R"(Usage:
+
+    %s --session-id=<id> --checkin-address=<address> --server-address=<address>
+        [--advance-script=<yields>] [--inspect-script=<yields>] [--cycles-per-yield=<n>]
+        [--latency=<us>] [--run-latency=<us>] [--help]
+
+Stand-in for remote-cartesi-machine, for benchmarking the server manager
+without the emulator. Start the server manager with
+
+    --remote-cartesi-machine="<path-to>/mock-remote-cartesi-machine <options>"
+
+where
+
+    --session-id=<id>
+    --checkin-address=<address>
+    --server-address=<address>
+      passed by the server manager, as to remote-cartesi-machine
+
+    --advance-script=<yields>
+      yields of the machine while serving each advance state request,
+      one character per yield, echoing the input payload in outputs:
+        v  voucher
+        n  notice
+        r  report
+        e  exception (ends the request)
+        a  accept (ends the request)
+        j  reject (ends the request)
+      the machine runs without yielding after the script is over, until
+      it reaches the cycle limit
+      default: vnra
+
+    --inspect-script=<yields>
+      yields of the machine while serving each inspect state request
+      default: ra
+
+    --cycles-per-yield=<n>
+      cycles the machine runs before each yield
+      default: 1000
+
+    --latency=<us>
+      microseconds to wait before serving each call
+      default: 0
+
+    --run-latency=<us>
+      additional microseconds to wait before serving each Run
+      default: 0
+
+    --help
+      prints this message and exits
+
+)",
+        name);
+}
+
+/// \brief Checks if string matches prefix and captures remaninder
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix, points to remaninder
+/// \returns True if string matches prefix, false otherwise
+static bool stringval(const char *pre, const char *str, const char **val) {
+    size_t len = strlen(pre);
+    if (strncmp(pre, str, len) == 0) {
+        *val = str + len;
+        return true;
+    }
+    return false;
+}
+
+/// \brief Checks if string matches prefix and captures an unsigned integer after it
+/// \param pre Prefix to match in str.
+/// \param str Input string
+/// \param val If string matches prefix and has a valid number, receives it
+/// \returns True if string matches prefix, false otherwise. Exits on invalid numbers.
+static bool uintval(const char *pre, const char *str, uint64_t *val) {
+    const char *digits = nullptr;
+    if (!stringval(pre, str, &digits)) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    *val = strtoull(digits, &end, 0);
+    if (errno != 0 || *digits == '\0' || *end != '\0') {
+        std::cerr << "invalid " << pre << '\n';
+        exit(1);
+    }
+    return true;
+}
+
+/// \brief Checks that a script only has known yields
+/// \param script Script to check
+static bool is_valid_script(const std::string &script) {
+    return script.find_first_not_of("vnreaj") == std::string::npos;
+}
+
+int main(int argc, char *argv[]) try {
+    mock_config_type config;
+    config.advance_script = "vnra";
+    config.inspect_script = "ra";
+    config.cycles_per_yield = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        const char *str = nullptr;
+        if (stringval("--session-id=", argv[i], &str)) {
+            config.session_id = str;
+        } else if (stringval("--checkin-address=", argv[i], &str)) {
+            config.checkin_address = str;
+        } else if (stringval("--server-address=", argv[i], &str)) {
+            config.server_address = str;
+        } else if (stringval("--advance-script=", argv[i], &str)) {
+            config.advance_script = str;
+        } else if (stringval("--inspect-script=", argv[i], &str)) {
+            config.inspect_script = str;
+        } else if (uintval("--cycles-per-yield=", argv[i], &config.cycles_per_yield)) {
+            ;
+        } else if (uintval("--latency=", argv[i], &config.latency_us)) {
+            ;
+        } else if (uintval("--run-latency=", argv[i], &config.run_latency_us)) {
+            ;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            help(argv[0]);
+            exit(0);
+        } else {
+            std::cerr << "unknown option " << argv[i] << '\n';
+            exit(1);
+        }
+    }
+
+    if (config.session_id.empty() || config.checkin_address.empty() || config.server_address.empty()) {
+        std::cerr << "missing session-id, checkin-address, or server-address\n";
+        exit(1);
+    }
+    if (!is_valid_script(config.advance_script) || !is_valid_script(config.inspect_script)) {
+        std::cerr << "invalid script\n";
+        exit(1);
+    }
+    if (config.cycles_per_yield == 0) {
+        std::cerr << "invalid cycles-per-yield\n";
+        exit(1);
+    }
+
+    MockMachineServiceImpl service(config);
+    grpc::ServerBuilder builder;
+    int server_port = 0;
+    builder.AddListeningPort(config.server_address, grpc::InsecureServerCredentials(), &server_port);
+    builder.RegisterService(&service);
+    auto server = builder.BuildAndStart();
+    if (!server) {
+        std::cerr << "server creation failed\n";
+        exit(1);
+    }
+    service.set_address(replace_port(config.server_address, server_port));
+    if (!service.checkin()) {
+        exit(1);
+    }
+    service.wait_shutdown();
+    server->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+    server->Wait();
+    return 0;
+} catch (std::exception &e) {
+    std::cerr << "Caught exception: " << e.what() << '\n';
+    return 1;
+} catch (...) {
+    std::cerr << "Caught unknown exception\n";
+    return 1;
+}
@@ -0,0 +1,247 @@
+// Copyright Cartesi and individual authors (see AUTHORS)
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "multi-buffer-keccak-256-hasher.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace cartesi {
+
+// Keccak 256 absorbs 136 bytes per permutation, so each 64-byte input (the
+// concatenation of two hashes) takes a single permutation once padded.
+// Hashing many such inputs is therefore a matter of running independent
+// permutations, one per SIMD lane, with the state transposed so lane i of
+// every state word belongs to input i.
+
+namespace {
+
+constexpr std::array<uint64_t, 24> keccak_round_constants{UINT64_C(0x0000000000000001), UINT64_C(0x0000000000008082),
+    UINT64_C(0x800000000000808a), UINT64_C(0x8000000080008000), UINT64_C(0x000000000000808b),
+    UINT64_C(0x0000000080000001), UINT64_C(0x8000000080008081), UINT64_C(0x8000000000008009),
+    UINT64_C(0x000000000000008a), UINT64_C(0x0000000000000088), UINT64_C(0x0000000080008009),
+    UINT64_C(0x000000008000000a), UINT64_C(0x000000008000808b), UINT64_C(0x800000000000008b),
+    UINT64_C(0x8000000000008089), UINT64_C(0x8000000000008003), UINT64_C(0x8000000000008002),
+    UINT64_C(0x8000000000000080), UINT64_C(0x000000000000800a), UINT64_C(0x800000008000000a),
+    UINT64_C(0x8000000080008081), UINT64_C(0x8000000000008080), UINT64_C(0x0000000080000001),
+    UINT64_C(0x8000000080008008)};
+
+/// \brief Size of each input, in bytes
+constexpr size_t input_size = 64;
+
+/// \brief Size of each hash, in bytes
+constexpr size_t hash_size = 32;
+
+// Everything below must be inlined into the functions compiled for each
+// instruction set, so it is all marked always_inline. Vector types never
+// cross an actual function call, so GCC's ABI notes do not apply.
+#define KECCAK_INLINE inline __attribute__((always_inline)) // NOLINT(cppcoreguidelines-macro-usage)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+KECCAK_INLINE uint64_t load_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+KECCAK_INLINE void store_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+}
+
+template <typename V>
+KECCAK_INLINE void set_lane(V &v, size_t lane, uint64_t value) {
+    v[lane] = value;
+}
+
+KECCAK_INLINE void set_lane(uint64_t &v, size_t /*lane*/, uint64_t value) {
+    v = value;
+}
+
+template <typename V>
+KECCAK_INLINE uint64_t get_lane(const V &v, size_t lane) {
+    return v[lane];
+}
+
+KECCAK_INLINE uint64_t get_lane(const uint64_t &v, size_t /*lane*/) {
+    return v;
+}
+
+template <typename V>
+KECCAK_INLINE V rotate_left(const V &v, int n) {
+    return (v << n) | (v >> (64 - n));
+}
+
+/// \brief Keccak-f[1600] permutation of the states in each lane
+template <typename V>
+KECCAK_INLINE void keccak_f1600(V *a) {
+    for (auto round_constant : keccak_round_constants) {
+        // theta
+        const V c0 = a[0] ^ a[5] ^ a[10] ^ a[15] ^ a[20];
+        const V c1 = a[1] ^ a[6] ^ a[11] ^ a[16] ^ a[21];
+        const V c2 = a[2] ^ a[7] ^ a[12] ^ a[17] ^ a[22];
+        const V c3 = a[3] ^ a[8] ^ a[13] ^ a[18] ^ a[23];
+        const V c4 = a[4] ^ a[9] ^ a[14] ^ a[19] ^ a[24];
+        const V d0 = c4 ^ rotate_left(c1, 1);
+        const V d1 = c0 ^ rotate_left(c2, 1);
+        const V d2 = c1 ^ rotate_left(c3, 1);
+        const V d3 = c2 ^ rotate_left(c4, 1);
+        const V d4 = c3 ^ rotate_left(c0, 1);
+        // rho and pi
+        const V b0 = a[0] ^ d0;
+        const V b1 = rotate_left(a[6] ^ d1, 44);
+        const V b2 = rotate_left(a[12] ^ d2, 43);
+        const V b3 = rotate_left(a[18] ^ d3, 21);
+        const V b4 = rotate_left(a[24] ^ d4, 14);
+        const V b5 = rotate_left(a[3] ^ d3, 28);
+        const V b6 = rotate_left(a[9] ^ d4, 20);
+        const V b7 = rotate_left(a[10] ^ d0, 3);
+        const V b8 = rotate_left(a[16] ^ d1, 45);
+        const V b9 = rotate_left(a[22] ^ d2, 61);
+        const V b10 = rotate_left(a[1] ^ d1, 1);
+        const V b11 = rotate_left(a[7] ^ d2, 6);
+        const V b12 = rotate_left(a[13] ^ d3, 25);
+        const V b13 = rotate_left(a[19] ^ d4, 8);
+        const V b14 = rotate_left(a[20] ^ d0, 18);
+        const V b15 = rotate_left(a[4] ^ d4, 27);
+        const V b16 = rotate_left(a[5] ^ d0, 36);
+        const V b17 = rotate_left(a[11] ^ d1, 10);
+        const V b18 = rotate_left(a[17] ^ d2, 15);
+        const V b19 = rotate_left(a[23] ^ d3, 56);
+        const V b20 = rotate_left(a[2] ^ d2, 62);
+        const V b21 = rotate_left(a[8] ^ d3, 55);
+        const V b22 = rotate_left(a[14] ^ d4, 39);
+        const V b23 = rotate_left(a[15] ^ d0, 41);
+        const V b24 = rotate_left(a[21] ^ d1, 2);
+        // chi
+        a[0] = b0 ^ (~b1 & b2);
+        a[1] = b1 ^ (~b2 & b3);
+        a[2] = b2 ^ (~b3 & b4);
+        a[3] = b3 ^ (~b4 & b0);
+        a[4] = b4 ^ (~b0 & b1);
+        a[5] = b5 ^ (~b6 & b7);
+        a[6] = b6 ^ (~b7 & b8);
+        a[7] = b7 ^ (~b8 & b9);
+        a[8] = b8 ^ (~b9 & b5);
+        a[9] = b9 ^ (~b5 & b6);
+        a[10] = b10 ^ (~b11 & b12);
+        a[11] = b11 ^ (~b12 & b13);
+        a[12] = b12 ^ (~b13 & b14);
+        a[13] = b13 ^ (~b14 & b10);
+        a[14] = b14 ^ (~b10 & b11);
+        a[15] = b15 ^ (~b16 & b17);
+        a[16] = b16 ^ (~b17 & b18);
+        a[17] = b17 ^ (~b18 & b19);
+        a[18] = b18 ^ (~b19 & b15);
+        a[19] = b19 ^ (~b15 & b16);
+        a[20] = b20 ^ (~b21 & b22);
+        a[21] = b21 ^ (~b22 & b23);
+        a[22] = b22 ^ (~b23 & b24);
+        a[23] = b23 ^ (~b24 & b20);
+        a[24] = b24 ^ (~b20 & b21);
+
+        // iota
+        a[0] ^= round_constant;
+    }
+}
+
+/// \brief Hashes count 64-byte inputs, LANES at a time
+template <typename V, size_t LANES>
+KECCAK_INLINE void keccak_256_64(const unsigned char *data, size_t count, unsigned char *hashes) {
+    for (size_t first = 0; first < count; first += LANES) {
+        const size_t lanes = std::min(LANES, count - first);
+        std::array<V, 25> a{};
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const unsigned char *input = data + (first + lane) * input_size;
+            for (size_t word = 0; word < input_size / 8; ++word) {
+                set_lane(a[word], lane, load_le64(input + word * 8));
+            }
+        }
+        // Keccak padding: a 0x01 byte right after the input, and 0x80 in the last byte of the 136-byte block
+        a[input_size / 8] ^= UINT64_C(0x01);
+        a[16] ^= UINT64_C(0x8000000000000000);
+        keccak_f1600(a.data());
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            unsigned char *hash = hashes + (first + lane) * hash_size;
+            for (size_t word = 0; word < hash_size / 8; ++word) {
+                store_le64(hash + word * 8, get_lane(a[word], lane));
+            }
+        }
+    }
+}
+
+void keccak_256_64_generic(const unsigned char *data, size_t count, unsigned char *hashes) {
+    keccak_256_64<uint64_t, 1>(data, count, hashes);
+}
+
+#if defined(__x86_64__)
+
+typedef uint64_t lanes_4_type __attribute__((vector_size(32))); // NOLINT(modernize-use-using)
+typedef uint64_t lanes_8_type __attribute__((vector_size(64))); // NOLINT(modernize-use-using)
+
+__attribute__((target("avx2"))) void keccak_256_64_avx2(const unsigned char *data, size_t count,
+    unsigned char *hashes) {
+    keccak_256_64<lanes_4_type, 4>(data, count, hashes);
+}
+
+__attribute__((target("avx512f"))) void keccak_256_64_avx512(const unsigned char *data, size_t count,
+    unsigned char *hashes) {
+    keccak_256_64<lanes_8_type, 8>(data, count, hashes);
+}
+
+#endif
+
+/// \brief Implementation selected for the processor
+struct keccak_256_64_implementation {
+    void (*hash)(const unsigned char *data, size_t count, unsigned char *hashes);
+    int lanes;
+};
+
+const keccak_256_64_implementation &get_keccak_256_64_implementation(void) {
+    static const keccak_256_64_implementation implementation = []() -> keccak_256_64_implementation {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return {keccak_256_64_avx512, 8};
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return {keccak_256_64_avx2, 4};
+        }
+#endif
+        return {keccak_256_64_generic, 1};
+    }();
+    return implementation;
+}
+
+#undef KECCAK_INLINE
+
+} // namespace
+
+void multi_buffer_keccak_256_64(const unsigned char *data, size_t count, unsigned char *hashes) {
+    get_keccak_256_64_implementation().hash(data, count, hashes);
+}
+
+int multi_buffer_keccak_256_lanes(void) {
+    return get_keccak_256_64_implementation().lanes;
+}
+
+} // namespace cartesi
@@ -0,0 +1,82 @@
+// Copyright Cartesi and individual authors (see AUTHORS)
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef MULTI_BUFFER_KECCAK_256_HASHER_H
+#define MULTI_BUFFER_KECCAK_256_HASHER_H
+
+/// \file
+/// \brief Keccak 256 hasher that computes independent hashes of concatenated hashes in parallel
+
+#include "i-hasher.h"
+#include <cryptopp/keccak.h>
+#include <type_traits>
+
+namespace cartesi {
+
+/// \brief Hashes count independent 64-byte inputs with Keccak 256
+/// \param data Pointer to count consecutive 64-byte inputs
+/// \param count Number of inputs
+/// \param hashes Receives count consecutive 32-byte hashes
+/// \details Uses AVX-512 or AVX2 to hash 8 or 4 inputs at a time, when the processor supports them.
+void multi_buffer_keccak_256_64(const unsigned char *data, size_t count, unsigned char *hashes);
+
+/// \brief Returns the number of inputs multi_buffer_keccak_256_64 hashes in parallel in this processor
+int multi_buffer_keccak_256_lanes(void);
+
+class multi_buffer_keccak_256_hasher final :
+    public i_hasher<multi_buffer_keccak_256_hasher, std::integral_constant<int, CryptoPP::Keccak_256::DIGESTSIZE>> {
+
+    CryptoPP::Keccak_256 kc{};
+
+    friend i_hasher<multi_buffer_keccak_256_hasher, std::integral_constant<int, CryptoPP::Keccak_256::DIGESTSIZE>>;
+
+    void do_begin(void) {
+        return kc.Restart();
+    }
+
+    void do_add_data(const unsigned char *data, size_t length) {
+        return kc.Update(data, length);
+    }
+
+    void do_end(hash_type &hash) {
+        return kc.Final(hash.data());
+    }
+
+    void do_concat_hashes(const hash_type *children, size_t count, hash_type *parents) {
+        static_assert(sizeof(hash_type) == 32, "unexpected hash_type layout");
+        return multi_buffer_keccak_256_64(children->data(), count, parents->data());
+    }
+
+public:
+    /// \brief Default constructor
+    multi_buffer_keccak_256_hasher(void) = default;
+
+    /// \brief Default destructor
+    ~multi_buffer_keccak_256_hasher(void) = default;
+
+    /// \brief No copy constructor
+    multi_buffer_keccak_256_hasher(const multi_buffer_keccak_256_hasher &) = delete;
+    /// \brief No move constructor
+    multi_buffer_keccak_256_hasher(multi_buffer_keccak_256_hasher &&) = delete;
+    /// \brief No copy assignment
+    multi_buffer_keccak_256_hasher &operator=(const multi_buffer_keccak_256_hasher &) = delete;
+    /// \brief No move assignment
+    multi_buffer_keccak_256_hasher &operator=(multi_buffer_keccak_256_hasher &&) = delete;
+};
+
+} // namespace cartesi
+
+#endif
@@ -16,17 +16,30 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iomanip>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <new>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -38,6 +51,7 @@
 #endif
 #define BOOST_LOG_DYN_LINK 1 // NOLINT(cppcoreguidelines-macro-usage)
 #include <boost/core/demangle.hpp>
+#include <boost/core/null_deleter.hpp>
 #include <boost/coroutine2/coroutine.hpp>
 #include <boost/endian/conversion.hpp>
 #include <boost/iostreams/device/null.hpp>
@@ -45,9 +59,13 @@
 #include <boost/log/attributes/function.hpp>
 #include <boost/log/attributes/named_scope.hpp>
 #include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/unbounded_fifo_queue.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
+#include <boost/log/utility/setup/formatter_parser.hpp>
 #include <boost/process.hpp>
 #define BOOST_DLL_USE_STD_FS
 #include <boost/dll/runtime_symbol_info.hpp>
@@ -69,6 +87,8 @@
 #include <grpc++/grpc++.h>
 #include <grpc++/resource_quota.h>
 
+#include <google/protobuf/arena.h>
+
 #include "cartesi-machine-checkin.grpc.pb.h"
 #include "cartesi-machine.grpc.pb.h"
 #include "health.grpc.pb.h"
@@ -80,6 +100,7 @@
 
 #include <htif-defines.h>
 
+#include "back-merkle-tree.h"
 #include "complete-merkle-tree.h"
 #include "keccak-256-hasher.h"
 #include "merkle-tree-proof.h"
@@ -129,13 +150,24 @@ static std::string request_metadata(const grpc::ServerContext &context) {
     return metadata;
 }
 
+/// \brief Minimum severity of log records, set once at startup
+/// \details Checking it before opening a record skips the logging core, and the evaluation of the streamed
+/// arguments, including request_metadata, for every debug line on the hot path.
+static boost::log::trivial::severity_level log_level = boost::log::trivial::info;
+
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
-#define LOG_CONTEXT(level, context) BOOST_LOG_TRIVIAL(level) << request_metadata(context)
+#define LOG_CONTEXT(level, context)                                                                                    \
+    if (boost::log::trivial::level < log_level) {                                                                      \
+    } else                                                                                                             \
+        BOOST_LOG_TRIVIAL(level) << request_metadata(context)
 
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
 #define THROW(e)                                                                                                       \
     do {                                                                                                               \
-        BOOST_LOG_TRIVIAL(debug) << "Throwing from " << __FILE__ << ":" << __LINE__ << " at " << __PRETTY_FUNCTION__;  \
+        if (boost::log::trivial::debug >= log_level) {                                                                 \
+            BOOST_LOG_TRIVIAL(debug) << "Throwing from " << __FILE__ << ":" << __LINE__ << " at "                      \
+                                     << __PRETTY_FUNCTION__;                                                           \
+        }                                                                                                              \
         throw(e);                                                                                                      \
     } while (0);
 
@@ -216,6 +248,17 @@ static std::string request_metadata(const grpc::ServerContext &context) {
 // immediately deleted and a dangling pointer will be returned by the completion
 // queue. THIS WILL CRASH!
 //
+// The server can dispatch handlers from several threads. Each thread serves
+// the completion queue of a shard, and each session is pinned to a shard by
+// a hash of its id. An RPC arrives at the completion queue of any shard. Once
+// its handler knows the session, it yields side_effect::migrate and the
+// dispatch loop sends it to the completion queue of the session's shard.
+// From then on, it only runs in the thread of that shard, so nothing in a
+// session is ever touched by two threads. The remaining events of the RPC
+// itself (e.g., Finish) still arrive at the original shard, and the dispatch
+// loop forwards them. State shared by all shards is guarded by a mutex that
+// is never held across a yield.
+//
 
 /// \brief Class to use when computing hashes
 using hasher_type = cartesi::keccak_256_hasher;
@@ -231,7 +274,8 @@ using time_point_type = std::chrono::time_point<std::chrono::system_clock>;
 
 /// \brief Desired side effect when a handler yields
 enum class side_effect {
-    none,    ///< do nothing
+    none,     ///< do nothing
+    migrate,  ///< move handler to the completion queue of its shard
     shutdown ///< shutdown server
 };
 
@@ -260,6 +304,8 @@ struct input_metadata_type {
 
 constexpr const int LOG2_ROOT_SIZE = 37;
 constexpr const int LOG2_KECCAK_SIZE = 5;
+constexpr const int LOG2_WORD_SIZE = 3;
+constexpr const uint64_t WORD_SIZE = UINT64_C(1) << LOG2_WORD_SIZE;
 constexpr const uint64_t KECCAK_SIZE = UINT64_C(1) << LOG2_KECCAK_SIZE;
 constexpr const uint64_t EVM_ABI_UINT64_LENGTH = 32;
 constexpr const uint64_t EVM_ABI_ADDRESS_LENGTH = 32;
@@ -271,12 +317,33 @@ constexpr const uint64_t EVM_ABI_STRING_HEADER_LENGTH = EVM_ABI_OFFSET_LENGTH +
 
 using evm_abi_input_metadata_type = std::array<uint8_t, EVM_ABI_INPUT_METADATA_LENGTH>;
 
+/// \brief Encodes a payload as an EVM ABI string
+/// \param payload Payload to encode
+/// \return Offset and length header followed by payload, ready to be written to the rx buffer
+static std::string evm_abi_encoded_string(const std::string &payload) {
+    using namespace boost::endian;
+    std::string encoded(EVM_ABI_STRING_HEADER_LENGTH, '\0');
+    encoded.reserve(EVM_ABI_STRING_HEADER_LENGTH + payload.size());
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto *header = reinterpret_cast<unsigned char *>(encoded.data());
+    endian_store<uint64_t, sizeof(uint64_t), order::big>(header + EVM_ABI_OFFSET_LENGTH - sizeof(uint64_t),
+        EVM_ABI_OFFSET_LENGTH);
+    endian_store<uint64_t, sizeof(uint64_t), order::big>(
+        header + EVM_ABI_OFFSET_LENGTH + EVM_ABI_LENGTH_LENGTH - sizeof(uint64_t), payload.size());
+    encoded.append(payload);
+    return encoded;
+}
+
 /// \brief Type holding an AdvanceState input for processing
+/// \details The payload is kept already encoded as it is written to the rx buffer, so the only copy is the one made
+/// here. The request message taking ownership of the payload is freed as soon as the input is enqueued.
 struct input_type {
-    input_type(const input_metadata_type &input_metadata, const std::string &input_payload) : metadata(input_metadata) {
-        payload.insert(payload.end(), input_payload.begin(), input_payload.end());
-    }
-    std::vector<uint8_t> payload;
+    input_type(const input_metadata_type &input_metadata, std::string input_payload) :
+        payload_length(input_payload.size()),
+        encoded_payload(evm_abi_encoded_string(input_payload)),
+        metadata(input_metadata) {}
+    uint64_t payload_length{};   ///< Length of payload
+    std::string encoded_payload; ///< Payload encoded as an EVM ABI string
     input_metadata_type metadata{};
 };
 
@@ -338,14 +405,26 @@ struct processed_input_type {
     std::vector<report_type> reports; ///< List of reports produced while input was processed
 };
 
+/// \brief Type holding an InspectState handler attached to an identical query that is already pending
+struct query_follower_type {
+    handler_type::pull_type *coroutine{nullptr}; ///< Handler waiting for the outcome of the query
+    InspectStateResponse response;               ///< Response copied from the query, once it is done
+    grpc::Status status;                         ///< Status copied from the query, once it is done
+};
+
 /// \brief Type holding an InspectState request/response while it is processed
 struct query_type {
-    query_type(const std::string &query_payload) {
-        payload.insert(payload.end(), query_payload.begin(), query_payload.end());
-    }
-    std::vector<uint8_t> payload;
+    query_type(std::string query_payload) :
+        payload_length(query_payload.size()),
+        encoded_payload(evm_abi_encoded_string(query_payload)) {}
+    uint64_t payload_length{};   ///< Length of payload
+    std::string encoded_payload; ///< Payload encoded as an EVM ABI string
+    hash_type payload_hash{};    ///< Hash of encoded payload, when results are cached
     completion_status status{completion_status::accepted};
-    handler_type::pull_type *coroutine{nullptr};
+    handler_type::pull_type *coroutine{nullptr};  ///< InspectState handler waiting for its turn to use the machine
+    bool running{};                               ///< Set once the handler has been given the machine
+    bool cache_hit{};                             ///< Set when the outcome was found in the inspect cache
+    std::vector<query_follower_type *> followers; ///< Handlers waiting for the outcome of this same query
     uint64_t processed_input_count{0};
     std::optional<exception_data_type> exception_data;
     std::vector<report_type> reports;
@@ -357,16 +436,30 @@ enum class epoch_state { active, finished };
 /// \brief Type of session ids
 using id_type = std::string;
 
+/// \brief Type holding the Merkle tree of voucher or notice hashes memory range hashes in an epoch
+/// \details While the epoch is active, only the back Merkle tree context is needed to produce the root hash and the
+/// proof of each new leaf. The complete tree, with proofs for all leaves, is only built when the epoch finishes.
+struct epoch_output_tree_type {
+    /// \brief Context of back Merkle tree
+    cartesi::back_merkle_tree context{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE};
+    /// \brief Leaf hashes, one per input, until the epoch finishes
+    std::vector<hash_type> leaves;
+    /// \brief Root hash, updated with each new leaf
+    hash_type root_hash{context.get_root_hash()};
+};
+
 /// \brief Type holding an epoch;
 struct epoch_type {
     uint64_t epoch_index{};
     epoch_state state{epoch_state::active};
     hash_type most_recent_machine_hash{};
-    cartesi::complete_merkle_tree vouchers_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE};
-    cartesi::complete_merkle_tree notices_tree{LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE};
+    epoch_output_tree_type vouchers_tree;
+    epoch_output_tree_type notices_tree;
     std::vector<processed_input_type> processed_inputs;
     std::deque<input_type> pending_inputs;
-    std::optional<query_type> pending_query;
+    std::deque<query_type> pending_queries;
+    handler_type::pull_type *query_batch_waiter{nullptr}; ///< Input processor waiting for a batch of queries
+    uint64_t query_batch_size{};                          ///< Number of queries left in that batch
 };
 
 /// \brief Type holding the deadlines for varios server tasks
@@ -398,9 +491,84 @@ struct cycles_config_type {
     uint64_t inspect_state_increment{}; ///< Number of cycles in each increment to processing a query
 };
 
+/// \brief Type holding a GetEpochStatus handler waiting for a change in a session
+struct epoch_status_waiter_type {
+    grpc::Alarm alarm; ///< Alarm that resumes the handler when it goes off at the timeout, or when canceled
+    bool notified{};   ///< Set when resumed by a change, rather than by its timeout
+};
+
+/// \brief Type holding an AdvanceState handler whose input arrived ahead of its turn
+struct advance_state_waiter_type {
+    grpc::Alarm alarm;      ///< Alarm that resumes the handler when it goes off at the timeout, or when canceled
+    bool notified{};        ///< Set when resumed by a change, rather than by its timeout
+    uint64_t input_index{}; ///< Index of the input held by the handler
+};
+
+/// \brief Phases of processing inputs and queries whose durations are measured
+enum class phase_type : size_t {
+    snapshot,    ///< Snapshot RPC
+    checkin,     ///< Wait for the machine server to check in after a snapshot or rollback
+    clear,       ///< Clear of rx buffer and other memory ranges, together with the reset of iflags.Y
+    write,       ///< Write of input or query to the rx buffer and related memory ranges
+    run,         ///< Run RPCs until the machine yields, halts, or reaches a limit
+    read_output, ///< Read of a voucher, notice, report, or exception from the tx buffer
+    get_proof,   ///< GetProof RPC
+    root_hash,   ///< GetRootHash RPC
+    rollback,    ///< Rollback RPC
+    count        ///< Number of phases
+};
+
+/// \brief Returns the upper bounds of histogram buckets growing geometrically
+/// \param first Upper bound of first bucket
+/// \param factor Ratio between consecutive upper bounds
+/// \param count Number of buckets, not counting the unbounded one
+static std::vector<double> get_exponential_bounds(double first, double factor, int count) {
+    std::vector<double> bounds;
+    for (double bound = first; count > 0; bound *= factor, --count) {
+        bounds.push_back(bound);
+    }
+    return bounds;
+}
+
+/// \brief Type holding a histogram of observations, as exported in the Prometheus text format
+struct histogram_type {
+    /// \brief Default constructor, with buckets for durations in seconds from 0.1ms to about 100s
+    histogram_type() : histogram_type(get_exponential_bounds(0.0001, 4, 11)) {}
+    /// \brief Constructor
+    /// \param bounds Upper bounds of buckets, in increasing order
+    explicit histogram_type(std::vector<double> bounds) : bounds(std::move(bounds)), buckets(this->bounds.size() + 1) {}
+    std::vector<double> bounds;    ///< Upper bounds of buckets
+    std::vector<uint64_t> buckets; ///< Number of observations in each bucket, the last one unbounded
+    double sum{};                  ///< Sum of all observations
+};
+
+/// \brief Type holding the metrics periodically written to a file in the Prometheus text format
+struct metrics_type {
+    std::string path;                             ///< File the metrics are written to, empty if disabled
+    uint64_t interval{};                          ///< Milliseconds between writes
+    std::mutex mutex;                             ///< Guards all of the below
+    std::map<id_type, uint64_t> inputs_processed; ///< Inputs processed in each session that was not ended
+    /// Duration of each phase
+    std::array<histogram_type, static_cast<size_t>(phase_type::count)> phase_seconds;
+    /// Run RPCs issued per input
+    histogram_type run_requests_per_input{get_exponential_bounds(1, 2, 16)};
+    /// Cycles run per input
+    histogram_type mcycles_per_input{get_exponential_bounds(1000, 10, 10)};
+    /// Depth of the pending input queue when an input arrives
+    histogram_type pending_inputs{get_exponential_bounds(1, 2, 16)};
+    /// Duration of FinishEpoch
+    histogram_type finish_epoch_seconds;
+    /// Number of proofs in FinishEpoch
+    histogram_type finish_epoch_proofs{get_exponential_bounds(1, 4, 12)};
+    std::thread writer;                ///< Thread writing the file
+    std::condition_variable condition; ///< Signals stop to the writer
+    bool stop{};                       ///< Tells the writer to exit
+};
+
 /// \brief Type holding a session;
 struct session_type {
     id_type id{};                                 ///< Session id
+    id_type checkin_id{};                         ///< Id the machine server uses when checking in
     bool session_lock{};                          ///< Session lock
     std::string session_lock_reason{};            ///< Who/why session was locked
     bool processing_lock{};                       ///< Lock for handler processing inputs
@@ -411,12 +579,32 @@ struct session_type {
     uint64_t active_epoch_index{};                ///< Index of active epoch
     uint64_t processed_input_count{};             ///< Number of processed inputs since genesis
     uint64_t max_input_payload_length{};          ///< Maximum length of an input payload
+    uint64_t tx_read_prefix_length{};             ///< Length of payload data read together with tx buffer headers
     memory_ranges_type memory_range{};            ///< Important memory ranges
     std::map<uint64_t, epoch_type> epochs{};      ///< Map of cached epochs
     deadline_config_type server_deadline{};       ///< Deadlines for various server tasks
     cycles_config_type server_cycles;             ///< Cycle count limits for various server tasks
     boost::process::group server_process_group{}; ///< remote-cartesi-machine process group
     std::string server_address{};                 ///< remote-cartesi-machine address
+    /// Connection to the machine server that was replaced by the last check-in, to be reused if it checks in again
+    std::unique_ptr<Machine::Stub> previous_server_stub{};
+    std::string previous_server_address{};      ///< Address of machine server in previous_server_stub
+    bool reuse_server_stub{};                   ///< Keep connection when machine server checks in with the same address
+    uint64_t snapshot_interval{1};              ///< Number of accepted inputs processed after each snapshot
+    uint64_t snapshot_rejection_threshold{100}; ///< Rejection rate (percent) above which every input is snapshot
+    bool adaptive_run_increment{};              ///< Grow the mcycle increment of each Run while the machine runs
+    metrics_type *metrics{};                    ///< Metrics to update, or nullptr if disabled
+    uint64_t input_run_requests{};              ///< Run RPCs issued for the input being processed
+    uint64_t input_mcycles{};                   ///< Cycles run for the input being processed
+    double rejection_rate{};                    ///< Moving average of the rate of skipped inputs
+    bool has_checkpoint{};                      ///< True if machine server holds a snapshot to roll back to
+    uint64_t checkpoint_mcycle{};               ///< Machine mcycle when snapshot was taken
+    uint64_t accepted_since_checkpoint{};       ///< Number of inputs accepted since snapshot
+    std::deque<input_type> replay_inputs{};     ///< Inputs accepted since snapshot, to replay after a rollback
+    /// GetEpochStatus handlers waiting for new processed inputs, a finished epoch, or a taint
+    std::vector<epoch_status_waiter_type *> epoch_status_waiters{};
+    /// AdvanceState handlers holding inputs that arrived ahead of their turn
+    std::vector<advance_state_waiter_type *> advance_state_waiters{};
 };
 
 /// \brief Encodes an input metadata structure according to the EVM ABI
@@ -489,17 +677,129 @@ using health_status_type = grpc::health::v1::HealthCheckResponse::ServingStatus;
 
 /// \brief Context for internal functions that handle the checkin
 struct checkin_context {
-    handler_type::pull_type *coroutine{nullptr}; ///< Coroutine that should be continued
-    std::unique_ptr<grpc::Alarm> alarm;          ///< Check-in deadline alarm
-    std::optional<bool> status;                  ///< Check-in status
+    handler_type::pull_type *coroutine{nullptr};            ///< Coroutine that should be continued
+    grpc::ServerCompletionQueue *completion_queue{nullptr}; ///< Completion queue where coroutine is continued
+    std::unique_ptr<grpc::Alarm> alarm;                     ///< Check-in deadline alarm
+    std::optional<bool> status;                             ///< Check-in status
+    std::string address;                                    ///< Address received in check-in
+};
+
+/// \brief Prefix for the ids used by pooled machine servers when checking in
+constexpr const char *MACHINE_SERVER_POOL_ID_PREFIX = "server-manager-pool-";
+
+/// \brief Deadline in milliseconds for a pooled machine server to check in after spawned
+constexpr const uint64_t MACHINE_SERVER_POOL_CHECKIN_DEADLINE = 30000;
+
+/// \brief Interval in milliseconds before spawning a pooled machine server again after spawning failed
+constexpr const uint64_t MACHINE_SERVER_POOL_SPAWN_RETRY_INTERVAL = 1000;
+
+/// \brief Maximum time in milliseconds a GetEpochStatus call waits for processed inputs, whatever inputs-wait asks for
+constexpr const uint64_t EPOCH_STATUS_MAX_WAIT = 60000;
+
+/// \brief Maximum time in milliseconds AdvanceState holds an input that arrived ahead of its turn
+constexpr const uint64_t ADVANCE_STATE_HOLD_TIMEOUT = 10000;
+
+/// \brief Maximum number of inputs AdvanceState holds in a session, and how far ahead of its turn each can be
+constexpr const uint64_t ADVANCE_STATE_MAX_HELD_INPUTS = 256;
+
+/// \brief Maximum number of distinct InspectState queries pending in an epoch
+constexpr const uint64_t MAX_PENDING_QUERIES = 64;
+
+/// \brief Weight of each input in the moving average of the rate of skipped inputs in a session
+constexpr const double SNAPSHOT_REJECTION_RATE_WEIGHT = 1.0 / 16.0;
+
+/// \brief Type holding a machine server spawned ahead of time, before any session claims it
+struct pooled_machine_server_type {
+    id_type checkin_id{};                  ///< Id the machine server uses when checking in
+    bool checked_in{};                     ///< True once machine server checked in and can be claimed
+    std::string address{};                 ///< remote-cartesi-machine address
+    boost::process::group process_group{}; ///< remote-cartesi-machine process group
+};
+
+/// \brief Type holding a dispatch shard: a completion queue served by its own thread, and the sessions pinned to it
+struct shard_type {
+    std::unique_ptr<grpc::ServerCompletionQueue> completion_queue; ///< Completion queue served by the shard thread
+    std::unordered_map<id_type, session_type> sessions;            ///< Sessions pinned to the shard
+    /// Guards insertions and removals of sessions against listing by other shards
+    std::mutex sessions_mutex;
+    bool ok{}; ///< gRPC status of requests arriving in queue
+};
+
+/// \brief Type holding a handler together with the shard it moved to
+/// \details Dispatch threads look up the shard of every event they receive, so it is kept next to the handler
+/// instead of in a map shared by all shards
+struct handler_frame_type {
+    handler_type::pull_type coroutine; ///< Handler, constructed in place by its creator
+    /// Shard where the handler moved after learning the session it works on, or nullptr if it never left the
+    /// shard where it was created
+    std::atomic<shard_type *> shard;
+};
+
+/// \brief Allocates a handler, leaving its coroutine to be constructed in place by the caller
+/// \return Storage for the coroutine, also used as the tag of the handler in completion queues
+static handler_type::pull_type *allocate_handler(void) {
+    auto *frame = static_cast<handler_frame_type *>(operator new(sizeof(handler_frame_type)));
+    new (&frame->shard) std::atomic<shard_type *>{nullptr};
+    return &frame->coroutine;
+}
+
+/// \brief Returns the frame holding a handler
+/// \param h Handler
+/// \return Frame
+static handler_frame_type *get_handler_frame(handler_type::pull_type *h) {
+    static_assert(offsetof(handler_frame_type, coroutine) == 0, "coroutine must start the handler frame");
+    return reinterpret_cast<handler_frame_type *>(h); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+/// \brief Deletes a handler allocated with allocate_handler
+/// \param h Handler
+static void delete_handler(handler_type::pull_type *h) {
+    auto *frame = get_handler_frame(h);
+    std::destroy_at(&frame->coroutine);
+    std::destroy_at(&frame->shard);
+    operator delete(frame);
+}
+
+/// \brief Type holding the outcome of a query, which depends only on the machine state and the query
+struct inspect_result_type {
+    completion_status status{completion_status::accepted}; ///< Completion status of the query
+    std::optional<exception_data_type> exception_data;     ///< Exception data, when status is exception
+    std::vector<report_type> reports;                      ///< Reports produced while the query was processed
+};
+
+/// \brief Least recently used cache of query outcomes, bounded by the bytes they hold
+struct inspect_cache_type {
+    using entry_type = std::pair<hash_type, inspect_result_type>;
+    uint64_t max_size{};                                        ///< Maximum bytes held, 0 disables the cache
+    uint64_t size{};                                            ///< Bytes currently held
+    std::list<entry_type> entries;                              ///< Entries, most recently used first
+    std::map<hash_type, std::list<entry_type>::iterator> index; ///< Entries by machine hash and query
+    std::mutex mutex;                                           ///< Guards all of the above but max_size
+};
+
+/// \brief Pool of threads that build epoch proofs off the dispatch threads
+struct proof_pool_type {
+    std::vector<std::thread> threads;       ///< Worker threads, none when proofs are built in place
+    std::deque<std::function<void()>> jobs; ///< Jobs waiting for a worker thread
+    std::mutex mutex;                       ///< Guards jobs and stop
+    std::condition_variable condition;      ///< Signals new jobs or stop
+    bool stop{};                            ///< Tells worker threads to exit
 };
 
 /// \brief Context shared by all handlers
 struct handler_context {
-    std::string remote_cartesi_machine_path;            ///< Path to remote-cartesi-machine executable
+    std::string remote_cartesi_machine_command;         ///< Command line that spawns a machine server
     std::string manager_address;                        ///< Address to which manager is bound
     std::string server_address;                         ///< Address to which machine servers are bound
-    std::unordered_map<id_type, session_type> sessions; ///< Known sessions
+    uint64_t tx_read_prefix_length{};                   ///< Length of payload data read together with tx headers
+    bool reuse_server_stub{};                           ///< Keep connection when address is unchanged in check-in
+    uint64_t snapshot_interval{};                       ///< Maximum number of accepted inputs between snapshots
+    uint64_t snapshot_rejection_threshold{};            ///< Rejection rate (percent) forcing a snapshot per input
+    bool adaptive_run_increment{};                      ///< Grow the mcycle increment of each Run geometrically
+    uint64_t machine_server_pool_size{};                ///< Number of machine servers to keep spawned ahead of time
+    uint64_t machine_server_pool_next_index{};          ///< Index used in the id of the next pooled machine server
+    /// Machine servers spawned ahead of time, indexed by their check-in id
+    std::unordered_map<id_type, pooled_machine_server_type> machine_server_pool;
     /// Sessions waiting for server checkin
     std::unordered_map<id_type, checkin_context> sessions_waiting_checkin;
     /// Health status of each service
@@ -507,8 +807,15 @@ struct handler_context {
     ServerManager::AsyncService manager_async_service;             ///< Assynchronous manager service
     MachineCheckIn::AsyncService checkin_async_service;            ///< Assynchronous checkin service
     grpc::health::v1::Health::AsyncService health_async_service;   ///< Assynchronous health check service
-    std::unique_ptr<grpc::ServerCompletionQueue> completion_queue; ///< Completion queue where all handlers arrive
-    bool ok;                                                       ///< gRPC status of requests arriving in queue
+    std::vector<std::unique_ptr<shard_type>> shards;               ///< Dispatch shards, at least one
+    /// Guards state shared by all shards: sessions waiting for check-in and machine server pool
+    std::mutex mutex;
+    /// Worker threads building epoch proofs
+    proof_pool_type proof_pool;
+    /// Metrics written to a file in the Prometheus text format
+    metrics_type metrics;
+    /// Outcome of recent queries, shared by all sessions
+    inspect_cache_type inspect_cache;
 };
 
 /// \brief Context for internal functions that need to perform async operations
@@ -526,6 +833,473 @@ static void enqueue_completion_queue(grpc::ServerCompletionQueue *cq, handler_ty
     alarm.Set(cq, gpr_now(gpr_clock_type::GPR_CLOCK_REALTIME), self);
 }
 
+/// \brief Starts the worker threads of a proof pool
+/// \param pool Proof pool
+/// \param thread_count Number of worker threads
+static void start_proof_pool(proof_pool_type &pool, uint64_t thread_count) {
+    for (uint64_t i = 0; i < thread_count; ++i) {
+        pool.threads.emplace_back([&pool]() {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(pool.mutex);
+                    pool.condition.wait(lock, [&pool]() { return pool.stop || !pool.jobs.empty(); });
+                    if (pool.stop) {
+                        return;
+                    }
+                    job = std::move(pool.jobs.front());
+                    pool.jobs.pop_front();
+                }
+                job();
+            }
+        });
+    }
+}
+
+/// \brief Stops the worker threads of a proof pool
+/// \param pool Proof pool
+/// \details Jobs still waiting for a worker thread are dropped. The handlers waiting for them are never resumed, and
+/// are deleted when the completion queues are drained.
+static void stop_proof_pool(proof_pool_type &pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stop = true;
+        pool.jobs.clear();
+    }
+    pool.condition.notify_all();
+    for (auto &thread : pool.threads) {
+        thread.join();
+    }
+    pool.threads.clear();
+}
+
+/// \brief Names of phases, as exported in the phase label
+static const std::array<const char *, static_cast<size_t>(phase_type::count)> phase_names{"snapshot", "checkin",
+    "clear", "write", "run", "read_output", "get_proof", "root_hash", "rollback"};
+
+/// \brief Adds an observation to a histogram
+/// \param h Histogram, guarded by the mutex of its metrics, which the caller must hold
+/// \param value Observed value
+static void add_observation(histogram_type &h, double value) {
+    ++h.buckets[std::lower_bound(h.bounds.begin(), h.bounds.end(), value) - h.bounds.begin()];
+    h.sum += value;
+}
+
+/// \brief Adds an observation to a histogram
+/// \param metrics Metrics holding the histogram, or nullptr if disabled
+/// \param histogram Histogram in metrics
+/// \param value Observed value
+static void observe_metric(metrics_type *metrics, histogram_type metrics_type::*histogram, double value) {
+    if (metrics == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(metrics->mutex);
+    add_observation(metrics->*histogram, value);
+}
+
+/// \brief Measures the duration of a phase until it goes out of scope
+class auto_observe_phase final {
+public:
+    auto_observe_phase(const session_type &session, phase_type phase) :
+        m_metrics(session.metrics),
+        m_phase(phase),
+        m_start_time(std::chrono::system_clock::now()) {}
+
+    auto_observe_phase(const auto_observe_phase &other) = delete;
+    auto_observe_phase(auto_observe_phase &&other) = delete;
+    auto_observe_phase &operator=(const auto_observe_phase &other) = delete;
+    auto_observe_phase &operator=(auto_observe_phase &&other) = delete;
+
+    ~auto_observe_phase() {
+        if (m_metrics != nullptr) {
+            const std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - m_start_time;
+            std::lock_guard<std::mutex> lock(m_metrics->mutex);
+            add_observation(m_metrics->phase_seconds[static_cast<size_t>(m_phase)], elapsed.count());
+        }
+    }
+
+private:
+    metrics_type *m_metrics;
+    phase_type m_phase;
+    time_point_type m_start_time;
+};
+
+/// \brief Updates the metrics of a session when it is done with an input
+/// \param session Session
+static void observe_input_metrics(session_type &session) {
+    if (session.metrics == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(session.metrics->mutex);
+    add_observation(session.metrics->run_requests_per_input, static_cast<double>(session.input_run_requests));
+    add_observation(session.metrics->mcycles_per_input, static_cast<double>(session.input_mcycles));
+    ++session.metrics->inputs_processed[session.id];
+}
+
+/// \brief Writes a histogram in the Prometheus text format
+/// \param out Stream receiving the histogram
+/// \param name Metric name
+/// \param labels Labels common to all samples, each followed by a comma
+/// \param h Histogram
+static void write_histogram(std::ostream &out, const char *name, const std::string &labels,
+    const histogram_type &h) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < h.buckets.size(); ++i) {
+        count += h.buckets[i];
+        out << name << "_bucket{" << labels << "le=\"";
+        if (i < h.bounds.size()) {
+            out << h.bounds[i];
+        } else {
+            out << "+Inf";
+        }
+        out << "\"} " << count << '\n';
+    }
+    auto sample_labels = labels.empty() ? std::string{} : "{" + labels.substr(0, labels.size() - 1) + "}";
+    out << name << "_sum" << sample_labels << ' ' << h.sum << '\n';
+    out << name << "_count" << sample_labels << ' ' << count << '\n';
+}
+
+/// \brief Escapes a Prometheus label value
+static std::string escape_label_value(const std::string &value) {
+    std::string escaped;
+    for (auto c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/// \brief Writes all metrics to their file
+/// \param metrics Metrics
+/// \details The file is written under a temporary name, then renamed, so readers never see partial contents
+static void write_metrics(metrics_type &metrics) {
+    std::ostringstream out;
+    out << std::setprecision(10);
+    {
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        out << "# HELP server_manager_inputs_processed_total Inputs processed in session\n";
+        out << "# TYPE server_manager_inputs_processed_total counter\n";
+        for (const auto &[id, count] : metrics.inputs_processed) {
+            out << "server_manager_inputs_processed_total{session_id=\"" << escape_label_value(id) << "\"} " << count
+                << '\n';
+        }
+        out << "# HELP server_manager_phase_duration_seconds Duration of each phase of processing inputs and queries\n";
+        out << "# TYPE server_manager_phase_duration_seconds histogram\n";
+        for (size_t i = 0; i < metrics.phase_seconds.size(); ++i) {
+            write_histogram(out, "server_manager_phase_duration_seconds",
+                std::string{"phase=\""} + phase_names[i] + "\",", metrics.phase_seconds[i]);
+        }
+        out << "# HELP server_manager_run_requests_per_input Run RPCs issued to process an input\n";
+        out << "# TYPE server_manager_run_requests_per_input histogram\n";
+        write_histogram(out, "server_manager_run_requests_per_input", "", metrics.run_requests_per_input);
+        out << "# HELP server_manager_mcycles_per_input Cycles run to process an input\n";
+        out << "# TYPE server_manager_mcycles_per_input histogram\n";
+        write_histogram(out, "server_manager_mcycles_per_input", "", metrics.mcycles_per_input);
+        out << "# HELP server_manager_pending_inputs Pending inputs in session when an input arrives\n";
+        out << "# TYPE server_manager_pending_inputs histogram\n";
+        write_histogram(out, "server_manager_pending_inputs", "", metrics.pending_inputs);
+        out << "# HELP server_manager_finish_epoch_duration_seconds Duration of FinishEpoch\n";
+        out << "# TYPE server_manager_finish_epoch_duration_seconds histogram\n";
+        write_histogram(out, "server_manager_finish_epoch_duration_seconds", "", metrics.finish_epoch_seconds);
+        out << "# HELP server_manager_finish_epoch_proofs Proofs built by FinishEpoch\n";
+        out << "# TYPE server_manager_finish_epoch_proofs histogram\n";
+        write_histogram(out, "server_manager_finish_epoch_proofs", "", metrics.finish_epoch_proofs);
+    }
+    auto temporary_path = metrics.path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file << out.str();
+    file.close();
+    if (!file || std::rename(temporary_path.c_str(), metrics.path.c_str()) != 0) {
+        BOOST_LOG_TRIVIAL(error) << "Failed writing metrics to " << metrics.path;
+    }
+}
+
+/// \brief Starts the thread that periodically writes the metrics to their file, if enabled
+/// \param metrics Metrics
+static void start_metrics_writer(metrics_type &metrics) {
+    if (metrics.path.empty()) {
+        return;
+    }
+    metrics.writer = std::thread([&metrics]() {
+        std::unique_lock<std::mutex> lock(metrics.mutex);
+        while (!metrics.stop) {
+            lock.unlock();
+            write_metrics(metrics);
+            lock.lock();
+            metrics.condition.wait_for(lock, std::chrono::milliseconds(metrics.interval),
+                [&metrics]() { return metrics.stop; });
+        }
+    });
+}
+
+/// \brief Stops the thread that writes the metrics, writing them one last time
+/// \param metrics Metrics
+static void stop_metrics_writer(metrics_type &metrics) {
+    if (!metrics.writer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.stop = true;
+    }
+    metrics.condition.notify_all();
+    metrics.writer.join();
+    write_metrics(metrics);
+}
+
+/// \brief Runs a function over a range of indices, split across the threads of the proof pool
+/// \param hctx Handler context shared between all handlers
+/// \param actx Context for async operations
+/// \param count Number of indices
+/// \param f Function receiving the beginning and end of each subrange
+/// \details The handler yields until all subranges are done, so its dispatch thread keeps serving other handlers
+/// in the meantime. The session must be locked by the handler. Without worker threads, f runs in place.
+static void run_proof_jobs(handler_context &hctx, async_context &actx, uint64_t count,
+    const std::function<void(uint64_t begin, uint64_t end)> &f) {
+    auto &pool = hctx.proof_pool;
+    if (pool.threads.empty() || count <= 1) {
+        f(0, count);
+        return;
+    }
+    // A few subranges per worker thread, to balance uneven indices
+    const uint64_t job_count = std::min<uint64_t>(count, 4 * pool.threads.size());
+    struct {
+        std::atomic<uint64_t> remaining;
+        std::mutex mutex;
+        std::exception_ptr error;
+    } batch;
+    batch.remaining = job_count;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for (uint64_t j = 0; j < job_count; ++j) {
+            const uint64_t begin = count * j / job_count;
+            const uint64_t end = count * (j + 1) / job_count;
+            pool.jobs.emplace_back([&batch, &f, begin, end, cq = actx.completion_queue, self = actx.self]() {
+                try {
+                    f(begin, end);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(batch.mutex);
+                    if (!batch.error) {
+                        batch.error = std::current_exception();
+                    }
+                }
+                // The last job to finish resumes the handler, which owns the batch
+                if (--batch.remaining == 0) {
+                    enqueue_completion_queue(cq, self);
+                }
+            });
+        }
+    }
+    pool.condition.notify_all();
+    actx.yield(side_effect::none);
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+/// \brief Returns the shard a session is pinned to
+/// \param hctx Handler context shared between all handlers
+/// \param id Session id
+/// \return Shard whose thread runs all handlers working on the session
+static shard_type &get_session_shard(handler_context &hctx, const id_type &id) {
+    return *hctx.shards[std::hash<id_type>{}(id) % hctx.shards.size()];
+}
+
+/// \brief Moves a handler to the shard a session is pinned to, if it is not already there
+/// \param hctx Handler context shared between all handlers
+/// \param shard Shard running the handler
+/// \param id Session id
+/// \param self Handler coroutine
+/// \param yield Handler yield
+/// \return Shard the session is pinned to, now running the handler
+static shard_type &move_to_session_shard(handler_context &hctx, shard_type &shard, const id_type &id,
+    handler_type::pull_type *self, handler_type::push_type &yield) {
+    auto &session_shard = get_session_shard(hctx, id);
+    if (&session_shard != &shard) {
+        get_handler_frame(self)->shard = &session_shard;
+        // The dispatch loop sends us to the completion queue of the session shard once we yield
+        yield(side_effect::migrate);
+    }
+    return session_shard;
+}
+
+/// \brief Resumes the GetEpochStatus handlers waiting for a change in a session
+/// \param session Session that changed
+static void notify_epoch_status_waiters(session_type &session) {
+    for (auto *waiter : session.epoch_status_waiters) {
+        waiter->notified = true;
+        waiter->alarm.Cancel();
+    }
+    session.epoch_status_waiters.clear();
+}
+
+/// \brief Resumes the AdvanceState handlers holding inputs in a session
+/// \param session Session that changed
+/// \param input_index Resume only the handlers holding this input index, or all of them if UINT64_MAX
+static void notify_advance_state_waiters(session_type &session, uint64_t input_index = UINT64_MAX) {
+    auto &waiters = session.advance_state_waiters;
+    auto first_notified = std::partition(waiters.begin(), waiters.end(), [input_index](const auto *waiter) {
+        return input_index != UINT64_MAX && waiter->input_index != input_index;
+    });
+    for (auto it = first_notified; it != waiters.end(); ++it) {
+        (*it)->notified = true;
+        (*it)->alarm.Cancel();
+    }
+    waiters.erase(first_notified, waiters.end());
+}
+
+/// \brief Resumes the handlers waiting for a change in a session once it goes out of scope
+/// \details Declared before the session lock in a handler, it is destroyed after the lock is released, so the
+/// handlers it resumes do not find the session still locked and fail with ABORTED
+class auto_notify_session_waiters final {
+public:
+    /// \brief Constructor does not notify anything until armed
+    /// \param session Session whose waiters are resumed
+    explicit auto_notify_session_waiters(session_type &session) : m_session{session} {}
+
+    auto_notify_session_waiters(const auto_notify_session_waiters &other) = delete;
+    auto_notify_session_waiters(auto_notify_session_waiters &&other) = delete;
+    auto_notify_session_waiters &operator=(const auto_notify_session_waiters &other) = delete;
+    auto_notify_session_waiters &operator=(auto_notify_session_waiters &&other) = delete;
+
+    /// \brief Marks the session as changed, so waiters are resumed on destruction
+    void arm(void) {
+        m_armed = true;
+    }
+
+    /// \brief Destructor resumes waiters if armed
+    ~auto_notify_session_waiters() {
+        if (m_armed) {
+            notify_epoch_status_waiters(m_session);
+            notify_advance_state_waiters(m_session);
+        }
+    }
+
+private:
+    session_type &m_session;
+    bool m_armed{false};
+};
+
+/// \brief Waits for an epoch to have more processed inputs than a given count
+/// \param session_shard Shard the session is pinned to
+/// \param id Session id
+/// \param epoch_index Epoch index
+/// \param processed_input_count Number of processed inputs already known to the caller
+/// \param timeout Maximum time to wait, in milliseconds
+/// \param self Pointer to calling handler
+/// \param yield Yield of calling handler
+/// \details Also returns when the epoch is finished or the session is tainted or ended, and right away if the
+/// session or epoch are unknown, so the caller reports the error. The session is not locked while waiting.
+static void wait_epoch_status(shard_type &session_shard, const id_type &id, uint64_t epoch_index,
+    uint64_t processed_input_count, uint64_t timeout, handler_type::pull_type *self, handler_type::push_type &yield) {
+    auto session_it = session_shard.sessions.find(id);
+    if (session_it == session_shard.sessions.end()) {
+        return;
+    }
+    auto &session = session_it->second;
+    auto epoch_it = session.epochs.find(epoch_index);
+    if (epoch_it == session.epochs.end()) {
+        return;
+    }
+    const auto &e = epoch_it->second;
+    if (session.tainted || e.state != epoch_state::active || e.processed_inputs.size() > processed_input_count) {
+        return;
+    }
+    // The alarm delivers exactly one event, whether it goes off or is canceled by a change
+    epoch_status_waiter_type waiter;
+    waiter.alarm.Set(session_shard.completion_queue.get(),
+        std::chrono::system_clock::now() + std::chrono::milliseconds(timeout), self);
+    session.epoch_status_waiters.push_back(&waiter);
+    yield(side_effect::none);
+    if (!waiter.notified) {
+        // Timed out, so the session is still there and still holds the waiter
+        auto &waiters = session.epoch_status_waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), &waiter), waiters.end());
+    }
+}
+
+/// \brief Holds an AdvanceState input that arrived ahead of its turn until the inputs before it are enqueued
+/// \param session_shard Shard the session is pinned to
+/// \param id Session id
+/// \param epoch_index Active epoch index in the request
+/// \param input_index Current input index in the request
+/// \param self Pointer to calling handler
+/// \param yield Yield of calling handler
+/// \details Returns right away if the input is not ahead of its turn, is too far ahead, or too many inputs are
+/// already held, and if the session or epoch are unknown, so the caller reports errors as usual. Also returns when
+/// the session is tainted or ended, the epoch finishes, or ADVANCE_STATE_HOLD_TIMEOUT expires. The session is not
+/// locked while holding.
+static void hold_advance_state_input(shard_type &session_shard, const id_type &id, uint64_t epoch_index,
+    uint64_t input_index, handler_type::pull_type *self, handler_type::push_type &yield) {
+    auto session_it = session_shard.sessions.find(id);
+    if (session_it == session_shard.sessions.end()) {
+        return;
+    }
+    auto &session = session_it->second;
+    if (session.tainted || session.active_epoch_index != epoch_index) {
+        return;
+    }
+    auto epoch_it = session.epochs.find(epoch_index);
+    if (epoch_it == session.epochs.end() || epoch_it->second.state != epoch_state::active) {
+        return;
+    }
+    const auto current_input_index = epoch_it->second.pending_inputs.size() + session.processed_input_count;
+    if (input_index <= current_input_index || input_index - current_input_index > ADVANCE_STATE_MAX_HELD_INPUTS ||
+        session.advance_state_waiters.size() >= ADVANCE_STATE_MAX_HELD_INPUTS) {
+        return;
+    }
+    // The alarm delivers exactly one event, whether it goes off or is canceled when the input's turn comes
+    advance_state_waiter_type waiter;
+    waiter.input_index = input_index;
+    waiter.alarm.Set(session_shard.completion_queue.get(),
+        std::chrono::system_clock::now() + std::chrono::milliseconds(ADVANCE_STATE_HOLD_TIMEOUT), self);
+    session.advance_state_waiters.push_back(&waiter);
+    yield(side_effect::none);
+    if (!waiter.notified) {
+        // Timed out, so the session is still there and still holds the waiter
+        auto &waiters = session.advance_state_waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), &waiter), waiters.end());
+    }
+}
+
+/// \brief Erases a session from the shard it is pinned to
+/// \param hctx Handler context shared between all handlers
+/// \param id Session id
+static void erase_session(handler_context &hctx, const id_type &id) {
+    auto &session_shard = get_session_shard(hctx, id);
+    std::lock_guard<std::mutex> lock(session_shard.sessions_mutex);
+    auto it = session_shard.sessions.find(id);
+    if (it != session_shard.sessions.end()) {
+        notify_epoch_status_waiters(it->second);
+        notify_advance_state_waiters(it->second);
+        session_shard.sessions.erase(it);
+    }
+    std::lock_guard<std::mutex> metrics_lock(hctx.metrics.mutex);
+    hctx.metrics.inputs_processed.erase(id);
+}
+
+/// \brief Finds a session from the error path of a handler
+/// \param hctx Handler context shared between all handlers
+/// \param running_shard Shard running the handler
+/// \param id Session id
+/// \return Pointer to session, or nullptr if the session is unknown or the handler is not running in its shard
+/// \details Handlers may fail before they move to the session shard, and only that shard can touch the session
+static session_type *find_session_on_error(handler_context &hctx, shard_type &running_shard, const id_type &id) {
+    auto &session_shard = get_session_shard(hctx, id);
+    if (&session_shard != &running_shard) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(session_shard.sessions_mutex);
+    auto it = session_shard.sessions.find(id);
+    return it != session_shard.sessions.end() ? &it->second : nullptr;
+}
+
 /// \brief Checks if integer is a power of 2
 /// \param value Integer to test
 /// \return True if integer is power of 2, false otherwise
@@ -579,21 +1353,55 @@ private:
     grpc::Status m_status;
 };
 
+/// \brief Largest block an arena allocates for a response
+constexpr const size_t RESPONSE_ARENA_MAX_BLOCK_SIZE = 1 << 20;
+
+/// \brief Returns options for arenas holding large responses
+/// \details Blocks grow up to 1MiB, so responses with thousands of nested messages take few allocations
+static google::protobuf::ArenaOptions get_response_arena_options(void) {
+    google::protobuf::ArenaOptions options;
+    options.max_block_size = RESPONSE_ARENA_MAX_BLOCK_SIZE;
+    return options;
+}
+
+/// \brief Gets an unsigned integer from the client metadata of a request
+/// \param context Server context of request
+/// \param key Metadata key
+/// \returns Value, or std::nullopt if the key is not present
+static std::optional<uint64_t> get_metadata_uint(const grpc::ServerContext &context, const char *key) {
+    auto it = context.client_metadata().find(key);
+    if (it == context.client_metadata().end()) {
+        return std::nullopt;
+    }
+    const std::string str{it->second.begin(), it->second.end()};
+    if (str.empty() || str[0] < '0' || str[0] > '9') {
+        THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, std::string{"invalid "} + key}));
+    }
+    char *end = nullptr;
+    errno = 0;
+    uint64_t val = strtoull(str.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') {
+        THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, std::string{"invalid "} + key}));
+    }
+    return val;
+}
+
 /// \brief Creates a new handler for the GetVersion RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_GetVersion_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_GetVersion_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         Void request;
         ServerAsyncResponseWriter<GetVersionResponse> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestGetVersion(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_GetVersion_handler(hctx);
+        new_GetVersion_handler(hctx, shard);
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received GetVersion RPC with handle_context ok set to false";
             return;
         }
@@ -614,28 +1422,32 @@ static handler_type::pull_type *new_GetVersion_handler(handler_context &hctx) {
 
 /// \brief Creates a new handler for the GetStatus RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_GetStatus_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_GetStatus_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         Void request;
         ServerAsyncResponseWriter<GetStatusResponse> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestGetStatus(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_GetStatus_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_GetStatus_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) { // NOLINT: Unknown. Maybe linter bug?
+        if (!shard.ok) { // NOLINT: Unknown. Maybe linter bug?
             LOG_CONTEXT(error, request_context) << "Received GetStatus RPC with handle_context ok set to false";
             return;
         }
         LOG_CONTEXT(info, request_context) << "Received GetStatus"; // NOLINT: avoid boost warnings?
         Status status;
         GetStatusResponse response;
-        for (const auto &[session_id, session] : hctx.sessions) {
-            LOG_CONTEXT(debug, request_context) << "  " << session_id;
-            response.add_session_id(session_id);
+        for (auto &session_shard : hctx.shards) {
+            std::lock_guard<std::mutex> lock(session_shard->sessions_mutex);
+            for (const auto &[session_id, session] : session_shard->sessions) {
+                LOG_CONTEXT(debug, request_context) << "  " << session_id;
+                response.add_session_id(session_id);
+            }
         }
         writer.Finish(response, grpc::Status::OK, self); // NOLINT: Unknown. Maybe linter bug?
         yield(side_effect::none);
@@ -667,15 +1479,48 @@ static void store(async_context &actx, const std::string &directory) {
     }
 }
 
+/// \brief Appends a leaf to an epoch output tree
+/// \param tree Epoch output tree
+/// \param leaf_hash Hash of voucher or notice hashes memory range
+/// \return Proof of new leaf in epoch output tree
+/// \details All leaves to the right of the new one are pristine, so its proof is the proof for the next leaf
+/// before it was added, with the new leaf hash bubbled up to the root.
+static proof_type push_back_epoch_output(epoch_output_tree_type &tree, const hash_type &leaf_hash) {
+    auto proof = tree.context.get_next_leaf_proof();
+    tree.context.push_back(leaf_hash);
+    tree.leaves.push_back(leaf_hash);
+    proof.set_target_hash(leaf_hash);
+    proof.set_root_hash(proof.bubble_up(hasher_type{}, leaf_hash));
+    tree.root_hash = proof.get_root_hash();
+    return proof;
+}
+
 /// \brief Marks epoch finished and update all proofs now that all leaves are present
+/// \param hctx Handler context shared between all handlers
+/// \param actx Context for async operations
 /// \param e Associated epoch
-static void finish_epoch(epoch_type &e) {
+static void finish_epoch(handler_context &hctx, async_context &actx, epoch_type &e) {
     e.state = epoch_state::finished;
-    for (auto &i : e.processed_inputs) {
-        i.voucher_hashes_in_epoch =
-            e.vouchers_tree.get_proof(i.epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
-        i.notice_hashes_in_epoch = e.notices_tree.get_proof(i.epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
-    }
+    // Materialize the complete trees only now, and release the leaves once all proofs are updated
+    std::array<epoch_output_tree_type *, 2> output_trees{&e.vouchers_tree, &e.notices_tree};
+    std::array<std::optional<cartesi::complete_merkle_tree>, 2> trees;
+    run_proof_jobs(hctx, actx, trees.size(), [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = begin; j < end; ++j) {
+            trees[j].emplace(LOG2_ROOT_SIZE, LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE, std::move(output_trees[j]->leaves));
+            output_trees[j]->leaves = std::vector<hash_type>{};
+        }
+    });
+    const auto &vouchers_tree = trees[0].value();
+    const auto &notices_tree = trees[1].value();
+    run_proof_jobs(hctx, actx, e.processed_inputs.size(), [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = begin; j < end; ++j) {
+            auto &i = e.processed_inputs[j];
+            i.voucher_hashes_in_epoch =
+                vouchers_tree.get_proof(i.epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            i.notice_hashes_in_epoch =
+                notices_tree.get_proof(i.epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+        }
+    });
 }
 
 /// \brief Start a new epoch in session
@@ -707,8 +1552,8 @@ static void set_proto_output_validity_proof(const epoch_type &e, uint64_t input_
     proto_ovp->set_input_index_within_epoch(input_index);
     proto_ovp->set_output_index_within_input(output_index);
     cartesi::set_proto_hash(output_hash_in_hashes.get_root_hash(), proto_ovp->mutable_output_hashes_root_hash());
-    cartesi::set_proto_hash(e.vouchers_tree.get_root_hash(), proto_ovp->mutable_vouchers_epoch_root_hash());
-    cartesi::set_proto_hash(e.notices_tree.get_root_hash(), proto_ovp->mutable_notices_epoch_root_hash());
+    cartesi::set_proto_hash(e.vouchers_tree.root_hash, proto_ovp->mutable_vouchers_epoch_root_hash());
+    cartesi::set_proto_hash(e.notices_tree.root_hash, proto_ovp->mutable_notices_epoch_root_hash());
     cartesi::set_proto_hash(e.most_recent_machine_hash, proto_ovp->mutable_machine_state_hash());
     for (int log2_size = output_hash_in_hashes.get_log2_target_size();
          log2_size < output_hash_in_hashes.get_log2_root_size(); ++log2_size) {
@@ -731,70 +1576,141 @@ static std::array<unsigned char, EVM_ABI_UINT64_LENGTH> get_abi_encoded_context(
     return context;
 }
 
+/// \brief Fills out a Proof of an output
+/// \param e Epoch type
+/// \param i Processed input that produced the output
+/// \param output_enum Whether output is a voucher or a notice
+/// \param output_index Output index in input
+/// \param output_hashes_in_epoch Voucher/Notice hashes in epoch proof
+/// \param output_hash_in_hashes Voucher/Notice hash in hashes proof
+/// \param context ABI encoded context of proof
+/// \param proto_p Pointer to message receiving the proof
+static void set_proto_proof(const epoch_type &e, const processed_input_type &i, OutputEnum output_enum,
+    uint64_t output_index, const proof_type &output_hashes_in_epoch, const proof_type &output_hash_in_hashes,
+    const std::array<unsigned char, EVM_ABI_UINT64_LENGTH> &context, Proof *proto_p) {
+    proto_p->set_input_index(i.input_index);
+    proto_p->set_output_index(output_index);
+    proto_p->set_output_enum(output_enum);
+    auto *p_context = proto_p->mutable_context();
+    p_context->insert(p_context->end(), context.begin(), context.end());
+    set_proto_output_validity_proof(e, i.epoch_input_index, output_hashes_in_epoch, output_index,
+        output_hash_in_hashes, proto_p->mutable_validity());
+}
+
+/// \brief Returns the number of outputs with proofs produced by a processed input
+/// \param i Processed input
+/// \returns Number of vouchers and notices
+static uint64_t get_proof_count(const processed_input_type &i) {
+    if (std::holds_alternative<accepted_data_type>(i.processed)) {
+        const auto &data = std::get<accepted_data_type>(i.processed);
+        return data.vouchers.size() + data.notices.size();
+    }
+    return 0;
+}
+
 /// \brief Fills out OutputValidityProofs on a FinishEpochResponse
+/// \param hctx Handler context shared between all handlers
+/// \param actx Context for async operations
 /// \param e Epoch type
+/// \param proof_offset Index of first proof to include in response
+/// \param proof_limit Maximum number of proofs to include in response
+/// \param in_place True to build the proofs without yielding, instead of in the proof pool
 /// \param response FinishEpochResponse
-static void set_proto_finish_epoch_response(const epoch_type &e, FinishEpochResponse &response) {
+/// \returns Total number of proofs in epoch
+/// \details Proofs are ordered by input, with the vouchers of each input followed by its notices. Only the proofs
+/// in the requested page are built, which bounds the size of the response for very large epochs.
+static uint64_t set_proto_finish_epoch_response(handler_context &hctx, async_context &actx, const epoch_type &e,
+    uint64_t proof_offset, uint64_t proof_limit, bool in_place, FinishEpochResponse &response) {
     cartesi::set_proto_hash(e.most_recent_machine_hash, response.mutable_machine_hash());
-    cartesi::set_proto_hash(e.vouchers_tree.get_root_hash(), response.mutable_vouchers_epoch_root_hash());
-    cartesi::set_proto_hash(e.notices_tree.get_root_hash(), response.mutable_notices_epoch_root_hash());
+    cartesi::set_proto_hash(e.vouchers_tree.root_hash, response.mutable_vouchers_epoch_root_hash());
+    cartesi::set_proto_hash(e.notices_tree.root_hash, response.mutable_notices_epoch_root_hash());
     const auto context = get_abi_encoded_context(e.epoch_index);
-    for (const auto &i : e.processed_inputs) {
-        if (std::holds_alternative<accepted_data_type>(i.processed)) {
+    // Index of the first proof of each input, followed by the total number of proofs
+    std::vector<uint64_t> first_proof(e.processed_inputs.size() + 1);
+    for (uint64_t j = 0; j < e.processed_inputs.size(); ++j) {
+        first_proof[j + 1] = first_proof[j] + get_proof_count(e.processed_inputs[j]);
+    }
+    const uint64_t proof_count = first_proof.back();
+    const uint64_t page_begin = std::min(proof_offset, proof_count);
+    const uint64_t page_end = page_begin + std::min(proof_limit, proof_count - page_begin);
+    if (page_begin == page_end) {
+        return proof_count;
+    }
+    // Add all proof messages in page up front, so each input's proofs can be filled out independently
+    auto *proto_proofs = response.mutable_proofs();
+    proto_proofs->Reserve(static_cast<int>(page_end - page_begin));
+    for (uint64_t k = page_begin; k < page_end; ++k) {
+        proto_proofs->Add();
+    }
+    // Inputs with proofs in page
+    const uint64_t input_begin =
+        std::upper_bound(first_proof.begin(), first_proof.end(), page_begin) - first_proof.begin() - 1;
+    const uint64_t input_end = std::lower_bound(first_proof.begin(), first_proof.end(), page_end) - first_proof.begin();
+    const auto set_proto_proofs = [&](uint64_t begin, uint64_t end) {
+        for (uint64_t j = input_begin + begin; j < input_begin + end; ++j) {
+            const auto &i = e.processed_inputs[j];
+            if (!std::holds_alternative<accepted_data_type>(i.processed)) {
+                continue;
+            }
             const auto &data = std::get<accepted_data_type>(i.processed);
-            uint64_t output_index = 0;
-            for (const auto &v : data.vouchers) {
-                Proof *proto_p = response.add_proofs();
-                proto_p->set_input_index(i.input_index);
-                proto_p->set_output_index(output_index);
-                proto_p->set_output_enum(OutputEnum::VOUCHER);
-                auto *p_context = proto_p->mutable_context();
-                p_context->insert(p_context->end(), context.begin(), context.end());
-                set_proto_output_validity_proof(e, i.epoch_input_index, i.voucher_hashes_in_epoch, output_index,
-                    v.hash.value().keccak_in_hashes, proto_p->mutable_validity());
-                output_index++;
-            }
-            output_index = 0;
-            for (const auto &n : data.notices) {
-                Proof *proto_p = response.add_proofs();
-                proto_p->set_input_index(i.input_index);
-                proto_p->set_output_index(output_index);
-                proto_p->set_output_enum(OutputEnum::NOTICE);
-                auto *p_context = proto_p->mutable_context();
-                p_context->insert(p_context->end(), context.begin(), context.end());
-                set_proto_output_validity_proof(e, i.epoch_input_index, i.notice_hashes_in_epoch, output_index,
-                    n.hash.value().keccak_in_hashes, proto_p->mutable_validity());
-                output_index++;
+            uint64_t k = first_proof[j];
+            for (uint64_t output_index = 0; output_index < data.vouchers.size(); ++output_index, ++k) {
+                if (k >= page_begin && k < page_end) {
+                    set_proto_proof(e, i, OutputEnum::VOUCHER, output_index, i.voucher_hashes_in_epoch,
+                        data.vouchers[output_index].hash.value().keccak_in_hashes, context,
+                        proto_proofs->Mutable(static_cast<int>(k - page_begin)));
+                }
+            }
+            for (uint64_t output_index = 0; output_index < data.notices.size(); ++output_index, ++k) {
+                if (k >= page_begin && k < page_end) {
+                    set_proto_proof(e, i, OutputEnum::NOTICE, output_index, i.notice_hashes_in_epoch,
+                        data.notices[output_index].hash.value().keccak_in_hashes, context,
+                        proto_proofs->Mutable(static_cast<int>(k - page_begin)));
+                }
             }
         }
+    };
+    if (in_place) {
+        set_proto_proofs(0, input_end - input_begin);
+    } else {
+        run_proof_jobs(hctx, actx, input_end - input_begin, set_proto_proofs);
     }
+    return proof_count;
 }
 
 /// \brief Creates a new handler for the FinishEpoch RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_FinishEpoch_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_FinishEpoch_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         FinishEpochRequest request;
         ServerAsyncResponseWriter<FinishEpochResponse> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestFinishEpoch(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_FinishEpoch_handler(hctx);
+        new_FinishEpoch_handler(hctx, shard);
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received FinishEpoch RPC with handle_context ok set to false";
             return;
         }
         try {
             Status status; // NOLINT: Unknown. Maybe linter bug?
-            FinishEpochResponse response;
-            auto &sessions = hctx.sessions;
+            // Nested proofs are allocated from an arena, and freed all at once when the handler exits
+            google::protobuf::Arena arena{get_response_arena_options()};
+            auto &response = *google::protobuf::Arena::Create<FinishEpochResponse>(&arena);
             const auto &id = request.session_id();
             auto epoch_index = request.active_epoch_index();
             LOG_CONTEXT(info, request_context) << "Received FinishEpoch for session " << id << " epoch " << epoch_index;
+            // Clients page through the proofs of large epochs with the proofs-offset and proofs-limit metadata,
+            // calling FinishEpoch again on the finished epoch with proofs-offset set to read the following pages
+            const auto proofs_offset = get_metadata_uint(request_context, "proofs-offset");
+            const auto proofs_limit = get_metadata_uint(request_context, "proofs-limit");
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            auto &sessions = session_shard.sessions;
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found"}));
@@ -805,49 +1721,79 @@ static handler_type::pull_type *new_FinishEpoch_handler(handler_context &hctx) {
             if (session.active_epoch_index == UINT64_MAX) {
                 THROW((finish_error_yield_none{grpc::StatusCode::OUT_OF_RANGE, "active epoch index will overflow"}));
             }
-            // If session is already locked, bail out
-            auto new_lock_reason = get_session_lock_reason("FinishEpoch", request_context.peer());
-            if (session.session_lock) {
-                THROW((finish_error_yield_none{grpc::StatusCode::ABORTED,
-                    "concurrent call in session (already locked by " + session.session_lock_reason +
-                        " when attempted lock by " + new_lock_reason + ")"}));
+            // Resume epoch status and held AdvanceState waiters only after the session lock below is released
+            auto_notify_session_waiters notify_waiters(session);
+            auto &epochs = session.epochs;
+            // A finished epoch no longer changes once the next one started. Another page of its proofs is built
+            // without yielding, so nothing can delete the epoch while we read it. So page re-reads need no lock
+            auto epoch_it = epochs.find(epoch_index);
+            const bool read_proofs_page = proofs_offset.has_value() && epoch_it != epochs.end() &&
+                epoch_it->second.state == epoch_state::finished && epoch_index < session.active_epoch_index;
+            std::optional<auto_lock> session_lock;
+            if (!read_proofs_page) {
+                // If session is already locked, bail out
+                auto new_lock_reason = get_session_lock_reason("FinishEpoch", request_context.peer());
+                if (session.session_lock) {
+                    THROW((finish_error_yield_none{grpc::StatusCode::ABORTED,
+                        "concurrent call in session (already locked by " + session.session_lock_reason +
+                            " when attempted lock by " + new_lock_reason + ")"}));
+                }
+                // Lock session so other rpcs to the same session are rejected
+                session_lock.emplace(session.session_lock, "FinishEpoch session lock");
+                session.session_lock_reason = new_lock_reason;
             }
-            // Lock session so other rpcs to the same session are rejected
-            auto_lock session_lock(session.session_lock, "FinishEpoch session lock");
-            session.session_lock_reason = new_lock_reason;
             // If session is tainted, report potential data loss
             if (session.tainted) {
                 THROW((finish_error_yield_none{grpc::StatusCode::DATA_LOSS, "session is tainted"}));
             }
-            auto &epochs = session.epochs;
             // If epoch is unknown, a bail out
-            if (epochs.find(epoch_index) == epochs.end()) {
+            if (epoch_it == epochs.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "unknown epoch index"}));
             }
-            auto &e = epochs[epoch_index];
-            // If epoch is not active, bail out
-            if (e.state != epoch_state::active) {
+            auto &e = epoch_it->second;
+            // If epoch is not active, bail out unless reading another page of its proofs
+            if (e.state != epoch_state::active && !read_proofs_page) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "epoch already finished"}));
             }
+            // The machine is only stored when the epoch finishes, so a page re-read cannot honor a storage directory
+            if (read_proofs_page && !request.storage_directory().empty()) {
+                THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT,
+                    "storage directory is only allowed when the epoch finishes"}));
+            }
             // If there are still pending inputs to process, bail out
             if (!e.pending_inputs.empty()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "epoch still has pending inputs"}));
             }
+            // Queries do not hold the session lock, so make sure none is using the machine we are about to store
+            if (!e.pending_queries.empty()) {
+                THROW((finish_error_yield_none{grpc::StatusCode::ABORTED, "epoch still has pending queries"}));
+            }
             // If the number of processed inputs does not match the expected, bail out
             if (e.processed_inputs.size() != request.processed_input_count_within_epoch()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT,
                     "incorrect processed input count (expected " + std::to_string(e.processed_inputs.size()) +
                         ", got " + std::to_string(request.processed_input_count_within_epoch()) + ")"}));
             }
-            // Try to store session before we change anything
-            if (!request.storage_directory().empty()) {
-                LOG_CONTEXT(debug, request_context) << "  Storing into " << request.storage_directory();
-                async_context actx{session, request_context, hctx.completion_queue.get(), self, yield};
-                store(actx, request.storage_directory());
+            async_context actx{session, request_context, session_shard.completion_queue.get(), self, yield};
+            auto start_time = std::chrono::system_clock::now();
+            if (!read_proofs_page) {
+                // Try to store session before we change anything
+                if (!request.storage_directory().empty()) {
+                    LOG_CONTEXT(debug, request_context) << "  Storing into " << request.storage_directory();
+                    store(actx, request.storage_directory());
+                }
+                finish_epoch(hctx, actx, e);
+                start_new_epoch(e, session);
+                notify_waiters.arm();
+            }
+            auto proof_count = set_proto_finish_epoch_response(hctx, actx, e, proofs_offset.value_or(0),
+                proofs_limit.value_or(UINT64_MAX), read_proofs_page, response);
+            request_context.AddInitialMetadata("proofs-count", std::to_string(proof_count));
+            if (!read_proofs_page) {
+                const std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - start_time;
+                observe_metric(session.metrics, &metrics_type::finish_epoch_seconds, elapsed.count());
+                observe_metric(session.metrics, &metrics_type::finish_epoch_proofs, static_cast<double>(proof_count));
             }
-            finish_epoch(e);
-            start_new_epoch(e, session);
-            set_proto_finish_epoch_response(e, response);
             writer.Finish(response, grpc::Status::OK, self);
             yield(side_effect::none);
         } catch (finish_error_yield_none &e) {
@@ -866,28 +1812,30 @@ static handler_type::pull_type *new_FinishEpoch_handler(handler_context &hctx) {
 
 /// \brief Creates a new handler for the DeleteEpoch RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_DeleteEpoch_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_DeleteEpoch_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         DeleteEpochRequest request;
         ServerAsyncResponseWriter<Void> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestDeleteEpoch(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_DeleteEpoch_handler(hctx);
+        new_DeleteEpoch_handler(hctx, shard);
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received DeleteEpoch RPC with handle_context ok set to false";
             return;
         }
         try {
             Void response; // NOLINT: Unknown. Maybe linter bug?
-            auto &sessions = hctx.sessions;
             const auto &id = request.session_id();
             auto epoch_index = request.epoch_index();
             LOG_CONTEXT(info, request_context) << "Received DeleteEpoch for session " << id << " epoch " << epoch_index;
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            auto &sessions = session_shard.sessions;
             // If a session is unknown, bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found"}));
@@ -948,28 +1896,30 @@ static void shutdown_server(async_context &actx) {
 
 /// \brief Creates a new handler for the EndSession RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_EndSession_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_EndSession_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         EndSessionRequest request;
         ServerAsyncResponseWriter<Void> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestEndSession(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_EndSession_handler(hctx);
+        new_EndSession_handler(hctx, shard);
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received EndSession RPC with handle_context ok set to false";
             return;
         }
         try {
             Status status; // NOLINT: Unknown. Maybe linter bug?
             Void response;
-            auto &sessions = hctx.sessions;
             const auto &id = request.session_id();
             LOG_CONTEXT(info, request_context) << "Received EndSession for session " << id;
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            auto &sessions = session_shard.sessions;
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found"}));
@@ -986,8 +1936,16 @@ static handler_type::pull_type *new_EndSession_handler(handler_context &hctx) {
             // Lock session so other rpcs to the same session are rejected
             auto_lock session_lock(session.session_lock, "EndSession session lock");
             session.session_lock_reason = new_lock_reason;
-            async_context actx{session, request_context, cq, self, yield};
-            // If the session is tainted, nothing is going on with it, so we can erase it
+            // Queries do not hold the session lock, so make sure none is still referencing the session
+            if (!session.epochs[session.active_epoch_index].pending_queries.empty()) {
+                THROW((finish_error_yield_none{grpc::StatusCode::ABORTED, "active epoch has pending queries"}));
+            }
+            // The handler processing inputs holds on to the session, even after it gets tainted
+            if (session.processing_lock) {
+                THROW((finish_error_yield_none{grpc::StatusCode::ABORTED, "session is processing inputs"}));
+            }
+            async_context actx{session, request_context, session_shard.completion_queue.get(), self, yield};
+            // If the session is tainted, nothing else is going on with it, so we can erase it
             if (!session.tainted) {
                 // If the session is not tainted, we will only delete it if the active epoch is pristine
                 auto &epochs = session.epochs;
@@ -1001,17 +1959,13 @@ static handler_type::pull_type *new_EndSession_handler(handler_context &hctx) {
                         "active epoch has processed inputs"}));
                 }
             }
-            // This is just for peace of mind, there no way this branch can enter
-            if (session.processing_lock) {
-                THROW((finish_error_yield_none{grpc::StatusCode::INTERNAL, "session is processing inputs!"}));
-            }
             shutdown_server(actx);
             if (session.tainted) {
                 LOG_CONTEXT(info, request_context)
                     << "Session " << id << " is tainted. Terminating remote-cartesi-machine process group";
                 session.server_process_group.terminate();
             }
-            sessions.erase(id);
+            erase_session(hctx, id);
             writer.Finish(response, grpc::Status::OK, self);
             yield(side_effect::none);
         } catch (finish_error_yield_none &e) {
@@ -1030,27 +1984,28 @@ static handler_type::pull_type *new_EndSession_handler(handler_context &hctx) {
 
 /// \brief Creates a new handler for the GetSessionStatus RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_GetSessionStatus_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_GetSessionStatus_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         GetSessionStatusRequest request;
         ServerAsyncResponseWriter<GetSessionStatusResponse> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestGetSessionStatus(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_GetSessionStatus_handler(hctx);
+        new_GetSessionStatus_handler(hctx, shard);
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received GetSessionStatus RPC with handle_context ok set to false";
             return;
         }
         Status status; // NOLINT: cannot leak (pointer is in completion queue)
         GetSessionStatusResponse response;
-        auto &sessions = hctx.sessions;
         const auto &id = request.session_id();
         LOG_CONTEXT(info, request_context) << "Received GetSessionStatus for session " << id;
+        auto &sessions = move_to_session_shard(hctx, shard, id, self, yield).sessions;
         try {
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
@@ -1163,23 +2118,30 @@ static void set_proto_exception_data(const processed_input_type &i, ProcessedInp
 
 /// \brief Fills out ProcessedInput message from structure
 /// \param i Structure
+/// \param with_payloads Whether to include reports, vouchers, notices, and exception data, or only the status
 /// \param proto_i Pointer to message receiving structure contents
-static void set_proto_processed_input(const processed_input_type &i, ProcessedInput *proto_i) {
+static void set_proto_processed_input(const processed_input_type &i, bool with_payloads, ProcessedInput *proto_i) {
     proto_i->set_input_index(i.input_index);
-    for (const auto &r : i.reports) {
-        set_proto_report(r, proto_i->add_reports());
+    if (with_payloads) {
+        for (const auto &r : i.reports) {
+            set_proto_report(r, proto_i->add_reports());
+        }
     }
     switch (i.status) {
         case completion_status::accepted:
             proto_i->set_status(CompletionStatus::ACCEPTED);
-            set_proto_accepted_data(i, proto_i);
+            if (with_payloads) {
+                set_proto_accepted_data(i, proto_i);
+            }
             break;
         case completion_status::rejected:
             proto_i->set_status(CompletionStatus::REJECTED);
             break;
         case completion_status::exception:
             proto_i->set_status(CompletionStatus::EXCEPTION);
-            set_proto_exception_data(i, proto_i);
+            if (with_payloads) {
+                set_proto_exception_data(i, proto_i);
+            }
             break;
         case completion_status::machine_halted:
             proto_i->set_status(CompletionStatus::MACHINE_HALTED);
@@ -1196,31 +2158,71 @@ static void set_proto_processed_input(const processed_input_type &i, ProcessedIn
     }
 }
 
+/// \brief Returns the total length of the payloads in a processed input
+/// \param i Processed input
+/// \returns Length of reports, vouchers, notices, and exception data
+static uint64_t get_processed_input_payload_length(const processed_input_type &i) {
+    uint64_t length = 0;
+    for (const auto &r : i.reports) {
+        length += r.payload.size();
+    }
+    if (std::holds_alternative<accepted_data_type>(i.processed)) {
+        const auto &data = std::get<accepted_data_type>(i.processed);
+        for (const auto &o : data.vouchers) {
+            length += o.payload.size();
+        }
+        for (const auto &m : data.notices) {
+            length += m.payload.size();
+        }
+    } else if (std::holds_alternative<std::string>(i.processed)) {
+        length += std::get<std::string>(i.processed).size();
+    }
+    return length;
+}
+
 /// \brief Creates a new handler for the GetEpochStatus RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_GetEpochStatus_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_GetEpochStatus_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         GetEpochStatusRequest request;
         ServerAsyncResponseWriter<GetEpochStatusResponse> writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         hctx.manager_async_service.RequestGetEpochStatus(&request_context, &request, &writer, cq, cq, self);
         yield(side_effect::none);
-        new_GetEpochStatus_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_GetEpochStatus_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received GetEpochStatus RPC with handle_context ok set to false";
             return;
         }
         try {
-            GetEpochStatusResponse response; // NOLINT: Unknown. Maybe linter bug?
-            auto &sessions = hctx.sessions;
+            // Nested processed inputs are allocated from an arena, and freed all at once when the handler exits
+            google::protobuf::Arena arena{get_response_arena_options()};
+            auto &response = *google::protobuf::Arena::Create<GetEpochStatusResponse>(&arena);
             const auto &id = request.session_id();
             auto epoch_index = request.epoch_index();
             LOG_CONTEXT(info, request_context)
                 << "Received GetEpochStatus for session " << id << " epoch " << epoch_index;
+            // Pollers only fetch new processed inputs with the inputs-offset cursor, bound the response with
+            // inputs-limit and inputs-length-limit, and skip payloads by setting inputs-without-payloads to 1
+            const auto inputs_offset = get_metadata_uint(request_context, "inputs-offset").value_or(0);
+            const auto inputs_limit = get_metadata_uint(request_context, "inputs-limit").value_or(UINT64_MAX);
+            const auto inputs_length_limit =
+                get_metadata_uint(request_context, "inputs-length-limit").value_or(UINT64_MAX);
+            const bool with_payloads = get_metadata_uint(request_context, "inputs-without-payloads").value_or(0) == 0;
+            // Instead of polling, clients can set inputs-wait to hold the response for up to that many milliseconds,
+            // until there are processed inputs past inputs-offset, but never longer than EPOCH_STATUS_MAX_WAIT
+            const auto inputs_wait =
+                std::min(get_metadata_uint(request_context, "inputs-wait").value_or(0), EPOCH_STATUS_MAX_WAIT);
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            if (inputs_wait > 0) {
+                wait_epoch_status(session_shard, id, epoch_index, inputs_offset, inputs_wait, self, yield);
+            }
+            auto &sessions = session_shard.sessions;
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found"}));
@@ -1253,9 +2255,19 @@ static handler_type::pull_type *new_GetEpochStatus_handler(handler_context &hctx
                     response.set_state(EpochState::FINISHED);
                     break;
             }
-            for (const auto &i : e.processed_inputs) {
-                set_proto_processed_input(i, response.add_processed_inputs());
+            uint64_t payload_length = 0;
+            for (uint64_t j = inputs_offset; j < e.processed_inputs.size() && j - inputs_offset < inputs_limit; ++j) {
+                const auto &i = e.processed_inputs[j];
+                if (with_payloads) {
+                    // Always include the first input, so pollers make progress even with a tiny limit
+                    payload_length += get_processed_input_payload_length(i);
+                    if (payload_length > inputs_length_limit && j > inputs_offset) {
+                        break;
+                    }
+                }
+                set_proto_processed_input(i, with_payloads, response.add_processed_inputs());
             }
+            request_context.AddInitialMetadata("processed-input-count", std::to_string(e.processed_inputs.size()));
             response.set_pending_input_count(e.pending_inputs.size());
             if (session.tainted) {
                 response.mutable_taint_status()->set_error_code(session.taint_status.error_code());
@@ -1320,6 +2332,7 @@ static auto get_proto_cycles_config(const CyclesConfig &proto_p) {
 static auto get_proto_session(const StartSessionRequest &request) {
     session_type session;
     session.id = request.session_id();
+    session.checkin_id = request.session_id();
     session.session_lock = false;
     session.tainted = false;
     session.processing_lock = false;
@@ -1469,84 +2482,274 @@ static void check_server_stub(session_type &session) {
     }
 }
 
+/// \brief Updates the connection to the machine server after it checked in with a new address
+/// \param session Session with machine server
+/// \param address Address received in check-in
+/// \details When a machine server snapshots, the parent process waits at its old address while the child checks in
+/// with a new address. On rollback, the child exits and the parent checks in again with the old address. We keep the
+/// connection to the parent around, so rollbacks do not have to build a new channel.
+static void update_server_stub(session_type &session, std::string address) {
+    if (session.server_stub && address == session.server_address && session.reuse_server_stub) {
+        // Machine server is bound to an address that does not change across forks
+        return;
+    }
+    if (session.previous_server_stub && address == session.previous_server_address) {
+        // Back to the machine server we were connected to before. The connection we are replacing is to a machine
+        // server that is now gone, so there is nothing worth keeping.
+        session.server_stub = std::move(session.previous_server_stub);
+        session.server_address = std::move(address);
+        session.previous_server_address.clear();
+        return;
+    }
+    session.previous_server_stub = std::move(session.server_stub);
+    session.previous_server_address = std::move(session.server_address);
+    session.server_address = std::move(address);
+    check_server_stub(session);
+}
+
 /// \brief Creates a new handler for the Checkin Deadline handler
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_CheckinDeadline_handler(handler_context &hctx, const id_type &id,
-    uint64_t deadline) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx, id, deadline](handler_type::push_type &yield) {
+/// \param shard Shard running the coroutine waiting for check-in
+/// \param id Id the machine server uses when checking in
+/// \param deadline Deadline in milliseconds
+static handler_type::pull_type *new_CheckinDeadline_handler(handler_context &hctx, shard_type &shard,
+    const id_type &id, uint64_t deadline) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard, id, deadline](handler_type::push_type &yield) {
         using namespace grpc;
-        auto it_before = hctx.sessions_waiting_checkin.find(id);
-        // If there isn't a session with id waiting for check-in, it's a bug on the implementation
-        if (it_before == hctx.sessions_waiting_checkin.end()) {
-            BOOST_LOG_TRIVIAL(fatal) << "registering check-in deadline with wrong session id " << id;
-            exit(1);
+        grpc::Alarm *alarm = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(hctx.mutex);
+            auto it_before = hctx.sessions_waiting_checkin.find(id);
+            // If there isn't a session with id waiting for check-in, it's a bug on the implementation
+            if (it_before == hctx.sessions_waiting_checkin.end()) {
+                BOOST_LOG_TRIVIAL(fatal) << "registering check-in deadline with wrong session id " << id;
+                exit(1);
+            }
+            // Registering session check-in deadline alarm.
+            alarm = it_before->second.alarm.get();
+            alarm->Set(shard.completion_queue.get(),
+                std::chrono::system_clock::now() + std::chrono::milliseconds(deadline), self);
         }
-        // Registering session check-in deadline alarm.
-        auto *cq = hctx.completion_queue.get();
-        it_before->second.alarm->Set(cq, std::chrono::system_clock::now() + std::chrono::milliseconds(deadline), self);
         yield(side_effect::none);
         BOOST_LOG_TRIVIAL(debug) << "Resuming Check-in deadline alarm coroutine for session: " << id;
-        if (!hctx.ok) {
+        if (!shard.ok) {
             BOOST_LOG_TRIVIAL(debug) << "Check-in deadline alarm was canceled";
             return;
         }
-        auto it_after = hctx.sessions_waiting_checkin.find(id);
-        // If there isn't a session with id waiting for check-in, it's a bug on the implementation
-        if (it_after == hctx.sessions_waiting_checkin.end()) {
-            BOOST_LOG_TRIVIAL(fatal) << "Deadline alarm failed to find session waiting for check-in with id: " << id;
-            exit(1);
+        handler_type::pull_type *coroutine = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(hctx.mutex);
+            auto it_after = hctx.sessions_waiting_checkin.find(id);
+            // The check-in may have arrived in another shard just as the alarm went off
+            if (it_after == hctx.sessions_waiting_checkin.end() || it_after->second.alarm.get() != alarm ||
+                it_after->second.status.has_value()) {
+                BOOST_LOG_TRIVIAL(debug) << "Check-in deadline alarm went off after check-in for session: " << id;
+                return;
+            }
+            BOOST_LOG_TRIVIAL(error) << "Check-in deadline for remote machine was reached on session: " << id;
+            checkin_context &cctx = it_after->second;
+            // Acknowledge that check-in has failed
+            cctx.status = false;
+            coroutine = cctx.coroutine;
         }
-        BOOST_LOG_TRIVIAL(error) << "Check-in deadline for remote machine was reached on session: " << id;
-        // auto &session = hctx.sessions[id];
-        checkin_context &cctx = it_after->second;
-        // Acknowledge that check-in has failed
-        cctx.status = false;
         // Resume after checkin trigger
-        (*cctx.coroutine)();
+        (*coroutine)();
     }};
     return self;
 }
 
+/// \brief Registers a coroutine waiting for a machine server to check in
+/// \param hctx Handler context shared between all handlers
+/// \param shard Shard running the coroutine
+/// \param checkin_id Id the machine server uses when checking in
+/// \param coroutine Coroutine to continue after check-in
+static void register_checkin_wait(handler_context &hctx, shard_type &shard, const id_type &checkin_id,
+    handler_type::pull_type *coroutine) {
+    std::lock_guard<std::mutex> lock(hctx.mutex);
+    hctx.sessions_waiting_checkin[checkin_id] = {coroutine, shard.completion_queue.get(),
+        std::make_unique<grpc::Alarm>(), std::nullopt, {}};
+}
+
+/// \brief Removes the context of a coroutine that waited for a machine server to check in
+/// \param hctx Handler context shared between all handlers
+/// \param checkin_id Id the machine server uses when checking in
+/// \return Check-in context, or nothing if it is missing
+static std::optional<checkin_context> take_checkin_context(handler_context &hctx, const id_type &checkin_id) {
+    std::lock_guard<std::mutex> lock(hctx.mutex);
+    auto it = hctx.sessions_waiting_checkin.find(checkin_id);
+    if (it == hctx.sessions_waiting_checkin.end()) {
+        return {};
+    }
+    std::optional<checkin_context> cctx{std::move(it->second)};
+    hctx.sessions_waiting_checkin.erase(it);
+    return cctx;
+}
+
 template <class T>
 void trigger_and_wait_checkin(handler_context &hctx, async_context &actx, T trigger_checkin) {
     // trigger remote check-in
     LOG_CONTEXT(debug, actx.request_context) << "  Triggering machine server check-in";
+    auto &session_shard = get_session_shard(hctx, actx.session.id);
     // Assert that this session is not waiting for check-in already
-    if (hctx.sessions_waiting_checkin.find(actx.session.id) != hctx.sessions_waiting_checkin.end()) {
-        LOG_CONTEXT(fatal, actx.request_context) << "Session is already waiting for a previous check-in.";
-        exit(1);
+    {
+        std::lock_guard<std::mutex> lock(hctx.mutex);
+        if (hctx.sessions_waiting_checkin.find(actx.session.checkin_id) != hctx.sessions_waiting_checkin.end()) {
+            LOG_CONTEXT(fatal, actx.request_context) << "Session is already waiting for a previous check-in.";
+            exit(1);
+        }
     }
     trigger_checkin(hctx, actx); // NOLINT: avoid boost warnings?
+    auto_observe_phase observe(actx.session, phase_type::checkin);
     // Wait for CheckIn
     LOG_CONTEXT(debug, actx.request_context) << "  Waiting check-in";
-    hctx.sessions_waiting_checkin[actx.session.id] = {actx.self, std::make_unique<grpc::Alarm>(), std::nullopt};
+    register_checkin_wait(hctx, session_shard, actx.session.checkin_id, actx.self);
     // NOLINTNEXTLINE: cannot leak (pointer is in completion queue)
-    new_CheckinDeadline_handler(hctx, actx.session.id, actx.session.server_deadline.checkin);
+    new_CheckinDeadline_handler(hctx, session_shard, actx.session.checkin_id, actx.session.server_deadline.checkin);
     actx.yield(side_effect::none); // NOLINT: avoid boost warnings
     // Check if the check-in context is still there
-    auto it = hctx.sessions_waiting_checkin.find(actx.session.id);
-    if (it == hctx.sessions_waiting_checkin.end()) {
+    auto cctx = take_checkin_context(hctx, actx.session.checkin_id);
+    if (!cctx.has_value()) {
         LOG_CONTEXT(fatal, actx.request_context) << "Check-in context was already erased";
         exit(1);
     }
     // Check if the check-in context status was set
-    if (!it->second.status.has_value()) {
+    if (!cctx->status.has_value()) {
         LOG_CONTEXT(fatal, actx.request_context) << "Check-in context status was not set";
         exit(1);
     }
     // Check if the check-in failed / reached it deadline
-    if (!it->second.status.value()) {
-        hctx.sessions_waiting_checkin.erase(it);
+    if (!cctx->status.value()) {
         THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
             "Remote machine check-in has failed on session: " + actx.session.id}));
     }
     // Check-in was successful
-    hctx.sessions_waiting_checkin.erase(it);
     LOG_CONTEXT(debug, actx.request_context)
-        << "  Check-in for session " << actx.session.id << " passed with address " << actx.session.server_address;
+        << "  Check-in for session " << actx.session.id << " passed with address " << cctx->address;
     // update server stub
-    check_server_stub(actx.session);
+    update_server_stub(actx.session, std::move(cctx->address));
+}
+
+/// \brief Spawns a new machine server and asks it to check-in
+/// \param hctx Handler context shared between all handlers
+/// \param checkin_id Id the machine server uses when checking in
+/// \param process_group Receives the machine server process
+/// \return Command-line used to spawn the machine server
+/// \details Throws boost::process::process_error if spawning fails
+static std::string spawn_machine_server(handler_context &hctx, const id_type &checkin_id,
+    boost::process::group &process_group) {
+    auto cmdline = hctx.remote_cartesi_machine_command + " --session-id=" + checkin_id +
+        " --checkin-address=" + hctx.manager_address + " --server-address=" + hctx.server_address;
+    // NOLINTNEXTLINE: boost generated warnings
+    auto server_process = boost::process::child(cmdline, process_group);
+    server_process.detach();
+    return cmdline;
+}
+
+/// \brief Creates a new handler that spawns a machine server for the pool and waits for its check-in
+/// \param hctx Handler context shared between all handlers
+/// \param shard Shard running the handler
+/// \param checkin_id Id the machine server uses when checking in
+static handler_type::pull_type *new_MachineServerPool_handler(handler_context &hctx, shard_type &shard,
+    const id_type &checkin_id) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard, checkin_id](handler_type::push_type &yield) {
+        auto *cq = shard.completion_queue.get();
+        // The entry was added by replenish_machine_server_pool and cannot be claimed before it checks in.
+        // If the machine server fails, we replace the entry right away, instead of leaving the pool short until
+        // the next claim replenishes it.
+        auto id = checkin_id;
+        for (;;) {
+            auto &pooled = [&]() -> pooled_machine_server_type & {
+                std::lock_guard<std::mutex> lock(hctx.mutex);
+                return hctx.machine_server_pool[id];
+            }();
+            bool spawned = false;
+            try {
+                auto cmdline = spawn_machine_server(hctx, id, pooled.process_group);
+                spawned = true;
+                BOOST_LOG_TRIVIAL(debug) << "Spawning " << cmdline << " for machine server pool";
+                // Wait for CheckIn
+                register_checkin_wait(hctx, shard, id, self);
+                // NOLINTNEXTLINE: cannot leak (pointer is in completion queue)
+                new_CheckinDeadline_handler(hctx, shard, id, MACHINE_SERVER_POOL_CHECKIN_DEADLINE);
+                yield(side_effect::none);
+                auto cctx = take_checkin_context(hctx, id);
+                if (!cctx.has_value() || !cctx->status.has_value()) {
+                    BOOST_LOG_TRIVIAL(fatal) << "Check-in context for pooled machine server " << id
+                                             << " is missing or has no status";
+                    exit(1);
+                }
+                if (cctx->status.value()) {
+                    std::lock_guard<std::mutex> lock(hctx.mutex);
+                    pooled.address = std::move(cctx->address);
+                    pooled.checked_in = true;
+                    BOOST_LOG_TRIVIAL(debug) << "Machine server " << id << " joined pool with address "
+                                             << pooled.address;
+                    break;
+                }
+                BOOST_LOG_TRIVIAL(error) << "Check-in has failed for pooled machine server " << id;
+                std::error_code ec;
+                pooled.process_group.terminate(ec);
+            } catch (boost::process::process_error &e) {
+                BOOST_LOG_TRIVIAL(error) << "Failed spawning machine server for pool (" << e.what() << ")";
+            }
+            // Replace the failed entry with a new one, under a new id so a late check-in cannot be mistaken for it
+            {
+                std::lock_guard<std::mutex> lock(hctx.mutex);
+                hctx.machine_server_pool.erase(id);
+                id = MACHINE_SERVER_POOL_ID_PREFIX + std::to_string(hctx.machine_server_pool_next_index++);
+                hctx.machine_server_pool[id].checkin_id = id;
+            }
+            // Check-in failures are already paced by their deadline, but spawning fails immediately
+            if (!spawned) {
+                auto retry_interval = std::chrono::milliseconds(MACHINE_SERVER_POOL_SPAWN_RETRY_INTERVAL);
+                grpc::Alarm alarm;
+                alarm.Set(cq, std::chrono::system_clock::now() + retry_interval, self);
+                yield(side_effect::none);
+            }
+        }
+        // We were resumed by another handler (or are still being constructed), so we can't simply finish.
+        // Instead, we arrange for the completion queue to return us, so the dispatch loop deletes us.
+        enqueue_completion_queue(cq, self);
+        yield(side_effect::none);
+    }};
+    return self;
+}
+
+/// \brief Spawns machine servers until the pool has the requested size
+/// \param hctx Handler context shared between all handlers
+/// \param shard Shard running the handlers that wait for the new machine servers to check in
+static void replenish_machine_server_pool(handler_context &hctx, shard_type &shard) {
+    // Reserve pool entries first, so concurrent calls from other shards do not overshoot the pool size
+    std::vector<id_type> checkin_ids;
+    {
+        std::lock_guard<std::mutex> lock(hctx.mutex);
+        while (hctx.machine_server_pool.size() < hctx.machine_server_pool_size) {
+            auto checkin_id = MACHINE_SERVER_POOL_ID_PREFIX + std::to_string(hctx.machine_server_pool_next_index++);
+            hctx.machine_server_pool[checkin_id].checkin_id = checkin_id;
+            checkin_ids.push_back(std::move(checkin_id));
+        }
+    }
+    for (const auto &checkin_id : checkin_ids) {
+        // NOLINTNEXTLINE: cannot leak (pointer is in completion queue)
+        new_MachineServerPool_handler(hctx, shard, checkin_id);
+    }
+}
+
+/// \brief Claims a pooled machine server that has already checked in
+/// \param hctx Handler context shared between all handlers
+/// \return Pooled machine server, or nothing if none is ready
+static std::optional<pooled_machine_server_type> claim_pooled_machine_server(handler_context &hctx) {
+    std::lock_guard<std::mutex> lock(hctx.mutex);
+    for (auto it = hctx.machine_server_pool.begin(); it != hctx.machine_server_pool.end(); ++it) {
+        if (it->second.checked_in) {
+            std::optional<pooled_machine_server_type> pooled{std::move(it->second)};
+            hctx.machine_server_pool.erase(it);
+            return pooled;
+        }
+    }
+    return {};
 }
 
 /// \brief Extracts the data field in HTIF's fromhost/tohost register value
@@ -1656,6 +2859,7 @@ static uint64_t check_is_yielded(async_context &actx) {
 /// \brief Asynchronously get current root hash from machine server. (Assumes Merkle tree has been updated)
 /// \param actx Context for async operations
 static hash_type get_root_hash(async_context &actx) {
+    auto_observe_phase observe(actx.session, phase_type::root_hash);
     Void request;
     grpc::ClientContext client_context;
     set_deadline(client_context, actx.session.server_deadline.machine);
@@ -1683,27 +2887,29 @@ static void start_first_epoch(async_context &actx, session_type &session) {
 
 /// \brief Creates a new handler for the StartSession RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_StartSession_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_StartSession_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         StartSessionRequest start_session_request;
         ServerAsyncResponseWriter<StartSessionResponse> start_session_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Wait for a StartSession RPC
         hctx.manager_async_service.RequestStartSession(&request_context, &start_session_request, &start_session_writer,
             cq, cq, self);
         yield(side_effect::none);
-        new_StartSession_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_StartSession_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received StartSession RPC with handle_context ok set to false";
             return;
         }
+        // Error paths only erase the session if we allocated it, and by then we run in the session shard
+        bool allocated_session = false;
         try {
             // We now received a StartSession RPC
-            auto &sessions = hctx.sessions; // NOLINT: Unknown. Maybe linter bug?
             const auto &id = start_session_request.session_id();
             LOG_CONTEXT(info, request_context) << "Received StartSession request for session " << id;
             // Empty id is invalid, so a bail out
@@ -1713,6 +2919,15 @@ static handler_type::pull_type *new_StartSession_handler(handler_context &hctx)
                 yield(side_effect::none);
                 return;
             }
+            // If the id could be taken by a pooled machine server when checking in, bail out
+            if (id.rfind(MACHINE_SERVER_POOL_ID_PREFIX, 0) == 0) {
+                start_session_writer.FinishWithError(
+                    grpc::Status{StatusCode::INVALID_ARGUMENT, "session id prefix is reserved"}, self);
+                yield(side_effect::none);
+                return;
+            }
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            auto &sessions = session_shard.sessions; // NOLINT: Unknown. Maybe linter bug?
             // If a session with this id already exists, a bail out
             if (sessions.find(id) != sessions.end()) {
                 start_session_writer.FinishWithError(grpc::Status{StatusCode::ALREADY_EXISTS, "session id is taken"},
@@ -1721,7 +2936,25 @@ static handler_type::pull_type *new_StartSession_handler(handler_context &hctx)
                 return;
             }
             // Allocate a new session with data from request
+            std::unique_lock<std::mutex> sessions_lock(session_shard.sessions_mutex);
             auto &session = (sessions[id] = get_proto_session(start_session_request));
+            sessions_lock.unlock();
+            allocated_session = true;
+            session.tx_read_prefix_length = hctx.tx_read_prefix_length;
+            session.reuse_server_stub = hctx.reuse_server_stub;
+            // The snapshot policy can be chosen per session with the snapshot-interval and
+            // snapshot-rejection-threshold metadata
+            session.snapshot_interval =
+                get_metadata_uint(request_context, "snapshot-interval").value_or(hctx.snapshot_interval);
+            session.snapshot_rejection_threshold =
+                get_metadata_uint(request_context, "snapshot-rejection-threshold")
+                    .value_or(hctx.snapshot_rejection_threshold);
+            if (session.snapshot_interval == 0 || session.snapshot_rejection_threshold > 100) {
+                THROW((finish_error_yield_none{StatusCode::INVALID_ARGUMENT,
+                    "invalid snapshot-interval or snapshot-rejection-threshold"}));
+            }
+            session.adaptive_run_increment = hctx.adaptive_run_increment;
+            session.metrics = hctx.metrics.path.empty() ? nullptr : &hctx.metrics;
             // Lock session so other rpcs to the same session are rejected
             auto new_lock_reason = get_session_lock_reason("StartSession", request_context.peer());
             auto_lock lock(session.session_lock, "StartSession session lock");
@@ -1772,23 +3005,31 @@ static handler_type::pull_type *new_StartSession_handler(handler_context &hctx)
                 THROW((finish_error_yield_none{StatusCode::INVALID_ARGUMENT,
                     "max cycles per inspect state is less than cycles per inspect state increment"}));
             }
-            // Wait for machine server to checkin after spawned
-            async_context actx{session, request_context, cq, self, yield};
-            trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
-                // Spawn a new server and ask it to check-in
-                auto cmdline = hctx.remote_cartesi_machine_path + " --session-id=" + actx.session.id +
-                    " --checkin-address=" + hctx.manager_address + " --server-address=" + hctx.server_address;
-                LOG_CONTEXT(debug, actx.request_context) << "  Spawning " << cmdline;
-                try {
-                    // NOLINTNEXTLINE: boost generated warnings
-                    auto server_process = boost::process::child(cmdline, actx.session.server_process_group);
-                    server_process.detach();
-                } catch (boost::process::process_error &e) {
-                    THROW((finish_error_yield_none{StatusCode::INTERNAL,
-                        "failed spawning remote-cartesi-machine with command-line '" + cmdline + "' (" + e.what() +
-                            ")"}));
-                }
-            });
+            async_context actx{session, request_context, session_shard.completion_queue.get(), self, yield};
+            auto pooled = claim_pooled_machine_server(hctx);
+            if (pooled.has_value()) {
+                // Use a machine server that was spawned and checked in ahead of time
+                LOG_CONTEXT(debug, request_context)
+                    << "  Claiming pooled machine server " << pooled->checkin_id << " at " << pooled->address;
+                session.checkin_id = std::move(pooled->checkin_id);
+                session.server_address = std::move(pooled->address);
+                session.server_process_group = std::move(pooled->process_group);
+                check_server_stub(session);
+                replenish_machine_server_pool(hctx, session_shard);
+            } else {
+                // Wait for machine server to checkin after spawned
+                trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
+                    // Spawn a new server and ask it to check-in
+                    try {
+                        auto cmdline = spawn_machine_server(hctx, actx.session.checkin_id,
+                            actx.session.server_process_group);
+                        LOG_CONTEXT(debug, actx.request_context) << "  Spawned " << cmdline;
+                    } catch (boost::process::process_error &e) {
+                        THROW((finish_error_yield_none{StatusCode::INTERNAL,
+                            "failed spawning remote-cartesi-machine (" + std::string{e.what()} + ")"}));
+                    }
+                });
+            }
             try {
                 check_server_version(actx);
                 check_server_machine(actx, start_session_request.machine_directory());
@@ -1816,12 +3057,16 @@ static handler_type::pull_type *new_StartSession_handler(handler_context &hctx)
             }
         } catch (finish_error_yield_none &e) {
             LOG_CONTEXT(error, request_context) << "Caught finish_error_yield_none " << e.status().error_message();
-            hctx.sessions.erase(start_session_request.session_id());
+            if (allocated_session) {
+                erase_session(hctx, start_session_request.session_id());
+            }
             start_session_writer.FinishWithError(e.status(), self);
             yield(side_effect::none);
         } catch (std::exception &e) {
             LOG_CONTEXT(error, request_context) << "Caught unexpected exception " << e.what();
-            hctx.sessions.erase(start_session_request.session_id());
+            if (allocated_session) {
+                erase_session(hctx, start_session_request.session_id());
+            }
             start_session_writer.FinishWithError(
                 grpc::Status{grpc::StatusCode::INTERNAL, std::string{"unexpected exception "} + e.what()}, self);
             yield(side_effect::none);
@@ -1830,110 +3075,101 @@ static handler_type::pull_type *new_StartSession_handler(handler_context &hctx)
     return self;
 }
 
-/// \brief Asynchronously clears the rx buffer, input metadata, voucher hashes, and notice hashes memory ranges
+/// \brief Machine server call that may still be in flight
+/// \tparam RESPONSE Type of response message
+/// \details Several calls can be in flight at the same time when all of them use the coroutine as their tag.
+/// The coroutine must then yield once per call before it inspects any of the results.
+template <typename RESPONSE>
+struct machine_call_type {
+    grpc::ClientContext client_context{};
+    RESPONSE response{};
+    grpc::Status status{};
+    std::unique_ptr<grpc::ClientAsyncResponseReader<RESPONSE>> reader{};
+};
+
+/// \brief Starts a machine server call without waiting for it to complete
 /// \param actx Context for async operations
-static void clear_memory_ranges(async_context &actx) {
-    std::array<std::pair<MemoryRangeConfig *, const char *>, 4> range_configs = {
-        std::make_pair(&actx.session.memory_range.rx_buffer.config, "rx buffer"),
-        std::make_pair(&actx.session.memory_range.input_metadata.config, "input metadata"),
-        std::make_pair(&actx.session.memory_range.voucher_hashes.config, "voucher hashes"),
-        std::make_pair(&actx.session.memory_range.notice_hashes.config, "notice hashes")};
-    for (auto config : range_configs) {
-        LOG_CONTEXT(debug, actx.request_context) << "      clearing " << config.second;
-        ReplaceMemoryRangeRequest replace_request;
-        replace_request.set_allocated_config(config.first);
-        Void replace_response;
-        grpc::ClientContext client_context;
-        set_deadline(client_context, actx.session.server_deadline.fast);
-        auto reader =
-            actx.session.server_stub->AsyncReplaceMemoryRange(&client_context, replace_request, actx.completion_queue);
-        grpc::Status replace_status;
-        reader->Finish(&replace_response, &replace_status, actx.self);
+/// \param call Receives the call state
+/// \param deadline Deadline in milliseconds
+/// \param start_call Function that receives the client context and starts the call in the stub
+template <typename RESPONSE, typename START>
+static void start_machine_call(async_context &actx, machine_call_type<RESPONSE> &call, uint64_t deadline,
+    START start_call) {
+    set_deadline(call.client_context, deadline);
+    call.reader = start_call(&call.client_context);
+    call.reader->Finish(&call.response, &call.status, actx.self);
+}
+
+/// \brief Waits until all machine server calls started by the coroutine complete
+/// \param actx Context for async operations
+/// \param count Number of calls in flight
+static void wait_machine_calls(async_context &actx, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
         actx.yield(side_effect::none);
-        (void) replace_request.release_config();
-        if (!replace_status.ok()) {
-            THROW((taint_session{actx.session, std::move(replace_status)}));
-        }
     }
 }
 
-/// \brief Asynchronously clears the rx buffer
+/// \brief Taints the session if a completed machine server call failed
 /// \param actx Context for async operations
-static void clear_rx_buffer(async_context &actx) {
-    ReplaceMemoryRangeRequest replace_request;
-    replace_request.set_allocated_config(&actx.session.memory_range.rx_buffer.config);
-    Void replace_response;
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader =
-        actx.session.server_stub->AsyncReplaceMemoryRange(&client_context, replace_request, actx.completion_queue);
-    grpc::Status replace_status;
-    reader->Finish(&replace_response, &replace_status, actx.self);
-    actx.yield(side_effect::none);
-    (void) replace_request.release_config();
-    if (!replace_status.ok()) {
-        THROW((taint_session{actx.session, std::move(replace_status)}));
+/// \param call Completed call
+template <typename RESPONSE>
+static void check_machine_call(async_context &actx, machine_call_type<RESPONSE> &call) {
+    if (!call.status.ok()) {
+        THROW((taint_session{actx.session, std::move(call.status)}));
     }
 }
 
-/// \brief Asynchronously writes data to a memory range
-/// \param actx Context for async operations
+/// \brief Fills a write request with data for a memory range
+/// \param write_request Request to fill
 /// \param begin First byte to write
 /// \param end One past last byte to write
 /// \param drive MemoryRangeConfig describing drive
 template <typename IT>
-static void write_memory_range(async_context &actx, IT begin, IT end, const MemoryRangeConfig &drive) {
-    WriteMemoryRequest write_request;
+static void set_write_memory_range_request(WriteMemoryRequest &write_request, IT begin, IT end,
+    const MemoryRangeConfig &drive) {
     write_request.set_address(drive.start());
     auto *data = write_request.mutable_data();
     data->insert(data->end(), begin, end);
-    Void write_response;
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncWriteMemory(&client_context, write_request, actx.completion_queue);
-    grpc::Status write_status;
-    reader->Finish(&write_response, &write_status, actx.self);
-    actx.yield(side_effect::none);
-    if (!write_status.ok()) {
-        THROW((taint_session{actx.session, std::move(write_status)}));
-    }
 }
 
-/// \brief Asynchronously writes an EVM ABI string to a memory range
-/// \param actx Context for async operations
-/// \param begin First byte to write
-/// \param end One past last byte to write
+/// \brief Lends an encoded payload to a write request for a memory range, without copying it
+/// \param write_request Request to fill
+/// \param encoded_payload Payload encoded as an EVM ABI string, swapped with the request data
 /// \param drive MemoryRangeConfig describing drive
-template <typename IT>
-static void write_evm_abi_string(async_context &actx, IT begin, IT end, const MemoryRangeConfig &drive) {
-    using namespace boost::endian;
-    WriteMemoryRequest write_request;
+/// \details Call again with the same arguments to take the payload back once the write is done
+static void swap_write_evm_abi_string_request(WriteMemoryRequest &write_request, std::string &encoded_payload,
+    const MemoryRangeConfig &drive) {
     write_request.set_address(drive.start());
-    auto *data = write_request.mutable_data();
-    std::array<unsigned char, EVM_ABI_STRING_HEADER_LENGTH> header{};
-    header.fill(0);
-    auto *offset_ptr = header.data() + EVM_ABI_OFFSET_LENGTH - sizeof(uint64_t);
-    endian_store<uint64_t, sizeof(uint64_t), order::big>(offset_ptr, EVM_ABI_OFFSET_LENGTH);
-    auto *length_ptr = header.data() + EVM_ABI_OFFSET_LENGTH + EVM_ABI_LENGTH_LENGTH - sizeof(uint64_t);
-    endian_store<uint64_t, sizeof(uint64_t), order::big>(length_ptr, end - begin);
-    data->insert(data->end(), header.begin(), header.end());
-    data->insert(data->end(), begin, end);
-    Void write_response;
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncWriteMemory(&client_context, write_request, actx.completion_queue);
-    grpc::Status write_status;
-    reader->Finish(&write_response, &write_status, actx.self);
-    actx.yield(side_effect::none);
-    if (!write_status.ok()) {
-        THROW((taint_session{actx.session, std::move(write_status)}));
+    write_request.mutable_data()->swap(encoded_payload);
+}
+
+/// \brief Returns the mcycle increment for the next Run in adaptive mode
+/// \param increment Increment of the Run that just completed
+/// \param min_increment Configured increment, the smallest ever used
+/// \param cycles Number of cycles the machine ran in that Run
+/// \param us Microseconds that Run took
+/// \param deadline_increment Maximum time in ms allowed for each Run
+/// \param remaining_ms Time in ms left until the deadline for the entire run
+/// \details The increment doubles while the machine keeps running, but no further than the measured rate
+/// of cycles per millisecond allows within half the deadline of a Run, or within the time that is left.
+static uint64_t get_adaptive_mcycle_increment(uint64_t increment, uint64_t min_increment, uint64_t cycles,
+    uint64_t us, uint64_t deadline_increment, uint64_t remaining_ms) {
+    uint64_t next = increment > UINT64_MAX / 2 ? UINT64_MAX : 2 * increment;
+    if (us > 0) {
+        const double cycles_per_ms = 1000.0 * static_cast<double>(cycles) / static_cast<double>(us);
+        const double bound =
+            cycles_per_ms * std::min(static_cast<double>(deadline_increment) / 2.0, static_cast<double>(remaining_ms));
+        if (static_cast<double>(next) > bound) {
+            next = static_cast<uint64_t>(bound);
+        }
     }
+    return std::max(next, min_increment);
 }
 
 /// \brief Asynchronously runs machine server up to given max cycle
 /// \param actx Context for async operations
 /// \param curr_mcycle current mcycle
-/// \param mcycle_increment increment to mcycle in call to machine run
+/// \param mcycle_increment increment to mcycle in call to machine run, or the first one in adaptive mode
 /// \param max_mcycle mcycle limit
 /// \param start_time Time point given start of operation
 /// \param deadline_increment maximum time in ms allowed for mcycle increment
@@ -1948,10 +3184,16 @@ static std::optional<RunResponse> run_machine(async_context &actx, uint64_t curr
     // If the max_deadline expired, we return nothing but the server is responsive.
     // If the request for any single increment does not return by the deadline_increment deadline,
     // we assume the machine is not responsive and therefore we taint the session.
-    auto limit = std::min(curr_mcycle + mcycle_increment, max_mcycle);
+    // In adaptive mode, the increment grows while the machine keeps running, so long computations need fewer
+    // round trips. It stays small enough that the deadlines are still checked often enough.
+    auto_observe_phase observe(actx.session, phase_type::run);
+    auto increment = mcycle_increment;
+    auto limit = std::min(curr_mcycle + increment, max_mcycle);
     int i = 0;
     for (;;) {
-        LOG_CONTEXT(debug, actx.request_context) << "  Running advance/inspect state increment " << i++;
+        LOG_CONTEXT(debug, actx.request_context)
+            << "  Running advance/inspect state increment " << i++ << " up to mcycle " << limit;
+        auto increment_start_time = std::chrono::system_clock::now();
         RunRequest run_request;
         run_request.set_limit(limit);
         grpc::ClientContext client_context;
@@ -1964,6 +3206,8 @@ static std::optional<RunResponse> run_machine(async_context &actx, uint64_t curr
         if (!run_status.ok()) {
             THROW((taint_session{actx.session, std::move(run_status)}));
         }
+        ++actx.session.input_run_requests;
+        actx.session.input_mcycles += run_response.mcycle() - curr_mcycle;
         // Check if yielded or halted or reached max_mcycle and return
         if (run_response.iflags_y() || run_response.iflags_x() || run_response.iflags_h() ||
             run_response.mcycle() >= max_mcycle) {
@@ -1976,8 +3220,16 @@ static std::optional<RunResponse> run_machine(async_context &actx, uint64_t curr
         if (elapsed > static_cast<decltype(elapsed)>(max_deadline)) {
             return {};
         }
-        // Move on to next chunk
-        limit = std::min(limit + mcycle_increment, max_mcycle);
+        if (actx.session.adaptive_run_increment) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - increment_start_time)
+                          .count();
+            increment = get_adaptive_mcycle_increment(increment, mcycle_increment, run_response.mcycle() - curr_mcycle,
+                static_cast<uint64_t>(us), deadline_increment, max_deadline - static_cast<uint64_t>(elapsed));
+        }
+        curr_mcycle = run_response.mcycle();
+        // Move on to next chunk, without overflowing when the increment has grown large
+        limit += std::min(increment, max_mcycle - limit);
     }
 }
 
@@ -2083,51 +3335,16 @@ static inline uint64_t get_payload_length(session_type &session, const char *beg
         reinterpret_cast<const unsigned char *>(end) - sizeof(uint64_t));
 }
 
-/// \brief Asynchronously reads an voucher address and payload data length from the tx buffer
+/// \brief Asynchronously reads a chunk of the tx buffer
 /// \param actx Context for async operations
-/// \param payload_data_length Receives payload data length
-/// \return Address for voucher
-static evm_address_type read_voucher_address_and_payload_data_length(async_context &actx,
-    uint64_t *payload_data_length) {
+/// \param offset Offset of chunk within tx buffer
+/// \param length Length of chunk
+/// \return String with chunk contents
+static std::string read_tx_buffer(async_context &actx, uint64_t offset, uint64_t length) {
     ReadMemoryRequest read_request;
     const MemoryRangeConfig &range = actx.session.memory_range.tx_buffer.config;
-    read_request.set_address(range.start());
-    read_request.set_length(VOUCHER_HEADER_LENGTH);
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncReadMemory(&client_context, read_request, actx.completion_queue);
-    grpc::Status read_status;
-    ReadMemoryResponse read_response;
-    reader->Finish(&read_response, &read_status, actx.self);
-    actx.yield(side_effect::none);
-    if (!read_status.ok()) {
-        THROW((taint_session{actx.session, std::move(read_status)}));
-    }
-    if (read_response.data().size() != read_request.length()) {
-        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "read returned wrong number of bytes!"}));
-    }
-    const auto *payload_data_length_begin =
-        read_response.data().data() + EVM_ABI_ADDRESS_LENGTH + EVM_ABI_OFFSET_LENGTH;
-    const auto *payload_data_length_end = payload_data_length_begin + EVM_ABI_LENGTH_LENGTH;
-    *payload_data_length = get_payload_length(actx.session, payload_data_length_begin, payload_data_length_end);
-    auto address_begin = read_response.data().begin() + EVM_ABI_ADDRESS_LENGTH - EVM_ADDRESS_LENGTH;
-    auto address_end = address_begin + EVM_ADDRESS_LENGTH;
-    return get_evm_address(actx.session, address_begin, address_end);
-}
-
-/// \brief Asynchronously reads an voucher payload data from the tx buffer
-/// \param actx Context for async operations
-/// \param payload_data_length Length of payload data in entry
-/// \return Contents of voucher payload data
-static std::string read_voucher_payload_data(async_context &actx, uint64_t payload_data_length) {
-    auto payload_data_offset = VOUCHER_HEADER_LENGTH;
-    const MemoryRangeConfig &range = actx.session.memory_range.tx_buffer.config;
-    if (payload_data_length > actx.session.memory_range.tx_buffer.length - payload_data_offset) {
-        THROW((taint_session{actx.session, grpc::StatusCode::OUT_OF_RANGE, "voucher payload length is out of bounds"}));
-    }
-    ReadMemoryRequest read_request;
-    read_request.set_address(range.start() + payload_data_offset);
-    read_request.set_length(payload_data_length);
+    read_request.set_address(range.start() + offset);
+    read_request.set_length(length);
     grpc::ClientContext client_context;
     set_deadline(client_context, actx.session.server_deadline.fast);
     auto reader = actx.session.server_stub->AsyncReadMemory(&client_context, read_request, actx.completion_queue);
@@ -2138,7 +3355,7 @@ static std::string read_voucher_payload_data(async_context &actx, uint64_t paylo
     if (!read_status.ok()) {
         THROW((taint_session{actx.session, std::move(read_status)}));
     }
-    if (read_response.data().size() != payload_data_length) {
+    if (read_response.data().size() != length) {
         THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "read returned wrong number of bytes!"}));
     }
     // Here we can't use copy elision because read_response holds the string we want to move out
@@ -2146,61 +3363,53 @@ static std::string read_voucher_payload_data(async_context &actx, uint64_t paylo
     return data ? std::move(*data) : std::string{};
 }
 
-/// \brief Asynchronously reads a notice or report data length from the tx buffer
+/// \brief Asynchronously reads the header of the entry in the tx buffer, followed by a prefix of its payload data
 /// \param actx Context for async operations
-/// \return Payload data length for notice or report
-static uint64_t read_tx_payload_data_length(async_context &actx) {
-    ReadMemoryRequest read_request;
-    const MemoryRangeConfig &range = actx.session.memory_range.tx_buffer.config;
-    read_request.set_address(range.start());
-    read_request.set_length(EVM_ABI_STRING_HEADER_LENGTH);
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncReadMemory(&client_context, read_request, actx.completion_queue);
-    grpc::Status read_status;
-    ReadMemoryResponse read_response;
-    reader->Finish(&read_response, &read_status, actx.self);
-    actx.yield(side_effect::none);
-    if (!read_status.ok()) {
-        THROW((taint_session{actx.session, std::move(read_status)}));
-    }
-    if (read_response.data().size() != read_request.length()) {
-        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "read returned wrong number of bytes!"}));
-    }
-    const auto *payload_data_length_begin = read_response.data().data() + EVM_ABI_OFFSET_LENGTH;
-    const auto *payload_data_length_end = payload_data_length_begin + EVM_ABI_LENGTH_LENGTH;
-    return get_payload_length(actx.session, payload_data_length_begin, payload_data_length_end);
+/// \param header_length Length of entry header
+/// \return String with header followed by payload data prefix
+/// \details The payload data length is only known after the header is read. Reading a prefix of the payload data
+/// together with the header saves a round trip to the machine server for every entry whose payload data fits in it.
+static std::string read_tx_header_and_payload_data_prefix(async_context &actx, uint64_t header_length) {
+    auto prefix_length =
+        std::min(actx.session.tx_read_prefix_length, actx.session.memory_range.tx_buffer.length - header_length);
+    return read_tx_buffer(actx, 0, header_length + prefix_length);
 }
 
-/// \brief Asynchronously reads a notice or report payload data from the tx buffer
+/// \brief Asynchronously reads the payload data of the entry in the tx buffer
 /// \param actx Context for async operations
+/// \param entry Header followed by payload data prefix, as returned by read_tx_header_and_payload_data_prefix
+/// \param header_length Length of entry header
 /// \param payload_data_length Length of payload data in entry
-/// \return Contents of notice payload data
-static std::string read_tx_payload_data(async_context &actx, uint64_t payload_data_length) {
-    auto payload_data_offset = EVM_ABI_STRING_HEADER_LENGTH;
-    const MemoryRangeConfig &range = actx.session.memory_range.tx_buffer.config;
-    if (payload_data_length > actx.session.memory_range.tx_buffer.length - payload_data_offset) {
-        THROW((taint_session{actx.session, grpc::StatusCode::OUT_OF_RANGE, "notice payload length is out of bounds"}));
-    }
-    ReadMemoryRequest read_request;
-    read_request.set_address(range.start() + payload_data_offset);
-    read_request.set_length(payload_data_length);
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncReadMemory(&client_context, read_request, actx.completion_queue);
-    grpc::Status read_status;
-    ReadMemoryResponse read_response;
-    reader->Finish(&read_response, &read_status, actx.self);
-    actx.yield(side_effect::none);
-    if (!read_status.ok()) {
-        THROW((taint_session{actx.session, std::move(read_status)}));
+/// \param what Kind of entry, used in error messages
+/// \return Contents of payload data
+/// \details Only the part of the payload data that is missing from the prefix is read from the machine server
+static std::string read_tx_payload_data(async_context &actx, std::string entry, uint64_t header_length,
+    uint64_t payload_data_length, const char *what) {
+    if (payload_data_length > actx.session.memory_range.tx_buffer.length - header_length) {
+        THROW((taint_session{actx.session, grpc::StatusCode::OUT_OF_RANGE,
+            std::string(what) + " payload length is out of bounds"}));
     }
-    if (read_response.data().size() != payload_data_length) {
-        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "read returned wrong number of bytes!"}));
+    entry.erase(0, header_length);
+    if (payload_data_length <= entry.size()) {
+        entry.resize(payload_data_length);
+        return entry;
     }
-    // Here we can't use copy elision because read_response holds the string we want to move out
-    auto *data = read_response.release_data();
-    return data ? std::move(*data) : std::string{};
+    auto prefix_length = entry.size();
+    LOG_CONTEXT(debug, actx.request_context)
+        << "      Reading remaining " << payload_data_length - prefix_length << " bytes of " << what << " payload";
+    entry += read_tx_buffer(actx, header_length + prefix_length, payload_data_length - prefix_length);
+    return entry;
+}
+
+/// \brief Gets the payload data length from the header of an EVM ABI string in the tx buffer
+/// \param session Session to taint in case of error
+/// \param entry Entry read from tx buffer
+/// \param header_length Length of header that precedes the EVM ABI string
+/// \return Payload data length
+static uint64_t get_tx_payload_data_length(session_type &session, const std::string &entry, uint64_t header_length) {
+    const auto *payload_data_length_end = entry.data() + header_length;
+    const auto *payload_data_length_begin = payload_data_length_end - EVM_ABI_LENGTH_LENGTH;
+    return get_payload_length(session, payload_data_length_begin, payload_data_length_end);
 }
 
 /// \brief Gets a Merkle tree proof from the machine server
@@ -2209,6 +3418,7 @@ static std::string read_tx_payload_data(async_context &actx, uint64_t payload_da
 /// \param log2_size Log<sub>2</sub> of target node
 /// \return Proof that target node belongs to Merkle tree
 static proof_type get_proof(async_context &actx, uint64_t address, uint64_t log2_size) {
+    auto_observe_phase observe(actx.session, phase_type::get_proof);
     GetProofRequest proof_request;
     proof_request.set_address(address);
     proof_request.set_log2_size(log2_size);
@@ -2225,53 +3435,109 @@ static proof_type get_proof(async_context &actx, uint64_t address, uint64_t log2
     return cartesi::get_proto_merkle_tree_proof(proof_response.proof());
 }
 
+/// \brief Builds the Merkle tree of a hashes memory range from its contents
+/// \param actx Context for async operations
+/// \param range Description of hashes memory range
+/// \param hashes Contents of hashes memory range
+/// \param hashes_in_machine Proof of hashes memory range in machine
+/// \return Merkle tree of hashes memory range
+/// \details The leaves of the machine Merkle tree are the hashes of individual words, so the tree built here has
+/// the same root hash the machine server reported for the memory range. Words past the last non-null word are
+/// pristine and are not hashed. The tree is checked against the machine server before it is used for proofs.
+static cartesi::complete_merkle_tree get_hashes_memory_range_tree(async_context &actx,
+    const memory_range_description_type &range, const std::string &hashes, const proof_type &hashes_in_machine) {
+    if (hashes.size() != range.length || range.length % WORD_SIZE != 0) {
+        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "invalid hashes memory range length"}));
+    }
+    auto word_count = hashes.size() / WORD_SIZE;
+    while (word_count > 0 && is_null(&hashes[(word_count - 1) * WORD_SIZE], &hashes[0] + word_count * WORD_SIZE)) {
+        --word_count;
+    }
+    cartesi::complete_merkle_tree::level_type leaves(word_count);
+    hasher_type h;
+    for (uint64_t word_index = 0; word_index < word_count; ++word_index) {
+        h.begin();
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        h.add_data(reinterpret_cast<const unsigned char *>(&hashes[word_index * WORD_SIZE]), WORD_SIZE);
+        h.end(leaves[word_index]);
+    }
+    cartesi::complete_merkle_tree tree{static_cast<int>(range.log2_size), LOG2_WORD_SIZE, LOG2_WORD_SIZE,
+        std::move(leaves)};
+    if (tree.get_root_hash() != hashes_in_machine.get_target_hash()) {
+        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
+            "hashes memory range contents disagree with its hash in machine"}));
+    }
+    return tree;
+}
+
+/// \brief Gets proof of a keccak entry in a hashes memory range
+/// \param tree Merkle tree of hashes memory range
+/// \param range Description of hashes memory range
+/// \param entry_index Index of keccak entry
+/// \return Proof that keccak entry belongs to hashes memory range
+static proof_type get_keccak_in_hashes_proof(const cartesi::complete_merkle_tree &tree,
+    const memory_range_description_type &range, uint64_t entry_index) {
+    auto proof = tree.get_proof(entry_index * KECCAK_SIZE, LOG2_KECCAK_SIZE);
+    // Proofs from the machine server use target addresses in the machine address space
+    proof.set_target_address(range.start + entry_index * KECCAK_SIZE);
+    return proof;
+}
+
 /// \brief Asynchronously reads an voucher from the tx buffer
 /// \param actx Context for async operations
 /// \return Voucher
 static voucher_type read_voucher(async_context &actx) {
-    uint64_t payload_data_length = 0;
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading voucher address and length";
-    auto address = read_voucher_address_and_payload_data_length(actx, &payload_data_length);
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading voucher payload of length " << payload_data_length;
-    auto payload_data = read_voucher_payload_data(actx, payload_data_length);
+    auto_observe_phase observe(actx.session, phase_type::read_output);
+    LOG_CONTEXT(debug, actx.request_context) << "      Reading voucher address, length, and payload prefix";
+    auto entry = read_tx_header_and_payload_data_prefix(actx, VOUCHER_HEADER_LENGTH);
+    auto payload_data_length = get_tx_payload_data_length(actx.session, entry, VOUCHER_HEADER_LENGTH);
+    auto address_begin = entry.begin() + EVM_ABI_ADDRESS_LENGTH - EVM_ADDRESS_LENGTH;
+    auto address_end = address_begin + EVM_ADDRESS_LENGTH;
+    auto address = get_evm_address(actx.session, address_begin, address_end);
+    LOG_CONTEXT(debug, actx.request_context) << "      Voucher payload length is " << payload_data_length;
+    auto payload_data =
+        read_tx_payload_data(actx, std::move(entry), VOUCHER_HEADER_LENGTH, payload_data_length, "voucher");
     return {std::move(address), std::move(payload_data), {}};
 }
 
+/// \brief Asynchronously reads a notice, report, or exception payload from the tx buffer
+/// \param actx Context for async operations
+/// \param what Kind of entry, used in log and error messages
+/// \return Contents of payload data
+static std::string read_tx_evm_abi_string(async_context &actx, const char *what) {
+    auto_observe_phase observe(actx.session, phase_type::read_output);
+    LOG_CONTEXT(debug, actx.request_context) << "      Reading " << what << " length and payload prefix";
+    auto entry = read_tx_header_and_payload_data_prefix(actx, EVM_ABI_STRING_HEADER_LENGTH);
+    auto payload_data_length = get_tx_payload_data_length(actx.session, entry, EVM_ABI_STRING_HEADER_LENGTH);
+    LOG_CONTEXT(debug, actx.request_context) << "      " << what << " payload length is " << payload_data_length;
+    return read_tx_payload_data(actx, std::move(entry), EVM_ABI_STRING_HEADER_LENGTH, payload_data_length, what);
+}
+
 /// \brief Asynchronously reads a notice from the tx buffer
 /// \param actx Context for async operations
 /// \return Notice
 static notice_type read_notice(async_context &actx) {
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading notice length";
-    auto payload_data_length = read_tx_payload_data_length(actx);
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading notice payload of length " << payload_data_length;
-    auto payload_data = read_tx_payload_data(actx, payload_data_length);
-    return {std::move(payload_data), {}};
+    return {read_tx_evm_abi_string(actx, "notice"), {}};
 }
 
 /// \brief Asynchronously reads a report from the tx buffer
 /// \param actx Context for async operations
 /// \return Report
 static report_type read_report(async_context &actx) {
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading report length";
-    auto payload_data_length = read_tx_payload_data_length(actx);
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading report payload of length " << payload_data_length;
-    auto payload_data = read_tx_payload_data(actx, payload_data_length);
-    return {std::move(payload_data)};
+    return {read_tx_evm_abi_string(actx, "report")};
 }
 
 /// \brief Asynchronously reads an exception from the tx buffer
 /// \param actx Context for async operations
 /// \return Exception
 static std::string read_exception(async_context &actx) {
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading exception length";
-    auto payload_data_length = read_tx_payload_data_length(actx);
-    LOG_CONTEXT(debug, actx.request_context) << "      Reading exception payload of length " << payload_data_length;
-    return read_tx_payload_data(actx, payload_data_length);
+    return read_tx_evm_abi_string(actx, "exception");
 }
 
 /// \brief Asynchronously creates a new machine server snapshot. Used before processing an input.
 /// \param actx Context for async operations
 static void snapshot(async_context &actx) {
+    auto_observe_phase observe(actx.session, phase_type::snapshot);
     Void request;
     grpc::ClientContext client_context;
     set_deadline(client_context, actx.session.server_deadline.fast);
@@ -2288,6 +3554,7 @@ static void snapshot(async_context &actx) {
 /// \brief Asynchronously rollback machine server. Used after an input was skipped.
 /// \param actx Context for async operations
 static void rollback(async_context &actx) {
+    auto_observe_phase observe(actx.session, phase_type::rollback);
     Void request;
     grpc::ClientContext client_context;
     set_deadline(client_context, actx.session.server_deadline.fast);
@@ -2301,114 +3568,267 @@ static void rollback(async_context &actx) {
     }
 }
 
-/// \brief Asynchronously resets the iflags.y flag after a machine has yielded
+/// \brief Checks htif fromhost ack
 /// \param actx Context for async operations
-static void reset_iflags_y(async_context &actx) {
-    Void request;
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncResetIflagsY(&client_context, request, actx.completion_queue);
-    grpc::Status status;
-    Void response;
-    reader->Finish(&response, &status, actx.self);
-    actx.yield(side_effect::none);
-    if (!status.ok()) {
-        THROW((taint_session{actx.session, std::move(status)}));
+/// \param value Value of htif fromhost
+/// \param reqid Expected request in the data field
+static void check_htif_yield_ack_data(async_context &actx, uint64_t value, uint64_t reqid) {
+    check_htif_yield_manual(actx, "htif.fromhost", value);
+    auto data = htif_data_field(value);
+    if (data != reqid) {
+        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
+            "invalid data field in htif.fromhost (expected " + std::to_string(reqid) + ", got " + std::to_string(data) +
+                ")"}));
     }
 }
 
-/// \brief Asynchronously gets the value of HTIF's fromhost CSR
+/// \brief Asynchronously clears memory ranges, resets the iflags.y flag, and reads HTIF's fromhost CSR
 /// \param actx Context for async operations
-/// \return Register value
-static uint64_t get_htif_fromhost(async_context &actx) {
-    ReadCsrRequest request;
-    request.set_csr(Csr::HTIF_FROMHOST);
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncReadCsr(&client_context, request, actx.completion_queue);
-    grpc::Status status;
-    ReadCsrResponse response;
-    reader->Finish(&response, &status, actx.self);
-    actx.yield(side_effect::none);
-    if (!status.ok()) {
-        THROW((taint_session{actx.session, std::move(status)}));
+/// \param range_configs Memory ranges to clear
+/// \return Value of htif fromhost
+/// \details These requests do not depend on each other, so they are all in flight at the same time
+template <size_t N>
+static uint64_t clear_memory_ranges_and_reset_iflags_y(async_context &actx,
+    const std::array<MemoryRangeConfig *, N> &range_configs) {
+    auto_observe_phase observe(actx.session, phase_type::clear);
+    auto *cq = actx.completion_queue;
+    auto &stub = actx.session.server_stub;
+    auto deadline = actx.session.server_deadline.fast;
+    std::array<ReplaceMemoryRangeRequest, N> replace_requests{};
+    std::array<machine_call_type<Void>, N> replace_calls{};
+    for (size_t k = 0; k < N; ++k) {
+        replace_requests[k].set_allocated_config(range_configs[k]);
+        start_machine_call(actx, replace_calls[k], deadline, [&](grpc::ClientContext *client_context) {
+            return stub->AsyncReplaceMemoryRange(client_context, replace_requests[k], cq);
+        });
     }
-    return response.value();
+    Void reset_request;
+    machine_call_type<Void> reset_call;
+    start_machine_call(actx, reset_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncResetIflagsY(client_context, reset_request, cq);
+    });
+    ReadCsrRequest fromhost_request;
+    fromhost_request.set_csr(Csr::HTIF_FROMHOST);
+    machine_call_type<ReadCsrResponse> fromhost_call;
+    start_machine_call(actx, fromhost_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncReadCsr(client_context, fromhost_request, cq);
+    });
+    wait_machine_calls(actx, N + 2);
+    for (auto &replace_request : replace_requests) {
+        (void) replace_request.release_config();
+    }
+    for (auto &replace_call : replace_calls) {
+        check_machine_call(actx, replace_call);
+    }
+    check_machine_call(actx, reset_call);
+    check_machine_call(actx, fromhost_call);
+    return fromhost_call.response.value();
 }
 
-/// \brief Asynchronously sets the value of HTIF's fromhost CSR
+/// \brief Asynchronously prepares the machine server for processing an input
 /// \param actx Context for async operations
-/// \param value New register value
-static void set_htif_fromhost(async_context &actx, uint64_t value) {
-    WriteCsrRequest request;
-    request.set_csr(Csr::HTIF_FROMHOST);
-    request.set_value(value);
-    grpc::ClientContext client_context;
-    set_deadline(client_context, actx.session.server_deadline.fast);
-    auto reader = actx.session.server_stub->AsyncWriteCsr(&client_context, request, actx.completion_queue);
-    grpc::Status status;
-    Void response;
-    reader->Finish(&response, &status, actx.self);
-    actx.yield(side_effect::none);
-    if (!status.ok()) {
-        THROW((taint_session{actx.session, std::move(status)}));
-    }
+/// \param i Input to be processed
+/// \details The rx buffer, input metadata, voucher hashes, and notice hashes memory ranges are cleared together
+/// with the reset of iflags.y and the read of htif fromhost. Once these complete, the rx buffer and input metadata
+/// are written together. Each group costs a single round trip to the machine server.
+static void prepare_input(async_context &actx, input_type &i) {
+    auto &memory_range = actx.session.memory_range;
+    LOG_CONTEXT(debug, actx.request_context) << "    Clearing buffers and resetting iflags_Y";
+    auto fromhost = clear_memory_ranges_and_reset_iflags_y<4>(actx,
+        {&memory_range.rx_buffer.config, &memory_range.input_metadata.config, &memory_range.voucher_hashes.config,
+            &memory_range.notice_hashes.config});
+    check_htif_yield_ack_data(actx, fromhost, ROLLUP_ADVANCE_STATE);
+    LOG_CONTEXT(debug, actx.request_context) << "    Writing rx buffer and input metadata";
+    auto_observe_phase observe(actx.session, phase_type::write);
+    auto *cq = actx.completion_queue;
+    auto &stub = actx.session.server_stub;
+    auto deadline = actx.session.server_deadline.fast;
+    WriteMemoryRequest rx_request;
+    swap_write_evm_abi_string_request(rx_request, i.encoded_payload, memory_range.rx_buffer.config);
+    machine_call_type<Void> rx_call;
+    start_machine_call(actx, rx_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncWriteMemory(client_context, rx_request, cq);
+    });
+    WriteMemoryRequest metadata_request;
+    auto metadata = evm_abi_encoded_input_metadata(i.metadata);
+    set_write_memory_range_request(metadata_request, metadata.begin(), metadata.end(),
+        memory_range.input_metadata.config);
+    machine_call_type<Void> metadata_call;
+    start_machine_call(actx, metadata_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncWriteMemory(client_context, metadata_request, cq);
+    });
+    wait_machine_calls(actx, 2);
+    // Keep the payload for replays after a rollback
+    swap_write_evm_abi_string_request(rx_request, i.encoded_payload, memory_range.rx_buffer.config);
+    check_machine_call(actx, rx_call);
+    check_machine_call(actx, metadata_call);
 }
 
-/// \brief Asynchronously sets htif fromhost ack to specify a given request
+/// \brief Asynchronously prepares the machine server for processing a query
 /// \param actx Context for async operations
-static void set_htif_yield_ack_data(async_context &actx, uint64_t reqid) {
-    auto old_value = get_htif_fromhost(actx);
-    check_htif_yield_manual(actx, "htif.fromhost", old_value);
-    set_htif_fromhost(actx, htif_replace_data_field(old_value, reqid));
+/// \param q Query to be processed
+/// \details The rx buffer is cleared together with the reset of iflags.y and the read of htif fromhost.
+/// Once these complete, the rx buffer and the inspect request in htif fromhost are written together.
+static void prepare_query(async_context &actx, query_type &q) {
+    auto &memory_range = actx.session.memory_range;
+    LOG_CONTEXT(debug, actx.request_context) << "    Clearing rx buffer and resetting iflags_Y";
+    auto fromhost = clear_memory_ranges_and_reset_iflags_y<1>(actx, {&memory_range.rx_buffer.config});
+    check_htif_yield_manual(actx, "htif.fromhost", fromhost);
+    LOG_CONTEXT(debug, actx.request_context) << "    Writing rx buffer and inspect request in htif fromhost";
+    auto_observe_phase observe(actx.session, phase_type::write);
+    auto *cq = actx.completion_queue;
+    auto &stub = actx.session.server_stub;
+    auto deadline = actx.session.server_deadline.fast;
+    WriteMemoryRequest rx_request;
+    swap_write_evm_abi_string_request(rx_request, q.encoded_payload, memory_range.rx_buffer.config);
+    machine_call_type<Void> rx_call;
+    start_machine_call(actx, rx_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncWriteMemory(client_context, rx_request, cq);
+    });
+    WriteCsrRequest fromhost_request;
+    fromhost_request.set_csr(Csr::HTIF_FROMHOST);
+    fromhost_request.set_value(htif_replace_data_field(fromhost, ROLLUP_INSPECT_STATE));
+    machine_call_type<Void> fromhost_call;
+    start_machine_call(actx, fromhost_call, deadline, [&](grpc::ClientContext *client_context) {
+        return stub->AsyncWriteCsr(client_context, fromhost_request, cq);
+    });
+    wait_machine_calls(actx, 2);
+    // Keep the payload so identical queries can still find this one
+    swap_write_evm_abi_string_request(rx_request, q.encoded_payload, memory_range.rx_buffer.config);
+    check_machine_call(actx, rx_call);
+    check_machine_call(actx, fromhost_call);
+}
+
+/// \brief Forgets about the snapshot in the machine server, if any
+/// \param session Session to modify
+static void invalidate_checkpoint(session_type &session) {
+    session.has_checkpoint = false;
+    session.accepted_since_checkpoint = 0;
+    session.replay_inputs.clear();
 }
 
-/// \brief Asynchronously check htif fromhost ack
+/// \brief Returns the key of a query in the inspect cache
 /// \param actx Context for async operations
-static void check_htif_yield_ack_data(async_context &actx, uint64_t reqid) {
-    auto value = get_htif_fromhost(actx);
-    check_htif_yield_manual(actx, "htif.fromhost", value);
-    auto data = htif_data_field(value);
-    if (data != reqid) {
-        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
-            "invalid data field in htif.fromhost (expected " + std::to_string(reqid) + ", got " + std::to_string(data) +
-                ")"}));
+/// \param machine_hash Hash of the machine state the query runs on
+/// \param q Query
+/// \details The cycle limit is part of the key because it can change the outcome of the same query
+static hash_type get_inspect_cache_key(async_context &actx, const hash_type &machine_hash, const query_type &q) {
+    using namespace boost::endian;
+    std::array<unsigned char, sizeof(uint64_t)> max_cycles{};
+    endian_store<uint64_t, sizeof(uint64_t), order::big>(max_cycles.data(),
+        actx.session.server_cycles.max_inspect_state);
+    hasher_type h;
+    hash_type key;
+    h.begin();
+    h.add_data(machine_hash.data(), machine_hash.size());
+    h.add_data(max_cycles.data(), max_cycles.size());
+    h.add_data(q.payload_hash.data(), q.payload_hash.size());
+    h.end(key);
+    return key;
+}
+
+/// \brief Hashes the payload of a query, to be used in its key in the inspect cache
+static void set_query_payload_hash(query_type &q) {
+    hasher_type h;
+    h.begin();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    h.add_data(reinterpret_cast<const unsigned char *>(q.encoded_payload.data()), q.encoded_payload.size());
+    h.end(q.payload_hash);
+}
+
+/// \brief Returns the number of bytes an outcome holds in the inspect cache
+static uint64_t get_inspect_result_size(const inspect_result_type &result) {
+    uint64_t size = sizeof(inspect_cache_type::entry_type) + KECCAK_SIZE;
+    if (result.exception_data.has_value()) {
+        size += result.exception_data.value().size();
     }
+    for (const auto &r : result.reports) {
+        size += sizeof(report_type) + r.payload.size();
+    }
+    return size;
+}
+
+/// \brief Copies the cached outcome of a query, if any
+/// \param cache Inspect cache
+/// \param key Key of query
+/// \param q Receives the outcome
+/// \returns True if the outcome was found
+static bool find_inspect_result(inspect_cache_type &cache, const hash_type &key, query_type &q) {
+    if (cache.max_size == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto found = cache.index.find(key);
+    if (found == cache.index.end()) {
+        return false;
+    }
+    cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+    const auto &result = found->second->second;
+    q.status = result.status;
+    q.exception_data = result.exception_data;
+    q.reports = result.reports;
+    q.cache_hit = true;
+    return true;
+}
+
+/// \brief Stores the outcome of a query, evicting the least recently used ones to make room
+/// \param cache Inspect cache
+/// \param key Key of query
+/// \param q Query holding the outcome
+static void insert_inspect_result(inspect_cache_type &cache, const hash_type &key, const query_type &q) {
+    if (cache.max_size == 0) {
+        return;
+    }
+    inspect_result_type result{q.status, q.exception_data, q.reports};
+    const auto size = get_inspect_result_size(result);
+    if (size > cache.max_size) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.index.find(key) != cache.index.end()) {
+        return;
+    }
+    while (cache.size + size > cache.max_size) {
+        auto &last = cache.entries.back();
+        cache.size -= get_inspect_result_size(last.second);
+        cache.index.erase(last.first);
+        cache.entries.pop_back();
+    }
+    cache.entries.emplace_front(key, std::move(result));
+    cache.index.emplace(key, cache.entries.begin());
+    cache.size += size;
 }
 
 /// \brief Processes a pending query
 /// \param actx Context for async operations
 /// \param e Associated epoch
-static void process_pending_query(handler_context &hctx, async_context &actx, epoch_type &e) {
-    if (!e.pending_query.has_value()) { // should never happen
-        return;
-    }
-    auto &q = e.pending_query.value();
+/// \param q Query to process, at the front of the pending queries in the active epoch
+static void process_pending_query(handler_context &hctx, async_context &actx, epoch_type &e, query_type &q) {
     q.processed_input_count = actx.session.processed_input_count;
     LOG_CONTEXT(debug, actx.request_context) << "  Processing pending query";
     LOG_CONTEXT(debug, actx.request_context) << "    Current input index: " << q.processed_input_count;
     // Check size of query payload
-    const auto query_payload_size = q.payload.size();
+    const auto query_payload_size = q.payload_length;
     if (query_payload_size + EVM_ABI_STRING_HEADER_LENGTH > actx.session.memory_range.rx_buffer.length) {
         q.status = completion_status::payload_length_limit_exceeded;
         LOG_CONTEXT(debug, actx.request_context) << "    Query rejected because payload was too long";
         LOG_CONTEXT(debug, actx.request_context) << "  Done processing query";
         return;
     }
+    // Queries answered since the last change to the machine state need not run again
+    const auto cache_key = get_inspect_cache_key(actx, e.most_recent_machine_hash, q);
+    if (find_inspect_result(hctx.inspect_cache, cache_key, q)) {
+        LOG_CONTEXT(debug, actx.request_context) << "    Found query result in cache";
+        LOG_CONTEXT(debug, actx.request_context) << "  Done processing query";
+        return;
+    }
     LOG_CONTEXT(debug, actx.request_context) << "    Creating Snapshot";
     // Wait machine server to checkin after spawned
     trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
         (void) hctx;
         snapshot(actx);
     });
-    LOG_CONTEXT(debug, actx.request_context) << "    Clearing rx buffer";
-    clear_rx_buffer(actx);
-    LOG_CONTEXT(debug, actx.request_context) << "    Writing rx buffer";
-    write_evm_abi_string(actx, q.payload.begin(), q.payload.end(), actx.session.memory_range.rx_buffer.config);
-    LOG_CONTEXT(debug, actx.request_context) << "    Resetting iflags_Y";
-    reset_iflags_y(actx);
-    LOG_CONTEXT(debug, actx.request_context) << "    Setting inspect request in htif fromhost";
-    set_htif_yield_ack_data(actx, ROLLUP_INSPECT_STATE);
+    prepare_query(actx, q);
     auto max_mcycle = actx.session.current_mcycle + actx.session.server_cycles.max_inspect_state;
     // Loop getting reports until the machine exceeds max_mcycle, rejects the query, accepts the query,
     // or behaves inaproppriately
@@ -2474,33 +3894,131 @@ static void process_pending_query(handler_context &hctx, async_context &actx, ep
         (void) hctx;
         rollback(actx);
     });
+    // The query snapshot replaced the one taken before inputs accepted since then
+    invalidate_checkpoint(actx.session);
+    // Only wall-clock time can change the outcome of the query other than the key
+    if (q.status != completion_status::time_limit_exceeded) {
+        insert_inspect_result(hctx.inspect_cache, cache_key, q);
+    }
+}
+
+/// \brief Checks if a snapshot must be taken before processing the next input
+/// \param session Session to check
+/// \returns True if there is no snapshot to roll back to, if too many accepted inputs would have to be replayed
+/// after a rollback, or if inputs are being skipped too often
+static bool needs_snapshot(const session_type &session) {
+    return !session.has_checkpoint || session.accepted_since_checkpoint >= session.snapshot_interval ||
+        session.rejection_rate * 100 > static_cast<double>(session.snapshot_rejection_threshold);
+}
+
+/// \brief Replays inputs accepted since the last snapshot, after rolling back to it
+/// \param actx Context for async operations
+/// \details The machine must reach the same mcycle it had before the rollback, accepting all inputs again.
+/// Outputs are ignored, since they were collected when inputs were first processed.
+static void replay_inputs(async_context &actx) {
+    auto current_mcycle = actx.session.checkpoint_mcycle;
+    auto mcycle_increment = actx.session.server_cycles.advance_state_increment;
+    auto deadline_increment = actx.session.server_deadline.advance_state_increment;
+    auto max_deadline = actx.session.server_deadline.advance_state;
+    for (auto &i : actx.session.replay_inputs) {
+        prepare_input(actx, i);
+        auto max_mcycle = current_mcycle + actx.session.server_cycles.max_advance_state;
+        auto start_time = std::chrono::system_clock::now();
+        for (;;) {
+            auto run_response = run_machine(actx, current_mcycle, mcycle_increment, max_mcycle, start_time,
+                deadline_increment, max_deadline);
+            if (!run_response.has_value() || run_response.value().mcycle() >= max_mcycle ||
+                run_response.value().iflags_h()) {
+                THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
+                    "replayed input was not accepted after rollback"}));
+            }
+            uint64_t yield_reason = run_response.value().tohost() << 16 >> 48;
+            current_mcycle = run_response.value().mcycle();
+            if (run_response.value().iflags_y()) {
+                if (yield_reason != HTIF_YIELD_REASON_RX_ACCEPTED) {
+                    THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
+                        "replayed input was not accepted after rollback"}));
+                }
+                break;
+            }
+            if (!run_response.value().iflags_x()) {
+                THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
+                    "machine returned without hitting mcycle limit or yielding"}));
+            }
+            // ignore automatic yields
+        }
+    }
+    if (current_mcycle != actx.session.current_mcycle) {
+        THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL, "mcycle is changed after replaying inputs"}));
+    }
+}
+
+/// \brief Gives the machine to the first pending query, unless it already has it
+/// \param cq Completion queue of the session shard
+/// \param e Associated epoch
+static void resume_pending_queries(grpc::ServerCompletionQueue *cq, epoch_type &e) {
+    if (!e.pending_queries.empty() && !e.pending_queries.front().running) {
+        auto &q = e.pending_queries.front();
+        q.running = true;
+        enqueue_completion_queue(cq, q.coroutine);
+    }
+}
+
+/// \brief Lets all queries pending at an input boundary use the machine, then resumes
+/// \param actx Context for async operations
+/// \param e Associated epoch
+/// \details Each InspectState handler hands the machine to the next one when it is done. The last one in the
+/// batch resumes us instead. Queries that arrive in the meantime wait for the next input boundary, so a steady
+/// stream of queries cannot starve the inputs.
+static void process_pending_queries(async_context &actx, epoch_type &e) {
+    if (e.pending_queries.empty()) {
+        return;
+    }
+    e.query_batch_waiter = actx.self;
+    e.query_batch_size = e.pending_queries.size();
+    resume_pending_queries(actx.completion_queue, e);
+    actx.yield(side_effect::none);
 }
 
 /// \brief Loops processing all pending inputs
 /// \param actx Context for async operations
 /// \param e Associated epoch
+/// \details The caller holds the processing lock of the session
 static void process_pending_inputs(handler_context &hctx, async_context &actx, epoch_type &e) {
-    // This is just for peace of mind: there is no way two concurrent calls can happen
+    // This is just for peace of mind: there is no way to get here without the lock
     // (See discussion where process_pending_inputs is called.)
-    if (actx.session.processing_lock) {
+    if (!actx.session.processing_lock) {
         THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
-            "concurrent input processing detected in session"}));
+            "input processing without processing lock detected in session"}));
     }
-    auto_lock processing_lock(actx.session.processing_lock, "process_pending_inputs processing lock");
+    // Queries may be using the machine since before the first input arrived
+    process_pending_queries(actx, e);
     while (!e.pending_inputs.empty()) {
+        actx.session.input_run_requests = 0;
+        actx.session.input_mcycles = 0;
         auto global_input_index = actx.session.processed_input_count;
         auto epoch_input_index = e.processed_inputs.size();
         LOG_CONTEXT(debug, actx.request_context) << "  Processing input " << global_input_index;
         LOG_CONTEXT(debug, actx.request_context) << "    Epoch input index " << epoch_input_index;
         // Check size of input payload
-        const auto &i = e.pending_inputs.front();
-        LOG_CONTEXT(debug, actx.request_context) << "    Creating Snapshot";
-        // Wait machine server to checkin after spawned
-        trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
-            (void) hctx;
-            snapshot(actx);
-        });
-        const auto input_payload_size = i.payload.size();
+        auto &i = e.pending_inputs.front();
+        const bool fresh_snapshot = needs_snapshot(actx.session);
+        if (fresh_snapshot) {
+            LOG_CONTEXT(debug, actx.request_context) << "    Creating Snapshot";
+            // Wait machine server to checkin after spawned
+            trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
+                (void) hctx;
+                snapshot(actx);
+            });
+            actx.session.has_checkpoint = true;
+            actx.session.checkpoint_mcycle = actx.session.current_mcycle;
+            actx.session.accepted_since_checkpoint = 0;
+            actx.session.replay_inputs.clear();
+        } else {
+            LOG_CONTEXT(debug, actx.request_context)
+                << "    Skipping Snapshot (" << actx.session.accepted_since_checkpoint << " inputs since last one)";
+        }
+        const auto input_payload_size = i.payload_length;
         completion_status skip_reason = completion_status::accepted;
         LOG_CONTEXT(debug, actx.request_context) << "    Input payload size " << input_payload_size;
         std::vector<voucher_type> vouchers;
@@ -2509,16 +4027,7 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
         auto current_mcycle = actx.session.current_mcycle;
         exception_data_type exception_data;
         if (input_payload_size + EVM_ABI_STRING_HEADER_LENGTH <= actx.session.memory_range.rx_buffer.length) {
-            LOG_CONTEXT(debug, actx.request_context) << "    Clearing buffers";
-            clear_memory_ranges(actx);
-            LOG_CONTEXT(debug, actx.request_context) << "    Writing rx buffer";
-            write_evm_abi_string(actx, i.payload.begin(), i.payload.end(), actx.session.memory_range.rx_buffer.config);
-            LOG_CONTEXT(debug, actx.request_context) << "    Writing input metadata";
-            auto metadata = evm_abi_encoded_input_metadata(i.metadata);
-            write_memory_range(actx, metadata.begin(), metadata.end(), actx.session.memory_range.input_metadata.config);
-            LOG_CONTEXT(debug, actx.request_context) << "    Resetting iflags_Y";
-            reset_iflags_y(actx);
-            check_htif_yield_ack_data(actx, ROLLUP_ADVANCE_STATE);
+            prepare_input(actx, i);
             auto max_mcycle = actx.session.current_mcycle + actx.session.server_cycles.max_advance_state;
             // Loop getting vouchers and notices until the machine exceeds
             // max_mcycle, rejects the input, accepts the input, or behaves inaproppriately
@@ -2584,11 +4093,11 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
                 // advance current mcycle and continue
                 current_mcycle = run_response.value().mcycle();
             }
-            if (e.vouchers_tree.size() != epoch_input_index) {
+            if (e.vouchers_tree.leaves.size() != epoch_input_index) {
                 THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
                     "inconsistent number of entries in epoch's session vouchers Merkle tree"}));
             }
-            if (e.notices_tree.size() != epoch_input_index) {
+            if (e.notices_tree.leaves.size() != epoch_input_index) {
                 THROW((taint_session{actx.session, grpc::StatusCode::INTERNAL,
                     "inconsistent number of entries in epoch's session notices Merkle tree"}));
             }
@@ -2603,9 +4112,8 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
             auto voucher_hashes_in_machine = get_proof(actx, actx.session.memory_range.voucher_hashes.start,
                 actx.session.memory_range.voucher_hashes.log2_size);
             // Get proof of voucher hashes memory range in epoch
-            e.vouchers_tree.push_back(voucher_hashes_in_machine.get_target_hash());
             auto voucher_hashes_in_epoch =
-                e.vouchers_tree.get_proof(epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+                push_back_epoch_output(e.vouchers_tree, voucher_hashes_in_machine.get_target_hash());
             // Read voucher hashes memory range and count the number of non-zero hashes
             LOG_CONTEXT(debug, actx.request_context) << "    Reading voucher hashes memory range";
             auto voucher_hashes = read_memory_range(actx, actx.session.memory_range.voucher_hashes.config);
@@ -2615,17 +4123,15 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
                 THROW((taint_session{actx.session, grpc::StatusCode::INVALID_ARGUMENT,
                     "number of vouchers yielded and non-zero voucher hashes disagree"}));
             }
-            // Get hash for each voucher
+            // Get hash for each voucher, with proofs built from the voucher hashes memory range contents
+            LOG_CONTEXT(debug, actx.request_context) << "    Building voucher hashes memory range Merkle tree";
+            auto voucher_hashes_tree = get_hashes_memory_range_tree(actx, actx.session.memory_range.voucher_hashes,
+                voucher_hashes, voucher_hashes_in_machine);
             for (uint64_t entry_index = 0; entry_index < voucher_count; ++entry_index) {
                 auto keccak = get_hash(actx.session, &voucher_hashes[entry_index * KECCAK_SIZE],
                     &voucher_hashes[(entry_index + 1) * KECCAK_SIZE]);
-                LOG_CONTEXT(debug, actx.request_context)
-                    << "      Getting proof of keccak " << entry_index << " in voucher hashes memory range";
-                auto keccak_in_voucher_hashes =
-                    get_proof(actx, actx.session.memory_range.voucher_hashes.start + entry_index * KECCAK_SIZE,
-                        LOG2_KECCAK_SIZE)
-                        .slice(hasher_type{}, static_cast<int>(actx.session.memory_range.voucher_hashes.log2_size),
-                            LOG2_KECCAK_SIZE);
+                auto keccak_in_voucher_hashes = get_keccak_in_hashes_proof(voucher_hashes_tree,
+                    actx.session.memory_range.voucher_hashes, entry_index);
                 vouchers[entry_index].hash = keccak_type{std::move(keccak), std::move(keccak_in_voucher_hashes)};
             }
             // Read proof of notice hashes memory range in machine
@@ -2633,9 +4139,8 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
             auto notice_hashes_in_machine = get_proof(actx, actx.session.memory_range.notice_hashes.start,
                 actx.session.memory_range.notice_hashes.log2_size);
             // Get proof of notice hashes memory range in epoch
-            e.notices_tree.push_back(notice_hashes_in_machine.get_target_hash());
             auto notice_hashes_in_epoch =
-                e.notices_tree.get_proof(epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+                push_back_epoch_output(e.notices_tree, notice_hashes_in_machine.get_target_hash());
             // Read notice hashes memory range count the number of non-zero hashes
             LOG_CONTEXT(debug, actx.request_context) << "    Reading notice hashes memory range";
             auto notice_hashes = read_memory_range(actx, actx.session.memory_range.notice_hashes.config);
@@ -2645,17 +4150,15 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
                 THROW((taint_session{actx.session, grpc::StatusCode::INVALID_ARGUMENT,
                     "number notices yielded and non-zero notice hashes disagree"}));
             }
-            // Get hash for each notice
+            // Get hash for each notice, with proofs built from the notice hashes memory range contents
+            LOG_CONTEXT(debug, actx.request_context) << "    Building notice hashes memory range Merkle tree";
+            auto notice_hashes_tree = get_hashes_memory_range_tree(actx, actx.session.memory_range.notice_hashes,
+                notice_hashes, notice_hashes_in_machine);
             for (uint64_t entry_index = 0; entry_index < notice_count; ++entry_index) {
                 auto keccak = get_hash(actx.session, &notice_hashes[entry_index * KECCAK_SIZE],
                     &notice_hashes[(entry_index + 1) * KECCAK_SIZE]);
-                LOG_CONTEXT(debug, actx.request_context)
-                    << "      Getting proof of keccak " << entry_index << " in notice hashes memory range";
-                auto keccak_in_notice_hashes =
-                    get_proof(actx, actx.session.memory_range.notice_hashes.start + entry_index * KECCAK_SIZE,
-                        LOG2_KECCAK_SIZE)
-                        .slice(hasher_type{}, static_cast<int>(actx.session.memory_range.notice_hashes.log2_size),
-                            LOG2_KECCAK_SIZE);
+                auto keccak_in_notice_hashes = get_keccak_in_hashes_proof(notice_hashes_tree,
+                    actx.session.memory_range.notice_hashes, entry_index);
                 notices[entry_index].hash = keccak_type{std::move(keccak), std::move(keccak_in_notice_hashes)};
             }
             // Update most recent machine hash in epoch
@@ -2676,23 +4179,28 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
             LOG_CONTEXT(debug, actx.request_context) << "  Done processing input " << global_input_index;
         } else {
             LOG_CONTEXT(debug, actx.request_context) << "  Skipped input " << global_input_index;
-            LOG_CONTEXT(debug, actx.request_context) << "    Rolling back";
-            // Wait machine server to checkin after spawned
-            trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
-                (void) hctx;
-                rollback(actx);
-            });
+            // The machine was left untouched if the payload was too long to even be written to it
+            if (fresh_snapshot || skip_reason != completion_status::payload_length_limit_exceeded) {
+                LOG_CONTEXT(debug, actx.request_context) << "    Rolling back";
+                // Wait machine server to checkin after spawned
+                trigger_and_wait_checkin(hctx, actx, [](handler_context &hctx, async_context &actx) {
+                    (void) hctx;
+                    rollback(actx);
+                });
+                if (!actx.session.replay_inputs.empty()) {
+                    LOG_CONTEXT(debug, actx.request_context)
+                        << "    Replaying " << actx.session.replay_inputs.size() << " inputs since last snapshot";
+                    replay_inputs(actx);
+                }
+                invalidate_checkpoint(actx.session);
+            }
             // Add null hashes to the epoch Merkle trees
             hash_type zero;
             std::fill_n(zero.begin(), zero.size(), 0);
             // Get proof of null hash in epoch's vouchers metadata memory range Merkle tree
-            e.vouchers_tree.push_back(zero);
-            auto voucher_hashes_in_epoch =
-                e.vouchers_tree.get_proof(epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            auto voucher_hashes_in_epoch = push_back_epoch_output(e.vouchers_tree, zero);
             // Get proof of null hash in epoch's notices metadata memory range Merkle tree
-            e.notices_tree.push_back(zero);
-            auto notice_hashes_in_epoch =
-                e.notices_tree.get_proof(epoch_input_index << LOG2_KECCAK_SIZE, LOG2_KECCAK_SIZE);
+            auto notice_hashes_in_epoch = push_back_epoch_output(e.notices_tree, zero);
             // Check the machine hash has not changed
             if (e.most_recent_machine_hash != get_root_hash(actx)) {
                 THROW((
@@ -2706,48 +4214,67 @@ static void process_pending_inputs(handler_context &hctx, async_context &actx, e
         }
         // Increment session's processed input count
         actx.session.processed_input_count++;
-        // Finally remove pending
-        e.pending_inputs.pop_front();
-        // Check if there is a pending query
-        if (e.pending_query.has_value()) {
-            // Resume its coroutine so it can process the query and complete the InspectState rpc
-            // To do so, we use an alarm to add the coroutine to the completion queue, then we yield
-            // Once the coroutine is done, it will use the same process to add us back to the completion queue
-            enqueue_completion_queue(hctx.completion_queue.get(), e.pending_query.value().coroutine);
-            e.pending_query.value().coroutine = actx.self;
-            actx.yield(side_effect::none);
+        notify_epoch_status_waiters(actx.session);
+        observe_input_metrics(actx.session);
+        // Update moving average of the rate of skipped inputs
+        const double skipped = skip_reason == completion_status::accepted ? 0.0 : 1.0;
+        actx.session.rejection_rate += SNAPSHOT_REJECTION_RATE_WEIGHT * (skipped - actx.session.rejection_rate);
+        // Serve the queries that arrived while we were processing the input. The input is still pending while
+        // we yield, so new AdvanceState rpcs will leave the remaining inputs to us.
+        process_pending_queries(actx, e);
+        // Finally remove pending, keeping accepted inputs we might have to replay after a rollback. With a snapshot
+        // before every input, the next one takes a new snapshot and there is never anything to replay.
+        if (skip_reason == completion_status::accepted && actx.session.has_checkpoint) {
+            ++actx.session.accepted_since_checkpoint;
+            if (actx.session.snapshot_interval > 1) {
+                actx.session.replay_inputs.push_back(std::move(e.pending_inputs.front()));
+            }
         }
+        e.pending_inputs.pop_front();
     }
+    // Queries that arrived during the last batch can now have the idle machine
+    resume_pending_queries(actx.completion_queue, e);
 }
 
 /// \brief Creates a new handler for the AdvanceState RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_AdvanceState_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_AdvanceState_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         AdvanceStateRequest advance_state_request;
         ServerAsyncResponseWriter<Void> advance_state_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Wait for a AdvanceState RPC
         hctx.manager_async_service.RequestAdvanceState(&request_context, &advance_state_request, &advance_state_writer,
             cq, cq, self);
         yield(side_effect::none);
         // We now received a AdvanceState
         // We will handle other AdvanceState rpcs if we yield, but not in the same session, due to the session lock
-        new_AdvanceState_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_AdvanceState_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received AdvanceState RPC with handle_context ok set to false";
             return;
         }
+        auto *running_shard = &shard;
         try {
             // Check if session id exists
-            auto &sessions = hctx.sessions; // NOLINT: Unknown. Maybe linter bug?
             const auto &id = advance_state_request.session_id();
             LOG_CONTEXT(info, request_context) << "Received AdvanceState for session " << id << " epoch "
                                                << advance_state_request.active_epoch_index();
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            running_shard = &session_shard;
+            // Clients may send inputs without waiting for replies, so they can arrive out of order. Hold an input
+            // that is ahead of its turn until the inputs before it are enqueued, so inputs are always enqueued,
+            // and processed, in index order. Inputs with inconsistent metadata are rejected right away below.
+            if (advance_state_request.input_metadata().input_index() == advance_state_request.current_input_index()) {
+                hold_advance_state_input(session_shard, id, advance_state_request.active_epoch_index(),
+                    advance_state_request.current_input_index(), self, yield);
+            }
+            auto &sessions = session_shard.sessions; // NOLINT: Unknown. Maybe linter bug?
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found!"}));
@@ -2823,37 +4350,46 @@ static handler_type::pull_type *new_AdvanceState_handler(handler_context &hctx)
                         ") is inconsistent with current input index (" + std::to_string(current_input_index) + ")"}));
             }
             // Enqueue input
-            e.pending_inputs.emplace_back(input_metadata, advance_state_request.input_payload());
-            // Tell caller RPC succeeded
-            Void advance_state_response;
-            advance_state_writer.Finish(advance_state_response, grpc::Status::OK, self);
-            yield(side_effect::none); // Here the session is still locked, so no concurrent calls are possible
-            // Release the lock so other RPCs can enqueue additional inputs to the same session/epoch or call inspect
-            // state
-            session_lock.release();
-            // Between unlocking the session and the check here, there is no
-            // yield, and so no other AdvanceState RPC can be in flight for
-            // the same session. This means that the handler entering the
-            // branch will be exactly the handler that enqueued the input that
-            // caused the pending_inputs queue to not be empty anymore. While
-            // working on this single input, the handler can yield (because
-            // it talks to the machine server asynchronously) and allow
-            // other AdvanceState RPCs to grow the pending_inputs queue further.
-            // However, those other RPCs will not enter the branch, because
+            e.pending_inputs.emplace_back(input_metadata, std::move(*advance_state_request.mutable_input_payload()));
+            observe_metric(session.metrics, &metrics_type::pending_inputs,
+                static_cast<double>(e.pending_inputs.size()));
+            // The handler that enqueued the input that caused the
+            // pending_inputs queue to not be empty anymore is the one that
+            // processes it. While working on this single input, the handler
+            // can yield (because it talks to the machine server
+            // asynchronously) and allow other AdvanceState RPCs to grow the
+            // pending_inputs queue further. However, those other RPCs will
+            // not become the processing handler, because
             // process_pending_inputs only removes an item from the queue when
             // it is completely done with it. Between removing the pending
             // input and checking if there are other pending inputs, the
             // handler does not yield. Therefore, it will process all
             // pending inputs that have been enqueue while it is working.
-            //??D Victor and Diego both think this logic is sound but is too complicated.
-            //??D Any better ideas?
-            if (e.pending_inputs.size() == 1) {
-                async_context actx{session, request_context, hctx.completion_queue.get(), self, yield};
-                // While inputs are processed, a query might have arrived. If everything works, its coroutine will be
-                // waiting to be resumed between inputs, so the query can be processed. However, if
-                // process_pending_inputs exits via an exception, that coroutine might never be called. It would
-                // eventually timeout. So we resume it in the exception handlers below.
-                //??D Looks Ugly to repeat the code in each handler, but I couldn't find a more elegant solution
+            const bool process_inputs = e.pending_inputs.size() == 1;
+            // The processing handler takes the processing lock before yielding below, so EndSession cannot erase
+            // the session, even if it gets tainted meanwhile, before we are done with it
+            std::optional<auto_lock> processing_lock;
+            if (process_inputs) {
+                processing_lock.emplace(session.processing_lock, "AdvanceState processing lock");
+            }
+            // Release the lock before replying, so clients streaming many inputs (e.g., when catching up after
+            // downtime) can send the next AdvanceState without waiting for the reply to the previous one. The
+            // input is already enqueued, and the decision above does not depend on what happens while we yield.
+            session_lock.release();
+            // Resume the handler holding the next input, if it arrived ahead of this one
+            notify_advance_state_waiters(session, current_input_index + 1);
+            // Tell caller RPC succeeded
+            Void advance_state_response;
+            advance_state_writer.Finish(advance_state_response, grpc::Status::OK, self);
+            yield(side_effect::none);
+            // A query may have tainted the session while we yielded, and then there is no machine to process inputs
+            if (process_inputs && !session.tainted) {
+                async_context actx{session, request_context, session_shard.completion_queue.get(), self, yield};
+                // While inputs are processed, queries might have arrived. If everything works, their coroutines
+                // will be waiting to be resumed between inputs, so the queries can be processed. However, if
+                // process_pending_inputs exits via an exception, those coroutines might never be called. They would
+                // eventually timeout. So we resume them in the exception handlers below. Since the session is
+                // tainted, each query fails immediately and hands over to the next.
                 process_pending_inputs(hctx, actx, e);
             }
         } catch (finish_error_yield_none &e) {
@@ -2866,35 +4402,22 @@ static handler_type::pull_type *new_AdvanceState_handler(handler_context &hctx)
             auto &session = x.session();
             session.tainted = true;
             session.taint_status = x.status();
-            auto &e = session.epochs[session.active_epoch_index];
-            // Check if there is a pending query
-            if (e.pending_query.has_value()) {
-                // Resume its coroutine so it can process the query and complete the InspectState rpc
-                // To do so, we use an alarm to add the coroutine to the completion queue, then we yield
-                // Once the coroutine is done, it will use the same process to add us back to the completion queue
-                enqueue_completion_queue(hctx.completion_queue.get(), e.pending_query.value().coroutine);
-                e.pending_query.value().coroutine = self;
-                yield(side_effect::none);
-            }
+            notify_epoch_status_waiters(session);
+            notify_advance_state_waiters(session);
+            resume_pending_queries(get_session_shard(hctx, session.id).completion_queue.get(),
+                session.epochs[session.active_epoch_index]);
             // No need to return rpc results because we already have if we reach here
         } catch (std::exception &x) {
             LOG_CONTEXT(error, request_context) << "Caught unexpected exception " << x.what();
-            const auto &id = advance_state_request.session_id();
-            if (hctx.sessions.find(id) != hctx.sessions.end()) {
-                auto &session = hctx.sessions[id];
-                session.tainted = true;
-                session.taint_status =
+            auto *session = find_session_on_error(hctx, *running_shard, advance_state_request.session_id());
+            if (session != nullptr) {
+                session->tainted = true;
+                session->taint_status =
                     grpc::Status{grpc::StatusCode::INTERNAL, std::string{"unexpected exception "} + x.what()};
-                auto &e = session.epochs[session.active_epoch_index];
-                // Check if there is a pending query
-                if (e.pending_query.has_value()) {
-                    // Resume its coroutine so it can process the query and complete the InspectState rpc
-                    // To do so, we use an alarm to add the coroutine to the completion queue, then we yield
-                    // Once the coroutine is done, it will use the same process to add us back to the completion queue
-                    enqueue_completion_queue(hctx.completion_queue.get(), e.pending_query.value().coroutine);
-                    e.pending_query.value().coroutine = self;
-                    yield(side_effect::none);
-                }
+                notify_epoch_status_waiters(*session);
+                notify_advance_state_waiters(*session);
+                resume_pending_queries(running_shard->completion_queue.get(),
+                    session->epochs[session->active_epoch_index]);
             }
             // No need to return rpc results because we already have if we reach here
         }
@@ -2902,72 +4425,144 @@ static handler_type::pull_type *new_AdvanceState_handler(handler_context &hctx)
     return self;
 }
 
-class auto_resume final {
+/// \brief Resumes the handlers attached to a query, passing on its outcome
+/// \param cq Completion queue of the session shard
+/// \param q Query
+/// \param response Response to the query
+/// \param status Status of the query
+static void resume_query_followers(grpc::ServerCompletionQueue *cq, query_type &q,
+    const InspectStateResponse &response, const grpc::Status &status) {
+    for (auto *f : q.followers) {
+        f->response = response;
+        f->status = status;
+        enqueue_completion_queue(cq, f->coroutine);
+    }
+    q.followers.clear();
+}
+
+/// \brief Removes a query from the pending queries once it is done with the machine, and hands the machine over
+/// \details The machine goes to the next query in the batch, or back to the input processor waiting for the batch.
+/// Without a batch, it goes to the next query, if any.
+class auto_dequeue_query final {
 public:
-    explicit auto_resume(grpc::ServerCompletionQueue *cq) : m_cq(cq), m_coroutine(nullptr) {}
-    void reset(handler_type::pull_type *coroutine = nullptr) {
-        m_coroutine = coroutine;
+    auto_dequeue_query(grpc::ServerCompletionQueue *cq, epoch_type &e, query_type &q) : m_cq(cq), m_e(e), m_q(&q) {}
+    void release() {
+        // Only the running query is at the front. If we never got to run, there is nothing to hand over
+        if (m_q != nullptr && m_q->running) {
+            // If we failed without passing our status on, the handlers attached to us fail anyway
+            resume_query_followers(m_cq, *m_q, InspectStateResponse{},
+                grpc::Status{grpc::StatusCode::ABORTED, "identical pending query failed"});
+            m_e.pending_queries.pop_front();
+            if (m_e.query_batch_waiter != nullptr && --m_e.query_batch_size == 0) {
+                enqueue_completion_queue(m_cq, m_e.query_batch_waiter);
+                m_e.query_batch_waiter = nullptr;
+            } else {
+                resume_pending_queries(m_cq, m_e);
+            }
+        }
+        m_q = nullptr;
     }
 
-    auto_resume(const auto_resume &other) = delete;
-    auto_resume(auto_resume &&other) = delete;
-    auto_resume &operator=(const auto_resume &other) = delete;
-    auto_resume &operator=(auto_resume &&other) = delete;
+    auto_dequeue_query(const auto_dequeue_query &other) = delete;
+    auto_dequeue_query(auto_dequeue_query &&other) = delete;
+    auto_dequeue_query &operator=(const auto_dequeue_query &other) = delete;
+    auto_dequeue_query &operator=(auto_dequeue_query &&other) = delete;
 
-    ~auto_resume() {
-        if (m_coroutine) {
-            enqueue_completion_queue(m_cq, m_coroutine);
-        }
+    ~auto_dequeue_query() {
+        release();
     }
 
 private:
     grpc::ServerCompletionQueue *m_cq;
-    handler_type::pull_type *m_coroutine;
+    epoch_type &m_e;
+    query_type *m_q;
 };
 
+/// \brief Fills out an InspectState response from a processed query
+/// \param session Session the query was processed in
+/// \param q Processed query
+/// \param response Response to fill out
+static void set_proto_inspect_state_response(const session_type &session, const query_type &q,
+    InspectStateResponse &response) {
+    response.set_session_id(session.id);
+    response.set_active_epoch_index(session.active_epoch_index);
+    response.set_processed_input_count(q.processed_input_count);
+    for (const auto &r : q.reports) {
+        response.add_reports()->set_payload(r.payload);
+    }
+    switch (q.status) {
+        case completion_status::accepted:
+            response.set_status(CompletionStatus::ACCEPTED);
+            break;
+        case completion_status::rejected:
+            response.set_status(CompletionStatus::REJECTED);
+            break;
+        case completion_status::exception:
+            response.set_status(CompletionStatus::EXCEPTION);
+            if (q.exception_data.has_value()) {
+                response.set_exception_data(q.exception_data.value());
+            }
+            break;
+        case completion_status::machine_halted:
+            response.set_status(CompletionStatus::MACHINE_HALTED);
+            break;
+        case completion_status::cycle_limit_exceeded:
+            response.set_status(CompletionStatus::CYCLE_LIMIT_EXCEEDED);
+            break;
+        case completion_status::time_limit_exceeded:
+            response.set_status(CompletionStatus::TIME_LIMIT_EXCEEDED);
+            break;
+        case completion_status::payload_length_limit_exceeded:
+            response.set_status(CompletionStatus::PAYLOAD_LENGTH_LIMIT_EXCEEDED);
+            break;
+    }
+}
+
 /// \brief Creates a new handler for the InspectState RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_InspectState_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_InspectState_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         ServerContext request_context;
         InspectStateRequest inspect_state_request;
         ServerAsyncResponseWriter<InspectStateResponse> inspect_state_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Wait for a InspectState RPC
         hctx.manager_async_service.RequestInspectState(&request_context, &inspect_state_request, &inspect_state_writer,
             cq, cq, self);
         yield(side_effect::none);
         // We now received a InspectState
-        // We will handle other InspectState rpcs if we yield, but not in the same session, due to the session lock
-        new_InspectState_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        // We will handle other InspectState rpcs if we yield, including in the same session
+        new_InspectState_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received InspectState RPC with handle_context ok set to false";
             return;
         }
+        auto *running_shard = &shard;
         try {
             // Check if session id exists
-            auto &sessions = hctx.sessions; // NOLINT: Unknown. Maybe linter bug?
             const auto &id = inspect_state_request.session_id();
             LOG_CONTEXT(info, request_context) << "Received InspectState for session " << id;
+            auto &session_shard = move_to_session_shard(hctx, shard, id, self, yield);
+            running_shard = &session_shard;
+            auto &sessions = session_shard.sessions; // NOLINT: Unknown. Maybe linter bug?
             // If a session is unknown, a bail out
             if (sessions.find(id) == sessions.end()) {
                 THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT, "session id not found!"}));
             }
-            // Otherwise, get session and lock until we exit handler
+            // Otherwise, get session
             auto &session = sessions[id];
-            // If session is already locked, bail out
-            auto new_lock_reason = get_session_lock_reason("InspectState", request_context.peer());
+            // If session is locked, bail out. We do not lock the session ourselves: queries wait in the active
+            // epoch instead, so they neither reject each other nor the AdvanceState rpcs that arrive meanwhile.
             if (session.session_lock) {
                 THROW((finish_error_yield_none{grpc::StatusCode::ABORTED,
                     "concurrent call in session (already locked by " + session.session_lock_reason +
-                        " when attempted lock by " + new_lock_reason + ")"}));
+                        " when attempted by " + get_session_lock_reason("InspectState", request_context.peer()) +
+                        ")"}));
             }
-            // Lock session so other rpcs to the same session are rejected
-            auto_lock session_lock(session.session_lock, "InspectState session lock");
-            session.session_lock_reason = new_lock_reason;
             // If session is tainted, report potential data loss
             if (session.tainted) {
                 THROW((finish_error_yield_none{grpc::StatusCode::DATA_LOSS, "session is tainted"}));
@@ -2978,71 +4573,84 @@ static handler_type::pull_type *new_InspectState_handler(handler_context &hctx)
                 THROW((finish_error_yield_none{grpc::StatusCode::INTERNAL, "active epoch not found"}));
             }
             auto &e = epochs[session.active_epoch_index];
-            // Make sure there isn't already another pending query
-            if (e.pending_query.has_value()) {
-                THROW((finish_error_yield_none{grpc::StatusCode::INTERNAL, "another query is already pending"}));
-            }
-            // Add pending query
-            e.pending_query.emplace(inspect_state_request.query_payload());
-            auto &q = e.pending_query.value();
-            // Now, either there are pending AdvanceState inputs being processed in this session, or there aren't.
-            // If there aren't, we can immediately process the InspectState query and return results.
-            // The session is locked, and therefore no other rpcs can interfere (including AdvanceState rpcs).
-            // Otherwise, we will have to yield because AdvanceState may be in the middle of an input.
-            // The function process_pending_inputs checks for a pending query between every input it processes.
-            // If it finds a pending query, it knows we are yielded and waiting. So it schedules us in the completion
-            // queue and yield.
-            // We process the query, then, when we are about to leave, we schedule process_pending_input's coroutine
-            // back in the completion queue, so it can go on processing its input queue.
-            auto_resume resume_on_exit(hctx.completion_queue.get());
-            if (!e.pending_inputs.empty()) {
-                // Set our coroutine in the pending_query so process_pending_inputs can find us
-                q.coroutine = self;
-                yield(side_effect::none);
-                // Here we have been resumed and process_pending_input has set its coroutine for us to find it
-                resume_on_exit.reset(q.coroutine);
-            }
-            // There is a chance the session was tainted between our yielding and being resumed
-            if (session.tainted) {
-                THROW((finish_error_yield_none{grpc::StatusCode::DATA_LOSS, "session is tainted"}));
+            query_type query{std::move(*inspect_state_request.mutable_query_payload())};
+            if (hctx.inspect_cache.max_size != 0) {
+                set_query_payload_hash(query);
             }
-            async_context actx{session, request_context, hctx.completion_queue.get(), self, yield};
-            process_pending_query(hctx, actx, e);
-            // Copy response
+            async_context actx{session, request_context, session_shard.completion_queue.get(), self, yield};
             InspectStateResponse inspect_state_response;
-            inspect_state_response.set_session_id(session.id);
-            inspect_state_response.set_active_epoch_index(session.active_epoch_index);
-            inspect_state_response.set_processed_input_count(q.processed_input_count);
-            for (const auto &r : q.reports) {
-                inspect_state_response.add_reports()->set_payload(r.payload);
-            }
-            switch (q.status) {
-                case completion_status::accepted:
-                    inspect_state_response.set_status(CompletionStatus::ACCEPTED);
-                    break;
-                case completion_status::rejected:
-                    inspect_state_response.set_status(CompletionStatus::REJECTED);
-                    break;
-                case completion_status::exception:
-                    inspect_state_response.set_status(CompletionStatus::EXCEPTION);
-                    if (q.exception_data.has_value()) {
-                        inspect_state_response.set_exception_data(q.exception_data.value());
+            bool cache_hit = false;
+            // Without pending inputs, the machine state cannot change before the query would run. So we can
+            // answer right away from the cache, without waiting for our turn
+            if (e.pending_inputs.empty() &&
+                find_inspect_result(hctx.inspect_cache, get_inspect_cache_key(actx, e.most_recent_machine_hash, query),
+                    query)) {
+                LOG_CONTEXT(debug, request_context) << "  Found query result in cache";
+                query.processed_input_count = session.processed_input_count;
+                set_proto_inspect_state_response(session, query, inspect_state_response);
+                cache_hit = true;
+            } else if (auto leader = std::find_if(e.pending_queries.begin(), e.pending_queries.end(),
+                           [&query](const query_type &p) { return p.encoded_payload == query.encoded_payload; });
+                       leader != e.pending_queries.end()) {
+                // An identical query is already pending, and the machine state cannot change until it is done.
+                // So we attach to it and wait for its outcome, instead of running the machine again
+                LOG_CONTEXT(debug, request_context) << "  Attaching to identical pending query";
+                query_follower_type follower;
+                follower.coroutine = self;
+                leader->followers.push_back(&follower);
+                yield(side_effect::none);
+                // The session may be gone by now, so we only use what the query passed on to us
+                if (!follower.status.ok()) {
+                    THROW((finish_error_yield_none{follower.status.error_code(), follower.status.error_message()}));
+                }
+                inspect_state_response = std::move(follower.response);
+            } else {
+                // Identical queries attach to a pending one above, but each distinct query takes a place in the queue
+                if (e.pending_queries.size() >= MAX_PENDING_QUERIES) {
+                    THROW((finish_error_yield_none{grpc::StatusCode::RESOURCE_EXHAUSTED, "too many pending queries"}));
+                }
+                // Add pending query
+                auto &q = e.pending_queries.emplace_back(std::move(query));
+                q.coroutine = self;
+                // Now, either the machine is idle, or it is busy with AdvanceState inputs or other queries.
+                // If it is idle, we can immediately process the InspectState query and return results.
+                // Otherwise, we will have to yield and wait for our turn.
+                // The function process_pending_inputs serves the pending queries between every input it
+                // processes. It schedules the first one in the completion queue and yields. Each query, when done
+                // with the machine, schedules the next one, and the last one in the batch schedules
+                // process_pending_inputs back, so it can go on processing its input queue.
+                auto_dequeue_query dequeue_on_exit(session_shard.completion_queue.get(), e, q);
+                try {
+                    if (e.pending_queries.size() > 1 || !e.pending_inputs.empty()) {
+                        yield(side_effect::none);
+                    } else {
+                        q.running = true;
                     }
-                    break;
-                case completion_status::machine_halted:
-                    inspect_state_response.set_status(CompletionStatus::MACHINE_HALTED);
-                    break;
-                case completion_status::cycle_limit_exceeded:
-                    inspect_state_response.set_status(CompletionStatus::CYCLE_LIMIT_EXCEEDED);
-                    break;
-                case completion_status::time_limit_exceeded:
-                    inspect_state_response.set_status(CompletionStatus::TIME_LIMIT_EXCEEDED);
-                    break;
-                case completion_status::payload_length_limit_exceeded:
-                    inspect_state_response.set_status(CompletionStatus::PAYLOAD_LENGTH_LIMIT_EXCEEDED);
-                    break;
+                    // There is a chance the session was tainted between our yielding and being resumed
+                    if (session.tainted) {
+                        THROW((finish_error_yield_none{grpc::StatusCode::DATA_LOSS, "session is tainted"}));
+                    }
+                    process_pending_query(hctx, actx, e, q);
+                } catch (finish_error_yield_none &x) {
+                    // The handlers attached to us fail with the same status we do
+                    resume_query_followers(session_shard.completion_queue.get(), q, InspectStateResponse{},
+                        x.status());
+                    throw;
+                } catch (taint_session &x) {
+                    resume_query_followers(session_shard.completion_queue.get(), q, InspectStateResponse{},
+                        x.status());
+                    throw;
+                }
+                set_proto_inspect_state_response(session, q, inspect_state_response);
+                cache_hit = q.cache_hit;
+                resume_query_followers(session_shard.completion_queue.get(), q, inspect_state_response,
+                    grpc::Status::OK);
+                // Leaving this block hands the machine over before replying
+            }
+            // With the cache enabled, tell the caller whether the query ran the machine
+            if (hctx.inspect_cache.max_size != 0) {
+                request_context.AddInitialMetadata("inspect-cache-hit", cache_hit ? "1" : "0");
             }
-            e.pending_query.reset();
             // Tell caller RPC succeeded
             inspect_state_writer.Finish(inspect_state_response, grpc::Status::OK, self);
             yield(side_effect::none);
@@ -3056,17 +4664,20 @@ static handler_type::pull_type *new_InspectState_handler(handler_context &hctx)
             auto &session = e.session();
             session.tainted = true;
             session.taint_status = e.status();
+            notify_epoch_status_waiters(session);
+            notify_advance_state_waiters(session);
             inspect_state_writer.FinishWithError(session.taint_status, self);
             yield(side_effect::none);
         } catch (std::exception &e) {
             LOG_CONTEXT(error, request_context) << "Caught unexpected exception " << e.what();
-            const auto &id = inspect_state_request.session_id();
             auto taint_status =
                 grpc::Status{grpc::StatusCode::INTERNAL, std::string{"unexpected exception "} + e.what()};
-            if (hctx.sessions.find(id) != hctx.sessions.end()) {
-                auto &session = hctx.sessions[id];
-                session.tainted = true;
-                session.taint_status = taint_status;
+            auto *session = find_session_on_error(hctx, *running_shard, inspect_state_request.session_id());
+            if (session != nullptr) {
+                session->tainted = true;
+                session->taint_status = taint_status;
+                notify_epoch_status_waiters(*session);
+                notify_advance_state_waiters(*session);
             }
             inspect_state_writer.FinishWithError(taint_status, self);
             yield(side_effect::none);
@@ -3077,51 +4688,58 @@ static handler_type::pull_type *new_InspectState_handler(handler_context &hctx)
 
 /// \brief Creates a new handler for the Checkin RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_Checkin_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_Checkin_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         // Start accepting CheckIn rpcs.
         ServerContext request_context;
         CheckInRequest checkin_request;
         ServerAsyncResponseWriter<Void> checkin_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Start expecting check-in rpcs
         hctx.checkin_async_service.RequestCheckIn(&request_context, &checkin_request, &checkin_writer, cq, cq, self);
         yield(side_effect::none);
-        new_Checkin_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_Checkin_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received CheckIn RPC with handle_context ok set to false";
             return;
         }
         try {
             const auto &id = checkin_request.session_id(); // NOLINT: Unknown. Maybe linter bug?
             LOG_CONTEXT(info, request_context) << "Received CheckIn for session " << id;
-            // If check-in is for the wrong session, bail out
-            if (hctx.sessions_waiting_checkin.find(id) == hctx.sessions_waiting_checkin.end()) {
-                THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT,
-                    "check-in with wrong session id " + id}));
+            handler_type::pull_type *coroutine = nullptr;
+            grpc::ServerCompletionQueue *coroutine_cq = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(hctx.mutex);
+                auto it = hctx.sessions_waiting_checkin.find(id);
+                // If check-in is for the wrong session, bail out
+                if (it == hctx.sessions_waiting_checkin.end()) {
+                    THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT,
+                        "check-in with wrong session id " + id}));
+                }
+                // If the deadline was reached first, bail out
+                auto &cctx = it->second;
+                if (cctx.status.has_value()) {
+                    THROW((finish_error_yield_none{grpc::StatusCode::DEADLINE_EXCEEDED,
+                        "check-in after deadline for session id " + id}));
+                }
+                // Register remote machine address.
+                // Session is not waiting for check-in anymore. Cancel it's deadline
+                cctx.address = checkin_request.address();
+                cctx.status = true;
+                cctx.alarm->Cancel();
+                coroutine = cctx.coroutine;
+                coroutine_cq = cctx.completion_queue;
             }
-            // If the actual session is unknown, a bail out
-            if (hctx.sessions.find(id) == hctx.sessions.end()) {
-                THROW((finish_error_yield_none{grpc::StatusCode::INVALID_ARGUMENT,
-                    "could not find an actual session with id " + id}));
-            }
-            // Get session and register remote machine address
-            auto &session = hctx.sessions[id];
-            session.server_address = checkin_request.address();
-            // Session is not waiting for check-in anymore. Cancel it's deadline
-            auto &cctx = hctx.sessions_waiting_checkin[id];
-            cctx.status = true;
-            cctx.alarm->Cancel();
-            auto *coroutine = cctx.coroutine;
             // Acknowledge check-in
             Void checkin_response;
             checkin_writer.Finish(checkin_response, grpc::Status::OK, self);
             yield(side_effect::none);
-            // Resume after checkin trigger
-            (*coroutine)();
+            // Resume after checkin trigger, in the shard running it
+            enqueue_completion_queue(coroutine_cq, coroutine);
 
         } catch (finish_error_yield_none &e) {
             LOG_CONTEXT(error, request_context) << "Caught finish_error_yield_none " << e.status().error_message();
@@ -3139,22 +4757,23 @@ static handler_type::pull_type *new_Checkin_handler(handler_context &hctx) {
 
 /// \brief Creates a new handler for the Health RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_Health_Check_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_Health_Check_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         using namespace grpc::health::v1;
         // Start accepting Health rpcs.
         ServerContext request_context;
         HealthCheckRequest health_request;
         ServerAsyncResponseWriter<HealthCheckResponse> health_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Start expecting check-in rpcs
         hctx.health_async_service.RequestCheck(&request_context, &health_request, &health_writer, cq, cq, self);
         yield(side_effect::none);
-        new_Health_Check_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_Health_Check_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received Health Check RPC with handle_context ok set to false";
             return;
         }
@@ -3175,22 +4794,23 @@ static handler_type::pull_type *new_Health_Check_handler(handler_context &hctx)
 
 /// \brief Creates a new handler for the Health RPC and starts accepting requests
 /// \param hctx Handler context shared between all handlers
-static handler_type::pull_type *new_Health_Watch_handler(handler_context &hctx) {
-    auto *self = static_cast<handler_type::pull_type *>(operator new(sizeof(handler_type::pull_type)));
-    new (self) handler_type::pull_type{[self, &hctx](handler_type::push_type &yield) {
+/// \param shard Shard whose completion queue receives the RPC
+static handler_type::pull_type *new_Health_Watch_handler(handler_context &hctx, shard_type &shard) {
+    auto *self = allocate_handler();
+    new (self) handler_type::pull_type{[self, &hctx, &shard](handler_type::push_type &yield) {
         using namespace grpc;
         using namespace grpc::health::v1;
         // Start accepting Health rpcs.
         ServerContext request_context;
         HealthCheckRequest health_request;
         ServerAsyncWriter<HealthCheckResponse> health_writer(&request_context);
-        auto *cq = hctx.completion_queue.get();
+        auto *cq = shard.completion_queue.get();
         // Start expecting check-in rpcs
         hctx.health_async_service.RequestWatch(&request_context, &health_request, &health_writer, cq, cq, self);
         yield(side_effect::none);
-        new_Health_Watch_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
+        new_Health_Watch_handler(hctx, shard); // NOLINT: cannot leak (pointer is in completion queue)
         // Not sure if we can receive an RPC with ok set to false. To be safe, we will ignore those.
-        if (!hctx.ok) {
+        if (!shard.ok) {
             LOG_CONTEXT(error, request_context) << "Received Health Watch RPC with handle_context ok set to false";
             return;
         }
@@ -3232,7 +4852,9 @@ static auto build_manager(const char *manager_address, handler_context &hctx) {
     builder.RegisterService(&hctx.manager_async_service);
     builder.RegisterService(&hctx.checkin_async_service);
     builder.RegisterService(&hctx.health_async_service);
-    hctx.completion_queue = builder.AddCompletionQueue();
+    for (auto &shard : hctx.shards) {
+        shard->completion_queue = builder.AddCompletionQueue();
+    }
     hctx.service_health.insert({
         {"", health_status_type::HealthCheckResponse_ServingStatus_SERVING},
         {ServerManager::service_full_name(), health_status_type::HealthCheckResponse_ServingStatus_SERVING},
@@ -3251,7 +4873,7 @@ static void drain_completion_queue(grpc::ServerCompletionQueue *cq) {
     bool ok = false;
     handler_type::pull_type *h = nullptr;
     while (cq->Next(reinterpret_cast<void **>(&h), &ok)) { // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-        delete h;
+        delete_handler(h);
     }
 }
 
@@ -3262,13 +4884,74 @@ static bool finished(handler_type::pull_type *c) {
     return !(*c);
 }
 
+/// \brief Returns the shard a handler moved to
+/// \param h Handler
+/// \return Shard, or nullptr if handler never left the shard where it was created
+static shard_type *get_handler_shard(handler_type::pull_type *h) {
+    return get_handler_frame(h)->shard.load();
+}
+
+/// \brief Resumes handlers returned by the completion queue of a shard
+/// \param hctx Handler context shared between all handlers
+/// \param shard Shard served by the calling thread
+/// \return True if a handler requested a shutdown, false if the shard was asked to stop
+static bool dispatch_completion_queue(handler_context &hctx, shard_type &shard) {
+    const bool sharded = hctx.shards.size() > 1;
+    for (;;) {
+        // Obtain the next active handler
+        handler_type::pull_type *h = nullptr; // NOLINT: cannot leak (drain_completion_queue kills remaining)
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        if (!shard.completion_queue->Next(reinterpret_cast<void **>(&h), &shard.ok)) {
+            return true;
+        }
+        // A null handler asks the shard to stop
+        if (!h) {
+            return false;
+        }
+        // Events of an RPC arrive where the RPC arrived, so send the handler back to the shard it moved to
+        auto *handler_shard = sharded ? get_handler_shard(h) : nullptr;
+        if (handler_shard && handler_shard != &shard) {
+            enqueue_completion_queue(handler_shard->completion_queue.get(), h);
+            continue;
+        }
+        // If the handler is finished, simply delete it
+        // This can't really happen here, because the handler ALWAYS yields
+        // after arranging for the completion queue to return it, rather than
+        // finishing.
+        if (finished(h)) {
+            delete_handler(h);
+        } else {
+            // Otherwise, resume it
+            (*h)();
+            // If it is now finished after being resumed, simply delete it
+            if (finished(h)) {
+                delete_handler(h);
+            } else if (h->get() == side_effect::migrate) {
+                // If it learned the session it works on, send it to the shard the session is pinned to
+                enqueue_completion_queue(get_handler_shard(h)->completion_queue.get(), h);
+            } else if (h->get() == side_effect::shutdown) {
+                // Otherwise, if requested a shutdown, delete this handler and
+                // shutdown. The other pending handlers will be deleted when
+                // we drain the completion queues.
+                delete_handler(h);
+                return true;
+            }
+        }
+    }
+}
+
 /// \brief Prints help
 /// \param name Program name vrom argv[0]
 static void help(const char *name) {
     (void) fprintf(stderr,
         R"(Usage:
 
-    %s --manager-address=<address> --server-address=<address> [--help]
+    %s --manager-address=<address> --server-address=<address> [--tx-read-prefix=<bytes>]
+        [--machine-server-pool-size=<n>] [--reuse-server-connection] [--snapshot-interval=<n>]
+        [--snapshot-rejection-threshold=<percent>] [--dispatch-threads=<n>] [--proof-threads=<n>]
+        [--inspect-cache-size=<bytes>] [--adaptive-run-increment]
+        [--metrics-file=<path>] [--metrics-interval=<ms>] [--async-logging]
+        [--remote-cartesi-machine=<command>] [--help]
 
 where
 
@@ -3282,6 +4965,96 @@ where
       passed to the spawned remote cartesi machine
       default: localhost:0
 
+    --tx-read-prefix=<bytes>
+      number of payload bytes read from the tx buffer together with the
+      header of each voucher, notice, report, or exception. payloads that
+      fit need a single read from the machine server
+      default: 1024
+
+    --machine-server-pool-size=<n>
+      number of machine servers to spawn and check in ahead of time.
+      StartSession claims one of them, when available, instead of
+      spawning a new machine server and waiting for its check-in.
+      machine servers that fail to spawn or check in are replaced
+      right away
+      default: 0
+
+    --reuse-server-connection
+      keeps using the same connection when a machine server checks in
+      after a snapshot or rollback with an unchanged address. only use
+      when machine servers are bound to an address that is handed over
+      across forks, such as a pre-bound unix socket
+
+    --snapshot-interval=<n>
+      maximum number of accepted inputs processed after each snapshot of
+      the machine server. when an input is skipped, the machine server
+      rolls back to the snapshot and the inputs accepted since then are
+      processed again. larger values avoid a snapshot per input when
+      dapps rarely skip inputs. StartSession requests can override it
+      with the snapshot-interval metadata
+      default: 1
+
+    --snapshot-rejection-threshold=<percent>
+      when the recent rate of skipped inputs in a session exceeds this
+      percentage, a snapshot is taken before every input regardless of
+      --snapshot-interval. StartSession requests can override it with
+      the snapshot-rejection-threshold metadata
+      default: 100
+
+    --dispatch-threads=<n>
+      number of threads dispatching RPCs. each thread serves its own
+      completion queue, and each session is pinned to one of them by a
+      hash of its id, so independent sessions are processed in parallel
+      default: 1
+
+    --proof-threads=<n>
+      number of worker threads building the proofs of all outputs in
+      FinishEpoch. while they run, the dispatch thread keeps serving
+      other sessions. when 0, proofs are built by the dispatch thread
+      default: 0
+
+    --inspect-cache-size=<bytes>
+      maximum number of bytes of query results to keep, shared by all
+      sessions. a query sent again before the machine state changes is
+      answered from the cache without running the machine. least
+      recently used results are evicted first. when 0, nothing is cached.
+      otherwise, the inspect-cache-hit metadata of each InspectState
+      response is 1 if it was answered from the cache, and 0 if not
+      default: 0
+
+    --adaptive-run-increment
+      starts each run of the machine server with the mcycle increment
+      given in StartSession, then doubles it while the machine keeps
+      running, up to what the measured speed of the machine allows
+      within half the increment deadline or within the time left.
+      long computations need fewer Run requests
+
+    --metrics-file=<path>
+      periodically writes metrics in the Prometheus text format to this
+      file, to be picked up by the textfile collector of node_exporter.
+      metrics include inputs processed per session, durations of each
+      phase of processing inputs and queries, Run requests and cycles
+      per input, depth of the pending input queue, and FinishEpoch
+      durations and proof counts
+
+    --metrics-interval=<ms>
+      milliseconds between writes to --metrics-file
+      default: 10000
+
+    --async-logging
+      formats and writes log records in a dedicated thread, so handlers
+      only push them into a lock-free queue. either way, records below
+      the severity in the SERVER_MANAGER_LOG_LEVEL environment variable
+      (info by default) are dropped before they are formatted
+
+    --remote-cartesi-machine=<command>
+      command line used to spawn machine servers, to which the session id,
+      check-in address, and server address options are appended. may
+      include options of its own, such as those of
+      mock-remote-cartesi-machine
+      default: remote-cartesi-machine next to the manager executable,
+      or /usr/bin/remote-cartesi-machine
+
     --help
       prints this message and exits
 
@@ -3303,6 +5076,20 @@ static bool stringval(const char *pre, const char *str, const char **val) {
     return false;
 }
 
+/// \brief Parses an unsigned integer
+/// \param str Input string
+/// \param val Receives parsed value
+/// \returns True if the entire string was a valid unsigned integer, false otherwise
+static bool uintval(const char *str, uint64_t *val) {
+    if (!str || *str < '0' || *str > '9') {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    *val = strtoull(str, &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
 static void cleanup_child_handler(int signal) {
     (void) signal;
     while (waitpid(static_cast<pid_t>(-1), nullptr, WNOHANG) > 0) {
@@ -3319,13 +5106,43 @@ static boost::log::trivial::severity_level get_log_level() {
     return boost::log::trivial::info;
 }
 
-static void init_logger() {
+/// \brief Console sink that formats and writes records in its own thread, fed by a lock-free queue
+using async_console_sink_type = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_ostream_backend,
+    boost::log::sinks::unbounded_fifo_queue>;
+
+/// \brief Asynchronous console sink, if enabled
+static boost::shared_ptr<async_console_sink_type> async_console_sink;
+
+/// \brief Writes the records still queued in the asynchronous console sink and stops its thread
+static void stop_async_console_sink() {
+    if (async_console_sink) {
+        async_console_sink->stop();
+        async_console_sink->flush();
+    }
+}
+
+/// \brief Initializes logging to the console
+/// \param async Whether records are written from a dedicated thread
+static void init_logger(bool async) {
     namespace keywords = boost::log::keywords;
+    log_level = get_log_level();
     auto core = boost::log::core::get();
     core->add_global_attribute("TimeStamp", boost::log::attributes::local_clock());
     core->add_global_attribute("PID", boost::log::attributes::make_function(&getpid));
-    boost::log::add_console_log(std::clog, keywords::filter = boost::log::trivial::severity >= get_log_level(),
-        keywords::format = "%TimeStamp% %Severity% server-manager pid:%PID% %Message%");
+    core->set_filter(boost::log::trivial::severity >= log_level);
+    const char *format = "%TimeStamp% %Severity% server-manager pid:%PID% %Message%";
+    if (!async) {
+        boost::log::add_console_log(std::clog, keywords::format = format);
+        return;
+    }
+    auto backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+    backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+    backend->auto_flush(true);
+    async_console_sink = boost::make_shared<async_console_sink_type>(backend);
+    async_console_sink->set_formatter(boost::log::parse_formatter(format));
+    core->add_sink(async_console_sink);
+    // Records logged right before exit, including exit(1) after fatal errors, must not be lost
+    (void) std::atexit(stop_async_console_sink);
 }
 
 int main(int argc, char *argv[]) try {
@@ -3334,6 +5151,19 @@ int main(int argc, char *argv[]) try {
 
     const char *manager_address = nullptr;
     const char *server_address = "localhost:0";
+    uint64_t tx_read_prefix_length = 1024;
+    uint64_t machine_server_pool_size = 0;
+    bool reuse_server_stub = false;
+    uint64_t snapshot_interval = 1;
+    uint64_t snapshot_rejection_threshold = 100;
+    uint64_t dispatch_threads = 1;
+    uint64_t proof_threads = 0;
+    uint64_t inspect_cache_size = 0;
+    bool adaptive_run_increment = false;
+    const char *metrics_path = "";
+    uint64_t metrics_interval = 10000;
+    bool async_logging = false;
+    const char *remote_cartesi_machine = nullptr;
 
     if (argc < 1) { // NOLINT: of course it could be < 1...
         std::cerr << "missing argv[0]\n";
@@ -3341,10 +5171,61 @@ int main(int argc, char *argv[]) try {
     }
 
     for (int i = 1; i < argc; i++) {
+        const char *str = nullptr;
         if (stringval("--manager-address=", argv[i], &manager_address)) {
             ;
         } else if (stringval("--server-address=", argv[i], &server_address)) {
             ;
+        } else if (stringval("--tx-read-prefix=", argv[i], &str)) {
+            if (!uintval(str, &tx_read_prefix_length)) {
+                std::cerr << "invalid tx-read-prefix\n";
+                exit(1);
+            }
+        } else if (stringval("--machine-server-pool-size=", argv[i], &str)) {
+            if (!uintval(str, &machine_server_pool_size)) {
+                std::cerr << "invalid machine-server-pool-size\n";
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--reuse-server-connection") == 0) {
+            reuse_server_stub = true;
+        } else if (stringval("--snapshot-interval=", argv[i], &str)) {
+            if (!uintval(str, &snapshot_interval) || snapshot_interval == 0) {
+                std::cerr << "invalid snapshot-interval\n";
+                exit(1);
+            }
+        } else if (stringval("--snapshot-rejection-threshold=", argv[i], &str)) {
+            if (!uintval(str, &snapshot_rejection_threshold) || snapshot_rejection_threshold > 100) {
+                std::cerr << "invalid snapshot-rejection-threshold\n";
+                exit(1);
+            }
+        } else if (stringval("--dispatch-threads=", argv[i], &str)) {
+            if (!uintval(str, &dispatch_threads) || dispatch_threads == 0) {
+                std::cerr << "invalid dispatch-threads\n";
+                exit(1);
+            }
+        } else if (stringval("--proof-threads=", argv[i], &str)) {
+            if (!uintval(str, &proof_threads)) {
+                std::cerr << "invalid proof-threads\n";
+                exit(1);
+            }
+        } else if (stringval("--metrics-file=", argv[i], &metrics_path)) {
+            ;
+        } else if (stringval("--metrics-interval=", argv[i], &str)) {
+            if (!uintval(str, &metrics_interval) || metrics_interval == 0) {
+                std::cerr << "invalid metrics-interval\n";
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--async-logging") == 0) {
+            async_logging = true;
+        } else if (stringval("--remote-cartesi-machine=", argv[i], &remote_cartesi_machine)) {
+            ;
+        } else if (strcmp(argv[i], "--adaptive-run-increment") == 0) {
+            adaptive_run_increment = true;
+        } else if (stringval("--inspect-cache-size=", argv[i], &str)) {
+            if (!uintval(str, &inspect_cache_size)) {
+                std::cerr << "invalid inspect-cache-size\n";
+                exit(1);
+            }
         } else if (strcmp(argv[i], "--help") == 0) {
             help(argv[0]);
             exit(0);
@@ -3358,22 +5239,39 @@ int main(int argc, char *argv[]) try {
         exit(1);
     }
 
-    init_logger();
+    init_logger(async_logging);
     handler_context hctx{};
 
-    std::filesystem::path remote_cartesi_machine_path =
-        boost::dll::program_location().replace_filename("remote-cartesi-machine");
-    if (!std::filesystem::exists(remote_cartesi_machine_path)) {
-        remote_cartesi_machine_path = "/usr/bin/remote-cartesi-machine";
+    if (remote_cartesi_machine) {
+        // A command line, not just a path, so it is not checked
+        hctx.remote_cartesi_machine_command = remote_cartesi_machine;
+    } else {
+        std::filesystem::path remote_cartesi_machine_path =
+            boost::dll::program_location().replace_filename("remote-cartesi-machine");
         if (!std::filesystem::exists(remote_cartesi_machine_path)) {
-            BOOST_LOG_TRIVIAL(fatal) << "remote-cartesi-machine not found";
-            exit(1);
+            remote_cartesi_machine_path = "/usr/bin/remote-cartesi-machine";
+            if (!std::filesystem::exists(remote_cartesi_machine_path)) {
+                BOOST_LOG_TRIVIAL(fatal) << "remote-cartesi-machine not found";
+                exit(1);
+            }
         }
+        hctx.remote_cartesi_machine_command = remote_cartesi_machine_path;
     }
 
-    hctx.remote_cartesi_machine_path = remote_cartesi_machine_path;
     hctx.manager_address = manager_address;
     hctx.server_address = server_address;
+    hctx.tx_read_prefix_length = tx_read_prefix_length;
+    hctx.machine_server_pool_size = machine_server_pool_size;
+    hctx.reuse_server_stub = reuse_server_stub;
+    hctx.snapshot_interval = snapshot_interval;
+    hctx.snapshot_rejection_threshold = snapshot_rejection_threshold;
+    hctx.inspect_cache.max_size = inspect_cache_size;
+    hctx.adaptive_run_increment = adaptive_run_increment;
+    hctx.metrics.path = metrics_path;
+    hctx.metrics.interval = metrics_interval;
+    for (uint64_t i = 0; i < dispatch_threads; ++i) {
+        hctx.shards.push_back(std::make_unique<shard_type>());
+    }
 
     BOOST_LOG_TRIVIAL(info) << "manager version is " << manager_version_major << "." << manager_version_minor << "."
                             << manager_version_patch;
@@ -3390,59 +5288,71 @@ int main(int argc, char *argv[]) try {
     sigaction(SIGCHLD, &sa, nullptr);
 
     // Start accepting requests for all RPCs
-    new_GetVersion_handler(hctx);       // NOLINT: cannot leak (pointer is in completion queue)
-    new_StartSession_handler(hctx);     // NOLINT: cannot leak (pointer is in completion queue)
-    new_AdvanceState_handler(hctx);     // NOLINT: cannot leak (pointer is in completion queue)
-    new_GetStatus_handler(hctx);        // NOLINT: cannot leak (pointer is in completion queue)
-    new_GetSessionStatus_handler(hctx); // NOLINT: cannot leak (pointer is in completion queue)
-    new_GetEpochStatus_handler(hctx);   // NOLINT: cannot leak (pointer is in completion queue)
-    new_InspectState_handler(hctx);     // NOLINT: cannot leak (pointer is in completion queue)
-    new_FinishEpoch_handler(hctx);      // NOLINT: cannot leak (pointer is in completion queue)
-    new_DeleteEpoch_handler(hctx);      // NOLINT: cannot leak (pointer is in completion queue)
-    new_EndSession_handler(hctx);       // NOLINT: cannot leak (pointer is in completion queue)
-    new_Checkin_handler(hctx);          // NOLINT: cannot leak (pointer is in completion queue)
-    new_Health_Check_handler(hctx);     // NOLINT: cannot leak (pointer is in completion queue)
-    new_Health_Watch_handler(hctx);     // NOLINT: cannot leak (pointer is in completion queue)
-
-    // Dispatch loop
-    for (;;) {
-        // Obtain the next active handler
-        handler_type::pull_type *h = nullptr; // NOLINT: cannot leak (drain_completion_queue kills remaining)
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-        if (!hctx.completion_queue->Next(reinterpret_cast<void **>(&h), &hctx.ok)) {
-            goto shutdown; // NOLINT(cppcoreguidelines-avoid-goto)
-        }
-        // If the handler is finished, simply delete it
-        // This can't really happen here, because the handler ALWAYS yields
-        // after arranging for the completion queue to return it, rather than
-        // finishing.
-        if (finished(h)) {
-            delete h;
-        } else {
-            // Otherwise, resume it
-            (*h)();
-            // If it is now finished after being resumed, simply delete it
-            if (finished(h)) {
-                delete h;
-            } else {
-                // Otherwise, if requested a shutdown, delete this handler and
-                // shutdown. The other pending handlers will be deleted when
-                // we drain the completion queue.
-                if (h->get() == side_effect::shutdown) {
-                    delete h;
-                    goto shutdown; // NOLINT(cppcoreguidelines-avoid-goto)
-                }
+    for (auto &shard : hctx.shards) {
+        new_GetVersion_handler(hctx, *shard);       // NOLINT: cannot leak (pointer is in completion queue)
+        new_StartSession_handler(hctx, *shard);     // NOLINT: cannot leak (pointer is in completion queue)
+        new_AdvanceState_handler(hctx, *shard);     // NOLINT: cannot leak (pointer is in completion queue)
+        new_GetStatus_handler(hctx, *shard);        // NOLINT: cannot leak (pointer is in completion queue)
+        new_GetSessionStatus_handler(hctx, *shard); // NOLINT: cannot leak (pointer is in completion queue)
+        new_GetEpochStatus_handler(hctx, *shard);   // NOLINT: cannot leak (pointer is in completion queue)
+        new_InspectState_handler(hctx, *shard);     // NOLINT: cannot leak (pointer is in completion queue)
+        new_FinishEpoch_handler(hctx, *shard);      // NOLINT: cannot leak (pointer is in completion queue)
+        new_DeleteEpoch_handler(hctx, *shard);      // NOLINT: cannot leak (pointer is in completion queue)
+        new_EndSession_handler(hctx, *shard);       // NOLINT: cannot leak (pointer is in completion queue)
+        new_Checkin_handler(hctx, *shard);          // NOLINT: cannot leak (pointer is in completion queue)
+        new_Health_Check_handler(hctx, *shard);     // NOLINT: cannot leak (pointer is in completion queue)
+        new_Health_Watch_handler(hctx, *shard);     // NOLINT: cannot leak (pointer is in completion queue)
+    }
+
+    // Spawn machine servers ahead of time, if requested
+    replenish_machine_server_pool(hctx, *hctx.shards[0]);
+
+    start_proof_pool(hctx.proof_pool, proof_threads);
+    start_metrics_writer(hctx.metrics);
+
+    // Dispatch loops, one thread per shard, with the main thread serving the first shard
+    std::vector<std::thread> shard_threads;
+    for (size_t i = 1; i < hctx.shards.size(); ++i) {
+        shard_threads.emplace_back([&hctx, &shard = *hctx.shards[i]]() {
+            if (dispatch_completion_queue(hctx, shard)) {
+                // Wake the main thread so it shuts the server down
+                enqueue_completion_queue(hctx.shards[0]->completion_queue.get(), nullptr);
             }
-        }
+        });
     }
+    dispatch_completion_queue(hctx, *hctx.shards[0]);
 
-shutdown:
-    // Shutdown server before completion queue
+    // Shutdown server before completion queues
     manager->Shutdown();
-    drain_completion_queue(hctx.completion_queue.get());
+    // Stop all other dispatch threads before draining, since they send handlers to each other's completion queues
+    for (size_t i = 1; i < hctx.shards.size(); ++i) {
+        enqueue_completion_queue(hctx.shards[i]->completion_queue.get(), nullptr);
+    }
+    for (auto &shard_thread : shard_threads) {
+        shard_thread.join();
+    }
+    // Stop proof workers as well, since they send handlers back to the completion queues
+    stop_proof_pool(hctx.proof_pool);
+    stop_metrics_writer(hctx.metrics);
+    // Resume long-polls and held inputs now, or their alarms would keep the completion queues from draining
+    for (auto &shard : hctx.shards) {
+        for (auto &session_pair : shard->sessions) {
+            notify_epoch_status_waiters(session_pair.second);
+            notify_advance_state_waiters(session_pair.second);
+        }
+    }
+    for (auto &shard : hctx.shards) {
+        drain_completion_queue(shard->completion_queue.get());
+    }
     // Kill all machine servers
-    for (auto &session_pair : hctx.sessions) {
-        session_pair.second.server_process_group.terminate();
+    for (auto &shard : hctx.shards) {
+        for (auto &session_pair : shard->sessions) {
+            session_pair.second.server_process_group.terminate();
+        }
+    }
+    for (auto &pooled_pair : hctx.machine_server_pool) {
+        std::error_code ec;
+        pooled_pair.second.process_group.terminate(ec);
     }
     return 0;
 } catch (std::exception &e) {
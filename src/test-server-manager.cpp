@@ -14,12 +14,23 @@
 // limitations under the License.
 //
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <exception>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <regex>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <cryptopp/filters.h>
 #include <cryptopp/hex.h>
@@ -49,6 +60,7 @@
 
 #include "back-merkle-tree.h"
 #include "complete-merkle-tree.h"
+#include "cryptopp-keccak-256-hasher.h"
 
 using CartesiMachine::Void;
 using grpc::ClientContext;
@@ -57,6 +69,8 @@ using grpc::StatusCode;
 
 // NOLINTNEXTLINE(misc-unused-using-decls)
 using std::chrono_literals::operator""s;
+// NOLINTNEXTLINE(misc-unused-using-decls)
+using std::chrono_literals::operator""ms;
 
 using namespace std::filesystem;
 using namespace CartesiServerManager;
@@ -70,6 +84,9 @@ constexpr static const uint64_t MEMORY_REGION_LENGTH = 2 << 20;
 constexpr static const int WAITING_PENDING_INPUT_MAX_RETRIES = 20;
 static const path MANAGER_ROOT_DIR = "/tmp/server-manager-root"; // NOLINT: ignore static initialization warning
 
+/// \brief Request or response metadata, by key
+using metadata_type = std::multimap<std::string, std::string>;
+
 class ServerManagerClient {
 
 public:
@@ -85,9 +102,10 @@ public:
         return m_stub->GetVersion(&context, request, &response);
     }
 
-    Status start_session(const StartSessionRequest &request, StartSessionResponse &response) {
+    Status start_session(const StartSessionRequest &request, StartSessionResponse &response,
+        const metadata_type &metadata = {}) {
         ClientContext context;
-        init_client_context(context);
+        init_client_context(context, metadata);
         return m_stub->StartSession(&context, request, &response);
     }
 
@@ -111,22 +129,31 @@ public:
         return m_stub->GetSessionStatus(&context, request, &response);
     }
 
-    Status get_epoch_status(const GetEpochStatusRequest &request, GetEpochStatusResponse &response) {
+    Status get_epoch_status(const GetEpochStatusRequest &request, GetEpochStatusResponse &response,
+        const metadata_type &metadata = {}, metadata_type *server_metadata = nullptr) {
         ClientContext context;
-        init_client_context(context);
-        return m_stub->GetEpochStatus(&context, request, &response);
+        init_client_context(context, metadata);
+        auto status = m_stub->GetEpochStatus(&context, request, &response);
+        get_server_metadata(context, server_metadata);
+        return status;
     }
 
-    Status inspect_state(const InspectStateRequest &request, InspectStateResponse &response) {
+    Status inspect_state(const InspectStateRequest &request, InspectStateResponse &response,
+        const metadata_type &metadata = {}, metadata_type *server_metadata = nullptr) {
         ClientContext context;
-        init_client_context(context);
-        return m_stub->InspectState(&context, request, &response);
+        init_client_context(context, metadata);
+        auto status = m_stub->InspectState(&context, request, &response);
+        get_server_metadata(context, server_metadata);
+        return status;
     }
 
-    Status finish_epoch(const FinishEpochRequest &request, FinishEpochResponse &response) {
+    Status finish_epoch(const FinishEpochRequest &request, FinishEpochResponse &response,
+        const metadata_type &metadata = {}, metadata_type *server_metadata = nullptr) {
         ClientContext context;
-        init_client_context(context);
-        return m_stub->FinishEpoch(&context, request, &response);
+        init_client_context(context, metadata);
+        auto status = m_stub->FinishEpoch(&context, request, &response);
+        get_server_metadata(context, server_metadata);
+        return status;
     }
 
     Status delete_epoch(const DeleteEpochRequest &request) {
@@ -162,11 +189,24 @@ private:
     std::unique_ptr<Health::Stub> m_health_stub;
     std::string m_test_id;
 
-    void init_client_context(ClientContext &context) {
+    void init_client_context(ClientContext &context, const metadata_type &metadata = {}) {
         context.set_wait_for_ready(true);
         context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(90));
         context.AddMetadata("test-id", test_id());
         context.AddMetadata("request-id", request_id());
+        for (const auto &[key, value] : metadata) {
+            context.AddMetadata(key, value);
+        }
+    }
+
+    static void get_server_metadata(const ClientContext &context, metadata_type *server_metadata) {
+        if (server_metadata == nullptr) {
+            return;
+        }
+        server_metadata->clear();
+        for (const auto &[key, value] : context.GetServerInitialMetadata()) {
+            server_metadata->emplace(std::string{key.data(), key.size()}, std::string{value.data(), value.size()});
+        }
     }
 
     static std::string request_id() {
@@ -564,6 +604,31 @@ void assert_bool(bool value, const std::string &msg, const std::string &file, in
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
 #define ASSERT_STATUS_CODE(s, f, v) assert_status_code(s, f, v, __FILE__, __LINE__)
 
+/// \brief Calls a function from several threads, rethrowing the first exception any of the calls threw
+/// \param count Number of threads
+/// \param f Function called with the index of each thread
+static void run_concurrently(int count, const std::function<void(int)> &f) {
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back([&f, &errors, i]() {
+            try {
+                f(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
 static void test_get_version(const std::function<void(const std::string &title, test_function f)> &test) {
     test("The server-manager server version should be 0.8.x", [](ServerManagerClient &manager) {
         Versioning::GetVersionResponse response;
@@ -1072,6 +1137,11 @@ static void end_session_after_processing_pending_inputs(ServerManagerClient &man
     ASSERT_STATUS(status, "EndSession", true);
 }
 
+static std::string get_metadata_value(const metadata_type &metadata, const std::string &key) {
+    auto it = metadata.find(key);
+    return it != metadata.end() ? it->second : std::string{};
+}
+
 static void test_advance_state(const std::function<void(const std::string &title, test_function f)> &test) {
     test("Should complete a valid request with success", [](ServerManagerClient &manager) {
         StartSessionRequest session_request = create_valid_start_session_request();
@@ -1306,6 +1376,69 @@ static void test_advance_state(const std::function<void(const std::string &title
             session_request.active_epoch_index());
     });
 
+    test("Should hold an input that arrives ahead of its turn until the inputs before it",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            // send the second input first
+            AdvanceStateRequest first_request;
+            init_valid_advance_state_request(first_request, session_request.session_id(),
+                session_request.active_epoch_index(), 0);
+            AdvanceStateRequest second_request;
+            init_valid_advance_state_request(second_request, session_request.session_id(),
+                session_request.active_epoch_index(), 1);
+            Status second_status;
+            std::thread second_sender([&manager, &second_request, &second_status]() {
+                second_status = manager.advance_state(second_request);
+            });
+            std::this_thread::sleep_for(1s);
+            status = manager.advance_state(first_request);
+            second_sender.join();
+            ASSERT_STATUS(status, "AdvanceState", true);
+            ASSERT_STATUS(second_status, "AdvanceState", true);
+
+            // both inputs are processed in index order
+            GetEpochStatusRequest status_request;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            GetEpochStatusResponse status_response;
+            wait_pending_inputs_to_be_processed(manager, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+            ASSERT(status_response.processed_inputs_size() == 2, "status response processed_inputs size should be 2");
+            for (uint64_t i = 0; i < 2; i++) {
+                const auto &processed_input = status_response.processed_inputs()[static_cast<int>(i)];
+                ASSERT(processed_input.input_index() == i, "processed input index should be sequential");
+                ASSERT(processed_input.status() == CompletionStatus::ACCEPTED,
+                    "processed input status should be ACCEPTED");
+            }
+
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+    test("Should fail to complete right away if the input index is too far ahead", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request();
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // the server holds inputs at most 256 ahead of their turn
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), 257);
+        auto start_time = std::chrono::steady_clock::now();
+        status = manager.advance_state(advance_request);
+        ASSERT_STATUS(status, "AdvanceState", false);
+        ASSERT_STATUS_CODE(status, "AdvanceState", StatusCode::INVALID_ARGUMENT);
+        ASSERT(std::chrono::steady_clock::now() - start_time < 5s, "input should be rejected without being held");
+
+        end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+            session_request.active_epoch_index());
+    });
+
     test("Should fail to complete input metadata is missing", [](ServerManagerClient &manager) {
         StartSessionRequest session_request = create_valid_start_session_request();
         StartSessionResponse session_response;
@@ -1714,6 +1847,76 @@ static void check_empty_epoch_status(const GetEpochStatusResponse &status_respon
     ASSERT(!status_response.has_taint_status(), "status response should not be tainted");
 }
 
+/// \brief Sends four inputs to a machine that rejects the third, and checks the rollback leaves the session healthy
+/// \param manager Server manager client
+/// \param metadata StartSession metadata choosing the snapshot policy
+static void check_rollback_after_accepted_inputs(ServerManagerClient &manager, const metadata_type &metadata) {
+    StartSessionRequest session_request = create_valid_start_session_request("third-input-rejecting-machine");
+    StartSessionResponse session_response;
+    Status status = manager.start_session(session_request, session_response, metadata);
+    ASSERT_STATUS(status, "StartSession", true);
+
+    // enqueue accepted, accepted, rejected, accepted
+    const uint64_t input_count = 4;
+    for (uint64_t i = 0; i < input_count; ++i) {
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), i);
+        status = manager.advance_state(advance_request);
+        ASSERT_STATUS(status, "AdvanceState", true);
+    }
+
+    // wait for all of them, failing if the rollback tainted the session
+    GetEpochStatusRequest status_request;
+    GetEpochStatusResponse status_response;
+    status_request.set_session_id(session_request.session_id());
+    status_request.set_epoch_index(session_request.active_epoch_index());
+    wait_pending_inputs_to_be_processed(manager, status_request, status_response, false,
+        WAITING_PENDING_INPUT_MAX_RETRIES);
+    ASSERT(!status_response.has_taint_status(), "status response should not be tainted");
+    ASSERT(static_cast<uint64_t>(status_response.processed_inputs_size()) == input_count,
+        "status response processed_inputs size should be 4");
+    for (uint64_t i = 0; i < input_count; ++i) {
+        const auto &processed_input = status_response.processed_inputs(static_cast<int>(i));
+        ASSERT(processed_input.input_index() == i, "processed input index should be sequential");
+        if (i == 2) {
+            ASSERT(processed_input.status() == CompletionStatus::REJECTED, "third input should be REJECTED");
+        } else {
+            ASSERT(processed_input.status() == CompletionStatus::ACCEPTED, "other inputs should be ACCEPTED");
+            ASSERT(processed_input.accepted_data().vouchers_size() == 1, "accepted input should have a voucher");
+            ASSERT(processed_input.accepted_data().notices_size() == 1, "accepted input should have a notice");
+        }
+    }
+
+    // the epoch still finishes on the rolled back machine
+    FinishEpochRequest epoch_request;
+    FinishEpochResponse epoch_response;
+    init_valid_finish_epoch_request(epoch_request, session_request.session_id(), session_request.active_epoch_index(),
+        input_count);
+    status = manager.finish_epoch(epoch_request, epoch_response);
+    ASSERT_STATUS(status, "FinishEpoch", true);
+    ASSERT(epoch_response.proofs_size() == 6, "finish epoch response should have proofs for 3 vouchers and 3 notices");
+
+    EndSessionRequest end_session_request;
+    end_session_request.set_session_id(session_request.session_id());
+    status = manager.end_session(end_session_request);
+    ASSERT_STATUS(status, "EndSession", true);
+}
+
+/// \brief Starts a GetEpochStatus long-poll for processed inputs in its own thread
+/// \param manager Server manager client
+/// \param request Request to send
+/// \param response Receives the response once the thread is joined
+/// \param status Receives the status once the thread is joined
+/// \param inputs_wait Value of the inputs-wait metadata
+/// \return Thread running the call
+static std::thread start_waiting_epoch_status(ServerManagerClient &manager, const GetEpochStatusRequest &request,
+    GetEpochStatusResponse &response, Status &status, const std::string &inputs_wait) {
+    return std::thread([&manager, &request, &response, &status, inputs_wait]() {
+        status = manager.get_epoch_status(request, response, {{"inputs-offset", "0"}, {"inputs-wait", inputs_wait}});
+    });
+}
+
 static void test_get_epoch_status(const std::function<void(const std::string &title, test_function f)> &test) {
     test("Should complete a valid request with success", [](ServerManagerClient &manager) {
         StartSessionRequest session_request = create_valid_start_session_request();
@@ -2384,6 +2587,32 @@ static void test_get_epoch_status(const std::function<void(const std::string &ti
                 session_request.active_epoch_index(), false, true);
         });
 
+    test("Should roll back a rejected input after accepted inputs with the default snapshot policy",
+        [](ServerManagerClient &manager) { check_rollback_after_accepted_inputs(manager, {}); });
+
+    test("Should replay accepted inputs after rolling back to a snapshot taken several inputs before",
+        [](ServerManagerClient &manager) {
+            check_rollback_after_accepted_inputs(manager, {{"snapshot-interval", "4"}});
+        });
+
+    test("Should fail to start a session with snapshot-interval zero", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request();
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response, {{"snapshot-interval", "0"}});
+        ASSERT_STATUS(status, "StartSession", false);
+        ASSERT_STATUS_CODE(status, "StartSession", StatusCode::INVALID_ARGUMENT);
+    });
+
+    test("Should fail to start a session with snapshot-rejection-threshold above 100",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status =
+                manager.start_session(session_request, session_response, {{"snapshot-rejection-threshold", "101"}});
+            ASSERT_STATUS(status, "StartSession", false);
+            ASSERT_STATUS_CODE(status, "StartSession", StatusCode::INVALID_ARGUMENT);
+        });
+
     test("Should complete with first processed input as CompletionStatus MACHINE_HALTED",
         [](ServerManagerClient &manager) {
             StartSessionRequest session_request = create_valid_start_session_request("halting-machine");
@@ -2625,6 +2854,134 @@ static void test_get_epoch_status(const std::function<void(const std::string &ti
             end_session_after_processing_pending_inputs(manager, session_request.session_id(),
                 session_request.active_epoch_index());
         });
+
+    test("Should return only the processed inputs selected by inputs-offset and inputs-limit",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            // enqueue and process 3 inputs
+            AdvanceStateRequest advance_request;
+            for (uint64_t i = 0; i < 3; i++) {
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                status = manager.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+            GetEpochStatusRequest status_request;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            GetEpochStatusResponse status_response;
+            wait_pending_inputs_to_be_processed(manager, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+            ASSERT(status_response.processed_inputs_size() == 3, "status response processed_inputs size should be 3");
+
+            // skip the first input and take at most one
+            metadata_type server_metadata;
+            status = manager.get_epoch_status(status_request, status_response,
+                {{"inputs-offset", "1"}, {"inputs-limit", "1"}}, &server_metadata);
+            ASSERT_STATUS(status, "GetEpochStatus", true);
+            ASSERT(get_metadata_value(server_metadata, "processed-input-count") == "3",
+                "processed-input-count should count all processed inputs");
+            ASSERT(status_response.processed_inputs_size() == 1, "status response processed_inputs size should be 1");
+            auto processed_input = (status_response.processed_inputs())[0];
+            check_processed_input(processed_input, 1, 2, 2, 2);
+
+            // past the last input
+            status = manager.get_epoch_status(status_request, status_response, {{"inputs-offset", "3"}});
+            ASSERT_STATUS(status, "GetEpochStatus", true);
+            ASSERT(status_response.processed_inputs_size() == 0, "status response processed_inputs should be empty");
+
+            // only the status
+            status = manager.get_epoch_status(status_request, status_response,
+                {{"inputs-offset", "2"}, {"inputs-without-payloads", "1"}});
+            ASSERT_STATUS(status, "GetEpochStatus", true);
+            ASSERT(status_response.processed_inputs_size() == 1, "status response processed_inputs size should be 1");
+            processed_input = (status_response.processed_inputs())[0];
+            ASSERT(processed_input.input_index() == 2, "processed input index should be 2");
+            ASSERT(processed_input.status() == CompletionStatus::ACCEPTED, "processed input status should be ACCEPTED");
+            ASSERT(!processed_input.has_accepted_data(), "processed input should not contain accepted data");
+            ASSERT(processed_input.reports_size() == 0, "processed input should not contain reports");
+
+            // end session
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+    test("Should hold a GetEpochStatus with inputs-wait until an input is processed", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request();
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // wait with a value past the server maximum, which must not overflow the deadline
+        GetEpochStatusRequest status_request;
+        status_request.set_session_id(session_request.session_id());
+        status_request.set_epoch_index(session_request.active_epoch_index());
+        GetEpochStatusResponse status_response;
+        Status wait_status;
+        auto start_time = std::chrono::steady_clock::now();
+        auto waiter = start_waiting_epoch_status(manager, status_request, status_response, wait_status,
+            std::to_string(UINT64_MAX));
+        std::this_thread::sleep_for(1s);
+
+        // enqueue
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        status = manager.advance_state(advance_request);
+        ASSERT_STATUS(status, "AdvanceState", true);
+
+        waiter.join();
+        ASSERT_STATUS(wait_status, "GetEpochStatus", true);
+        ASSERT(std::chrono::steady_clock::now() - start_time >= 1s, "GetEpochStatus should wait for the input");
+        ASSERT(status_response.state() == EpochState::ACTIVE, "status response state should be ACTIVE");
+        ASSERT(status_response.processed_inputs_size() == 1, "status response processed_inputs size should be 1");
+        auto processed_input = (status_response.processed_inputs())[0];
+        check_processed_input(processed_input, 0, 2, 2, 2);
+
+        // end session
+        end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+            session_request.active_epoch_index());
+    });
+
+    test("Should resume a GetEpochStatus waiting with inputs-wait when the epoch finishes",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            GetEpochStatusRequest status_request;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            GetEpochStatusResponse status_response;
+            Status wait_status;
+            auto waiter = start_waiting_epoch_status(manager, status_request, status_response, wait_status, "30000");
+            std::this_thread::sleep_for(1s);
+
+            // finish the epoch while the long-poll is waiting
+            FinishEpochRequest epoch_request;
+            FinishEpochResponse epoch_response;
+            init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+                session_request.active_epoch_index(), 0);
+            status = manager.finish_epoch(epoch_request, epoch_response);
+            ASSERT_STATUS(status, "FinishEpoch", true);
+
+            // the waiter is resumed after FinishEpoch releases the session, so it is not rejected as concurrent
+            waiter.join();
+            ASSERT_STATUS(wait_status, "GetEpochStatus", true);
+            check_empty_epoch_status(status_response, session_request.session_id(),
+                session_request.active_epoch_index(), EpochState::FINISHED, 0);
+
+            // end session
+            EndSessionRequest end_session_request;
+            end_session_request.set_session_id(session_request.session_id());
+            status = manager.end_session(end_session_request);
+            ASSERT_STATUS(status, "EndSession", true);
+        });
 }
 
 static void check_inspect_state_response(InspectStateResponse &response, const std::string &session_id, uint64_t epoch,
@@ -2901,62 +3258,271 @@ static void test_inspect_state(const std::function<void(const std::string &title
                 session_request.active_epoch_index());
         });
 
-    test("Should fail to complete if session id is not valid", [](ServerManagerClient &manager) {
-        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
-        StartSessionResponse session_response;
-        Status status = manager.start_session(session_request, session_response);
-        ASSERT_STATUS(status, "StartSession", true);
+    test("Should complete identical inspect state requests sent concurrently during advance states with success",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
 
-        InspectStateRequest inspect_request;
-        init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
-        inspect_request.set_session_id("NON-EXISTENT");
-        InspectStateResponse inspect_response;
-        status = manager.inspect_state(inspect_request, inspect_response);
-        ASSERT_STATUS(status, "InspectState", false);
-        ASSERT_STATUS_CODE(status, "InspectState", StatusCode::INVALID_ARGUMENT);
+            // keep the machine busy, so the queries pile up and the identical ones are coalesced
+            AdvanceStateRequest advance_request;
+            for (uint64_t i = 0; i < 2; i++) {
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                status = manager.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
 
-        // end session
-        EndSessionRequest end_session_request;
-        end_session_request.set_session_id(session_request.session_id());
-        status = manager.end_session(end_session_request);
-        ASSERT_STATUS(status, "EndSession", true);
-    });
+            // the last query differs from the others, so it must not get their response
+            const int query_count = 5;
+            std::vector<InspectStateRequest> inspect_requests(query_count);
+            std::vector<InspectStateResponse> inspect_responses(query_count);
+            std::vector<Status> inspect_statuses(query_count);
+            std::vector<std::thread> senders;
+            for (int i = 0; i < query_count; i++) {
+                init_valid_inspect_state_request(inspect_requests[i], session_request.session_id(),
+                    i + 1 < query_count ? 1 : 2);
+            }
+            for (int i = 0; i < query_count; i++) {
+                senders.emplace_back([&manager, &inspect_requests, &inspect_responses, &inspect_statuses, i]() {
+                    inspect_statuses[i] = manager.inspect_state(inspect_requests[i], inspect_responses[i]);
+                });
+            }
+            for (auto &sender : senders) {
+                sender.join();
+            }
+            for (int i = 0; i < query_count; i++) {
+                ASSERT_STATUS(inspect_statuses[i], "InspectState", true);
+                check_inspect_state_response(inspect_responses[i], session_request.session_id(),
+                    session_request.active_epoch_index(), i + 1 < query_count ? 1 : 2, 2);
+            }
 
-    test("Should fail to complete if session was ended", [](ServerManagerClient &manager) {
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+    test("Should answer concurrent inspect state requests in the order they arrive", [](ServerManagerClient &manager) {
         StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
         StartSessionResponse session_response;
         Status status = manager.start_session(session_request, session_response);
         ASSERT_STATUS(status, "StartSession", true);
 
-        // end session
-        EndSessionRequest end_session_request;
-        end_session_request.set_session_id(session_request.session_id());
-        status = manager.end_session(end_session_request);
-        ASSERT_STATUS(status, "EndSession", true);
+        // queries arriving while inputs are processed wait for their turn in the queue
+        const int input_count = 4;
+        for (int i = 0; i < input_count; i++) {
+            AdvanceStateRequest advance_request;
+            init_valid_advance_state_request(advance_request, session_request.session_id(),
+                session_request.active_epoch_index(), i);
+            status = manager.advance_state(advance_request);
+            ASSERT_STATUS(status, "AdvanceState", true);
+        }
+        const int query_count = 4;
+        std::vector<InspectStateRequest> inspect_requests(query_count);
+        std::vector<InspectStateResponse> inspect_responses(query_count);
+        for (int i = 0; i < query_count; i++) {
+            init_valid_inspect_state_request(inspect_requests[i], session_request.session_id(), i);
+        }
+        run_concurrently(query_count, [&manager, &inspect_requests, &inspect_responses](int i) {
+            // stagger the queries, so they arrive in index order
+            std::this_thread::sleep_for(std::chrono::milliseconds(100 * i));
+            Status status = manager.inspect_state(inspect_requests[i], inspect_responses[i]);
+            ASSERT_STATUS(status, "InspectState", true);
+        });
 
-        // try to enqueue input on ended session
-        InspectStateRequest inspect_request;
-        init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
-        InspectStateResponse inspect_response;
-        status = manager.inspect_state(inspect_request, inspect_response);
-        ASSERT_STATUS(status, "InspectState", false);
-        ASSERT_STATUS_CODE(status, "InspectState", StatusCode::INVALID_ARGUMENT);
-    });
+        // each query gets its own reports, and none ran on an older machine state than the query before it
+        for (int i = 0; i < query_count; i++) {
+            check_inspect_state_response(inspect_responses[i], session_request.session_id(),
+                session_request.active_epoch_index(), i, 2);
+            ASSERT(inspect_responses[i].processed_input_count() <= input_count,
+                "query should not see more inputs than were sent");
+            ASSERT(i == 0 ||
+                    inspect_responses[i].processed_input_count() >= inspect_responses[i - 1].processed_input_count(),
+                "queries should be answered in the order they arrived");
+        }
 
-    test("Should complete with success enqueing on a new epoch", [](ServerManagerClient &manager) {
-        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
-        StartSessionResponse session_response;
-        Status status = manager.start_session(session_request, session_response);
-        ASSERT_STATUS(status, "StartSession", true);
+        end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+            session_request.active_epoch_index());
+    });
 
-        // finish epoch
-        FinishEpochRequest epoch_request;
-        FinishEpochResponse epoch_response;
-        init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
-            session_request.active_epoch_index(), 0);
-        status = manager.finish_epoch(epoch_request, epoch_response);
-        ASSERT_STATUS(status, "FinishEpoch", true);
-        validate_finish_epoch_response(epoch_response, session_request.active_epoch_index(), 0);
+    test("Should queue an inspect state request across an advance state without rejecting either",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            AdvanceStateRequest advance_request;
+            for (uint64_t i = 0; i < 2; i++) {
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                status = manager.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+
+            // the query waits in the queue while the next input arrives
+            InspectStateRequest inspect_request;
+            init_valid_inspect_state_request(inspect_request, session_request.session_id(), 1);
+            InspectStateResponse inspect_response;
+            Status inspect_status;
+            std::thread inspector([&manager, &inspect_request, &inspect_response, &inspect_status]() {
+                inspect_status = manager.inspect_state(inspect_request, inspect_response);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            init_valid_advance_state_request(advance_request, session_request.session_id(),
+                session_request.active_epoch_index(), 2);
+            status = manager.advance_state(advance_request);
+            inspector.join();
+            ASSERT_STATUS(status, "AdvanceState", true);
+            ASSERT_STATUS(inspect_status, "InspectState", true);
+
+            // the query is served at an input boundary before the input sent after it
+            check_inspect_state_response(inspect_response, session_request.session_id(),
+                session_request.active_epoch_index(), 1, 2);
+            ASSERT(inspect_response.processed_input_count() <= 2,
+                "query should be served before the input that arrived after it");
+
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+    test("Should fail queued inspect state requests with DATA_LOSS when the session gets tainted",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request("infinite-loop-machine");
+            StartSessionResponse session_response;
+            // the input runs the machine in a single request, which taints the session when its deadline expires
+            auto *server_cycles = session_request.mutable_server_cycles();
+            server_cycles->set_advance_state_increment(server_cycles->max_advance_state());
+            auto *server_deadline = session_request.mutable_server_deadline();
+            server_deadline->set_advance_state_increment(10000);
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            AdvanceStateRequest advance_request;
+            init_valid_advance_state_request(advance_request, session_request.session_id(),
+                session_request.active_epoch_index(), 0);
+            status = manager.advance_state(advance_request);
+            ASSERT_STATUS(status, "AdvanceState", true);
+            std::this_thread::sleep_for(1s);
+
+            // distinct queries fill the queue, and the one past its limit of 64 is turned away
+            const int query_count = 65;
+            std::vector<InspectStateRequest> inspect_requests(query_count);
+            std::vector<Status> inspect_statuses(query_count);
+            for (int i = 0; i < query_count; i++) {
+                init_valid_inspect_state_request(inspect_requests[i], session_request.session_id(), i);
+            }
+            run_concurrently(query_count, [&manager, &inspect_requests, &inspect_statuses](int i) {
+                InspectStateResponse inspect_response;
+                inspect_statuses[i] = manager.inspect_state(inspect_requests[i], inspect_response);
+            });
+            int data_loss_count = 0;
+            int exhausted_count = 0;
+            for (auto &inspect_status : inspect_statuses) {
+                ASSERT_STATUS(inspect_status, "InspectState", false);
+                data_loss_count += inspect_status.error_code() == StatusCode::DATA_LOSS ? 1 : 0;
+                exhausted_count += inspect_status.error_code() == StatusCode::RESOURCE_EXHAUSTED ? 1 : 0;
+            }
+            ASSERT(data_loss_count == query_count - 1, "queued queries should fail with DATA_LOSS");
+            ASSERT(exhausted_count == 1, "the query past the queue limit should fail with RESOURCE_EXHAUSTED");
+
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index(), true);
+        });
+
+    test("Should fail identical queued inspect state requests with DATA_LOSS when the session gets tainted",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request("infinite-loop-machine");
+            StartSessionResponse session_response;
+            // the input runs the machine in a single request, which taints the session when its deadline expires
+            auto *server_cycles = session_request.mutable_server_cycles();
+            server_cycles->set_advance_state_increment(server_cycles->max_advance_state());
+            auto *server_deadline = session_request.mutable_server_deadline();
+            server_deadline->set_advance_state_increment(10000);
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            AdvanceStateRequest advance_request;
+            init_valid_advance_state_request(advance_request, session_request.session_id(),
+                session_request.active_epoch_index(), 0);
+            status = manager.advance_state(advance_request);
+            ASSERT_STATUS(status, "AdvanceState", true);
+            std::this_thread::sleep_for(1s);
+
+            // the first query waits for its turn, and the others attach to it, so they all share its outcome
+            const int query_count = 8;
+            InspectStateRequest inspect_request;
+            init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
+            std::vector<Status> inspect_statuses(query_count);
+            run_concurrently(query_count, [&manager, &inspect_request, &inspect_statuses](int i) {
+                InspectStateResponse inspect_response;
+                inspect_statuses[i] = manager.inspect_state(inspect_request, inspect_response);
+            });
+            for (auto &inspect_status : inspect_statuses) {
+                ASSERT_STATUS(inspect_status, "InspectState", false);
+                ASSERT_STATUS_CODE(inspect_status, "InspectState", StatusCode::DATA_LOSS);
+            }
+
+            end_session_after_processing_pending_inputs(manager, session_request.session_id(),
+                session_request.active_epoch_index(), true);
+        });
+
+    test("Should fail to complete if session id is not valid", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        InspectStateRequest inspect_request;
+        init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
+        inspect_request.set_session_id("NON-EXISTENT");
+        InspectStateResponse inspect_response;
+        status = manager.inspect_state(inspect_request, inspect_response);
+        ASSERT_STATUS(status, "InspectState", false);
+        ASSERT_STATUS_CODE(status, "InspectState", StatusCode::INVALID_ARGUMENT);
+
+        // end session
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        status = manager.end_session(end_session_request);
+        ASSERT_STATUS(status, "EndSession", true);
+    });
+
+    test("Should fail to complete if session was ended", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // end session
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        status = manager.end_session(end_session_request);
+        ASSERT_STATUS(status, "EndSession", true);
+
+        // try to enqueue input on ended session
+        InspectStateRequest inspect_request;
+        init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
+        InspectStateResponse inspect_response;
+        status = manager.inspect_state(inspect_request, inspect_response);
+        ASSERT_STATUS(status, "InspectState", false);
+        ASSERT_STATUS_CODE(status, "InspectState", StatusCode::INVALID_ARGUMENT);
+    });
+
+    test("Should complete with success enqueing on a new epoch", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // finish epoch
+        FinishEpochRequest epoch_request;
+        FinishEpochResponse epoch_response;
+        init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        status = manager.finish_epoch(epoch_request, epoch_response);
+        ASSERT_STATUS(status, "FinishEpoch", true);
+        validate_finish_epoch_response(epoch_response, session_request.active_epoch_index(), 0);
 
         InspectStateRequest inspect_request;
         init_valid_inspect_state_request(inspect_request, session_request.session_id(), 1);
@@ -3531,6 +4097,165 @@ static void test_finish_epoch(const std::function<void(const std::string &title,
         status = manager.end_session(end_session_request);
         ASSERT_STATUS(status, "EndSession", true);
     });
+
+    test("Should page through the proofs of an epoch with proofs-offset and proofs-limit",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            // enqueue two inputs, each with 2 vouchers and 2 notices
+            for (uint64_t i = 0; i < 2; ++i) {
+                AdvanceStateRequest advance_request;
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                status = manager.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+            GetEpochStatusRequest status_request;
+            GetEpochStatusResponse status_response;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            wait_pending_inputs_to_be_processed(manager, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+
+            // The first call finishes the epoch, the following ones read the other pages
+            const uint64_t proof_count = 8;
+            const uint64_t page_size = 3;
+            FinishEpochRequest epoch_request;
+            init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+                session_request.active_epoch_index(), 2);
+            FinishEpochResponse all_pages;
+            for (uint64_t offset = 0; offset < proof_count; offset += page_size) {
+                metadata_type metadata{{"proofs-limit", std::to_string(page_size)}};
+                if (offset > 0) {
+                    metadata.emplace("proofs-offset", std::to_string(offset));
+                }
+                metadata_type server_metadata;
+                FinishEpochResponse page;
+                status = manager.finish_epoch(epoch_request, page, metadata, &server_metadata);
+                ASSERT_STATUS(status, "FinishEpoch", true);
+                ASSERT(get_metadata_value(server_metadata, "proofs-count") == std::to_string(proof_count),
+                    "proofs-count should be the number of proofs in the epoch");
+                ASSERT(static_cast<uint64_t>(page.proofs_size()) == std::min(page_size, proof_count - offset),
+                    "page should have at most proofs-limit proofs");
+                if (offset == 0) {
+                    all_pages = page;
+                } else {
+                    ASSERT(page.vouchers_epoch_root_hash().data() == all_pages.vouchers_epoch_root_hash().data() &&
+                            page.notices_epoch_root_hash().data() == all_pages.notices_epoch_root_hash().data(),
+                        "all pages should have the same epoch root hashes");
+                    for (const auto &proof : page.proofs()) {
+                        *all_pages.add_proofs() = proof;
+                    }
+                }
+            }
+            validate_finish_epoch_response(all_pages, session_request.active_epoch_index(), 2);
+
+            // EndSession
+            EndSessionRequest end_session_request;
+            end_session_request.set_session_id(session_request.session_id());
+            status = manager.end_session(end_session_request);
+            ASSERT_STATUS(status, "EndSession", true);
+        });
+
+    test("Should read another page of proofs while another call holds the session lock",
+        [](ServerManagerClient &manager) {
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = manager.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            // enqueue two inputs, each with 2 vouchers and 2 notices
+            for (uint64_t i = 0; i < 2; ++i) {
+                AdvanceStateRequest advance_request;
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                status = manager.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+            GetEpochStatusRequest status_request;
+            GetEpochStatusResponse status_response;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            wait_pending_inputs_to_be_processed(manager, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+
+            FinishEpochRequest epoch_request;
+            FinishEpochResponse epoch_response;
+            init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+                session_request.active_epoch_index(), 2);
+            status = manager.finish_epoch(epoch_request, epoch_response);
+            ASSERT_STATUS(status, "FinishEpoch", true);
+
+            // finishing the next epoch holds the session lock while it stores the machine, and meanwhile pages
+            // of the finished epoch are read again
+            std::string storage_dir{"sessions"};
+            ASSERT(create_storage_directory(storage_dir), "test should be able to create directory");
+            FinishEpochRequest store_request;
+            init_valid_finish_epoch_request(store_request, session_request.session_id(),
+                session_request.active_epoch_index() + 1, 0,
+                get_machine_directory(storage_dir, "test_" + manager.test_id()));
+            std::atomic<bool> stored{false};
+            run_concurrently(2, [&](int i) {
+                if (i == 0) {
+                    FinishEpochResponse store_response;
+                    Status store_status = manager.finish_epoch(store_request, store_response);
+                    stored = true;
+                    ASSERT_STATUS(store_status, "FinishEpoch", true);
+                    return;
+                }
+                do {
+                    metadata_type server_metadata;
+                    FinishEpochResponse page;
+                    Status page_status = manager.finish_epoch(epoch_request, page,
+                        {{"proofs-offset", "3"}, {"proofs-limit", "3"}}, &server_metadata);
+                    ASSERT_STATUS(page_status, "FinishEpoch", true);
+                    ASSERT(get_metadata_value(server_metadata, "proofs-count") == "8",
+                        "proofs-count should be the number of proofs in the epoch");
+                    ASSERT(page.proofs_size() == 3 && page.proofs(0).SerializeAsString() ==
+                            epoch_response.proofs(3).SerializeAsString(),
+                        "page should have the proofs at its offset");
+                } while (!stored);
+            });
+            ASSERT(delete_storage_directory(storage_dir), "test should be able to remove dir");
+
+            EndSessionRequest end_session_request;
+            end_session_request.set_session_id(session_request.session_id());
+            status = manager.end_session(end_session_request);
+            ASSERT_STATUS(status, "EndSession", true);
+        });
+
+    test("Should fail to store the machine when reading another page of proofs", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request();
+        StartSessionResponse session_response;
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        FinishEpochRequest epoch_request;
+        FinishEpochResponse epoch_response;
+        init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        status = manager.finish_epoch(epoch_request, epoch_response);
+        ASSERT_STATUS(status, "FinishEpoch", true);
+
+        // reading a page again is fine, but the machine is only stored when the epoch finishes
+        status = manager.finish_epoch(epoch_request, epoch_response, {{"proofs-offset", "0"}});
+        ASSERT_STATUS(status, "FinishEpoch", true);
+        std::string storage_dir{"sessions"};
+        init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0, get_machine_directory(storage_dir, "test_" + manager.test_id()));
+        status = manager.finish_epoch(epoch_request, epoch_response, {{"proofs-offset", "0"}});
+        ASSERT_STATUS(status, "FinishEpoch", false);
+        ASSERT_STATUS_CODE(status, "FinishEpoch", StatusCode::INVALID_ARGUMENT);
+
+        // end session
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        status = manager.end_session(end_session_request);
+        ASSERT_STATUS(status, "EndSession", true);
+    });
 }
 
 static void test_delete_epoch(const std::function<void(const std::string &title, test_function f)> &test) {
@@ -3778,6 +4503,48 @@ static void test_end_session(const std::function<void(const std::string &title,
             end_session_after_processing_pending_inputs(manager, session_request.session_id(),
                 session_request.active_epoch_index());
         });
+
+    test("Should end a session tainted by a query while an input is being enqueued", [](ServerManagerClient &manager) {
+        StartSessionRequest session_request = create_valid_start_session_request("infinite-loop-machine");
+        StartSessionResponse session_response;
+        auto *server_deadline = session_request.mutable_server_deadline();
+        server_deadline->set_advance_state_increment(1);
+        server_deadline->set_inspect_state_increment(1);
+        Status status = manager.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // the query taints the session while the input is enqueued and the session is ended
+        InspectStateRequest inspect_request;
+        init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
+        InspectStateResponse inspect_response;
+        Status inspect_status;
+        std::thread inspector([&manager, &inspect_request, &inspect_response, &inspect_status]() {
+            inspect_status = manager.inspect_state(inspect_request, inspect_response);
+        });
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        (void) manager.advance_state(advance_request);
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        status = manager.end_session(end_session_request);
+        inspector.join();
+        ASSERT_STATUS(inspect_status, "InspectState", false);
+
+        // the session is only erased once nothing uses it anymore
+        for (int i = 0; !status.ok() && i < WAITING_PENDING_INPUT_MAX_RETRIES; i++) {
+            ASSERT(status.error_code() == StatusCode::ABORTED || status.error_code() == StatusCode::INVALID_ARGUMENT,
+                "EndSession should only fail while the session is in use");
+            std::this_thread::sleep_for(1s);
+            status = manager.end_session(end_session_request);
+        }
+        ASSERT_STATUS(status, "EndSession", true);
+
+        // the manager is still serving
+        GetStatusResponse get_status_response;
+        status = manager.get_status(get_status_response);
+        ASSERT_STATUS(status, "GetStatus", true);
+    });
 }
 
 static void test_session_simulations(const std::function<void(const std::string &title, test_function f)> &test) {
@@ -3992,8 +4759,501 @@ static void test_health_check(const std::function<void(const std::string &title,
     });
 }
 
-static int run_tests(const char *address, const bool fast) {
+/// \brief Client of a second server manager started with tuning options, or nullptr if there is none
+static std::unique_ptr<ServerManagerClient> tuned_manager; // NOLINT: ignore static initialization warning
+
+static ServerManagerClient &get_tuned_manager() {
+    ASSERT(tuned_manager != nullptr, "tuned manager address was not given");
+    return *tuned_manager;
+}
+
+/// \brief Size of the inspect cache of the tuned manager, set with --inspect-cache-size in TUNED_MANAGER_OPTS
+static constexpr uint64_t TUNED_INSPECT_CACHE_SIZE = 65536;
+
+/// \brief File the tuned manager writes its metrics to, set with --metrics-file in TUNED_MANAGER_OPTS
+static constexpr const char *TUNED_METRICS_FILE = "/tmp/server-manager-tuned.prom";
+
+/// \brief Parses a metrics file in the Prometheus text format
+/// \param path Metrics file
+/// \return Value of each sample, keyed by its name and labels as written
+/// \details Asserts that each line is a comment, or a sample of a metric whose type was declared before it
+static std::map<std::string, double> parse_prometheus_text(const std::string &path) {
+    static const std::regex help_line{R"(# HELP ([a-zA-Z_:][a-zA-Z0-9_:]*) .*)"};
+    static const std::regex type_line{R"(# TYPE ([a-zA-Z_:][a-zA-Z0-9_:]*) (counter|gauge|histogram|summary|untyped))"};
+    static const std::regex sample_line{R"(([a-zA-Z_:][a-zA-Z0-9_:]*)(\{[a-zA-Z_][a-zA-Z0-9_]*="([^"\\]|\\.)*")"
+                                        R"((,[a-zA-Z_][a-zA-Z0-9_]*="([^"\\]|\\.)*")*\})? (\S+))"};
+    std::ifstream file(path);
+    ASSERT(file.is_open(), "metrics file should exist");
+    std::map<std::string, std::string> types;
+    std::map<std::string, double> samples;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::smatch match;
+        if (line.empty() || std::regex_match(line, match, help_line)) {
+            continue;
+        }
+        if (std::regex_match(line, match, type_line)) {
+            types[match[1]] = match[2];
+            continue;
+        }
+        ASSERT(std::regex_match(line, match, sample_line), "metrics line should be a valid sample: " + line);
+        std::string name = match[1];
+        if (types.find(name) == types.end()) {
+            for (const char *suffix : {"_bucket", "_sum", "_count"}) {
+                const std::string s{suffix};
+                if (name.size() > s.size() && name.compare(name.size() - s.size(), s.size(), s) == 0 &&
+                    types[name.substr(0, name.size() - s.size())] == "histogram") {
+                    name = name.substr(0, name.size() - s.size());
+                    break;
+                }
+            }
+        }
+        ASSERT(types.find(name) != types.end(), "metrics sample should have a declared type: " + line);
+        const std::string value = match[match.size() - 1];
+        char *end = nullptr;
+        const double v = std::strtod(value.c_str(), &end);
+        ASSERT(end == value.c_str() + value.size(), "metrics sample value should be a number: " + line);
+        samples[line.substr(0, line.size() - value.size() - 1)] = v;
+    }
+    return samples;
+}
+
+/// \brief Sends a query to the tuned manager
+/// \param tuned Tuned manager
+/// \param session_id Session to query
+/// \param payload Query payload
+/// \param response Receives the response
+/// \return True if the query was answered from the inspect cache
+static bool inspect_state_tuned(ServerManagerClient &tuned, const std::string &session_id, const std::string &payload,
+    InspectStateResponse &response) {
+    InspectStateRequest request;
+    request.set_session_id(session_id);
+    request.set_query_payload(payload);
+    metadata_type server_metadata;
+    Status status = tuned.inspect_state(request, response, {}, &server_metadata);
+    ASSERT_STATUS(status, "InspectState", true);
+    auto hit = get_metadata_value(server_metadata, "inspect-cache-hit");
+    ASSERT(hit == "0" || hit == "1", "inspect-cache-hit metadata should be present");
+    return hit == "1";
+}
+
+/// \brief Checks that two responses to the same query carry the same outcome
+static void check_same_inspect_state_response(const InspectStateResponse &a, const InspectStateResponse &b) {
+    ASSERT(a.status() == b.status(), "response status should match");
+    ASSERT(a.exception_data() == b.exception_data(), "response exception data should match");
+    ASSERT(a.processed_input_count() == b.processed_input_count(), "response processed input count should match");
+    ASSERT(a.reports_size() == b.reports_size(), "response reports size should match");
+    for (int i = 0; i < a.reports_size(); i++) {
+        ASSERT(a.reports(i).payload() == b.reports(i).payload(), "report payload should match");
+    }
+}
+
+/// \brief Session started on one of the managers a test compares
+using managed_session_type = std::pair<ServerManagerClient *, StartSessionRequest>;
+
+/// \brief Feeds the same inputs to sessions on different managers, and checks they end up with the same epoch
+/// \param sessions Sessions to start, each with the manager it is started on
+/// \param input_count Number of inputs, each with 2 vouchers and 2 notices
+/// \details The processed inputs, hashes and proofs of the first session are the reference for the others.
+/// All sessions are ended at the end.
+static void check_same_epoch_on_managers(std::vector<managed_session_type> &sessions, uint64_t input_count) {
+    for (auto &[m, session_request] : sessions) {
+        StartSessionResponse session_response;
+        Status status = m->start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+    }
+
+    // All sessions get the very same inputs
+    for (uint64_t i = 0; i < input_count; ++i) {
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, sessions[0].second.session_id(),
+            sessions[0].second.active_epoch_index(), i);
+        for (auto &[m, session_request] : sessions) {
+            advance_request.set_session_id(session_request.session_id());
+            Status status = m->advance_state(advance_request);
+            ASSERT_STATUS(status, "AdvanceState", true);
+        }
+    }
+
+    std::vector<GetEpochStatusResponse> status_responses;
+    std::vector<FinishEpochResponse> epoch_responses;
+    for (auto &[m, session_request] : sessions) {
+        GetEpochStatusRequest status_request;
+        status_request.set_session_id(session_request.session_id());
+        status_request.set_epoch_index(session_request.active_epoch_index());
+        wait_pending_inputs_to_be_processed(*m, status_request, status_responses.emplace_back(), false,
+            WAITING_PENDING_INPUT_MAX_RETRIES);
+
+        FinishEpochRequest epoch_request;
+        init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+            session_request.active_epoch_index(), input_count);
+        Status status = m->finish_epoch(epoch_request, epoch_responses.emplace_back());
+        ASSERT_STATUS(status, "FinishEpoch", true);
+        validate_finish_epoch_response(epoch_responses.back(), session_request.active_epoch_index(), input_count);
+    }
+
+    const auto &reference_status = status_responses[0];
+    const auto &reference_epoch = epoch_responses[0];
+    ASSERT(reference_epoch.proofs_size() == static_cast<int>(input_count * 4),
+        "epoch should have a proof for each output");
+    for (size_t j = 1; j < sessions.size(); ++j) {
+        const auto &status_response = status_responses[j];
+        ASSERT(status_response.processed_inputs_size() == reference_status.processed_inputs_size(),
+            "processed inputs size should match");
+        for (int i = 0; i < status_response.processed_inputs_size(); i++) {
+            ASSERT(status_response.processed_inputs(i).SerializeAsString() ==
+                    reference_status.processed_inputs(i).SerializeAsString(),
+                "processed inputs should be identical");
+        }
+        const auto &epoch_response = epoch_responses[j];
+        ASSERT(epoch_response.machine_hash().data() == reference_epoch.machine_hash().data(),
+            "machine hashes should match");
+        ASSERT(epoch_response.vouchers_epoch_root_hash().data() == reference_epoch.vouchers_epoch_root_hash().data() &&
+                epoch_response.notices_epoch_root_hash().data() == reference_epoch.notices_epoch_root_hash().data(),
+            "epoch root hashes should match");
+        ASSERT(epoch_response.proofs_size() == reference_epoch.proofs_size(), "proofs size should match");
+        for (int i = 0; i < epoch_response.proofs_size(); i++) {
+            ASSERT(epoch_response.proofs(i).SerializeAsString() == reference_epoch.proofs(i).SerializeAsString(),
+                "proofs should be identical and in the same order");
+        }
+    }
+
+    for (auto &[m, session_request] : sessions) {
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        Status status = m->end_session(end_session_request);
+        ASSERT_STATUS(status, "EndSession", true);
+    }
+}
+
+static void test_tuned_manager(const std::function<void(const std::string &title, test_function f)> &test) {
+    test("Should serve sessions spread over several dispatch shards", [](ServerManagerClient & /*manager*/) {
+        auto &tuned = get_tuned_manager();
+        // Session ids hash to shards, so several sessions land on different shards and their handlers migrate
+        const int session_count = 8;
+        std::vector<StartSessionRequest> session_requests;
+        for (int i = 0; i < session_count; i++) {
+            session_requests.push_back(create_valid_start_session_request());
+        }
+        run_concurrently(session_count, [&tuned, &session_requests](int i) {
+            const auto &session_request = session_requests[i];
+            StartSessionResponse session_response;
+            Status status = tuned.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            for (uint64_t j = 0; j < 3; j++) {
+                AdvanceStateRequest advance_request;
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), j);
+                status = tuned.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+
+            InspectStateRequest inspect_request;
+            init_valid_inspect_state_request(inspect_request, session_request.session_id(), 0);
+            InspectStateResponse inspect_response;
+            status = tuned.inspect_state(inspect_request, inspect_response);
+            ASSERT_STATUS(status, "InspectState", true);
+
+            end_session_after_processing_pending_inputs(tuned, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+        // Every session was ended
+        GetStatusResponse get_status_response;
+        Status status = tuned.get_status(get_status_response);
+        ASSERT_STATUS(status, "GetStatus", true);
+        for (const auto &session_request : session_requests) {
+            for (const auto &id : get_status_response.session_id()) {
+                ASSERT(id != session_request.session_id(), "session should have been ended");
+            }
+        }
+    });
+
+    test("Should answer a repeated query from the inspect cache", [](ServerManagerClient & /*manager*/) {
+        auto &tuned = get_tuned_manager();
+        StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+        StartSessionResponse session_response;
+        Status status = tuned.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // Sessions start from the same machine, so an earlier test may have cached this query already
+        const std::string payload = get_report_payload(0) + session_request.session_id();
+        InspectStateResponse first_response;
+        ASSERT(!inspect_state_tuned(tuned, session_request.session_id(), payload, first_response),
+            "first query should run the machine");
+        ASSERT(first_response.reports_size() == 2, "first query should have reports");
+        InspectStateResponse second_response;
+        ASSERT(inspect_state_tuned(tuned, session_request.session_id(), payload, second_response),
+            "repeated query should be answered from the cache");
+        check_same_inspect_state_response(first_response, second_response);
+
+        EndSessionRequest end_session_request;
+        end_session_request.set_session_id(session_request.session_id());
+        status = tuned.end_session(end_session_request);
+        ASSERT_STATUS(status, "EndSession", true);
+    });
+
+    test("Should miss the inspect cache once an input changes the machine state",
+        [](ServerManagerClient & /*manager*/) {
+            auto &tuned = get_tuned_manager();
+            StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+            StartSessionResponse session_response;
+            Status status = tuned.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+
+            const std::string payload = get_report_payload(1) + session_request.session_id();
+            InspectStateResponse before_response;
+            ASSERT(!inspect_state_tuned(tuned, session_request.session_id(), payload, before_response),
+                "first query should run the machine");
+            ASSERT(inspect_state_tuned(tuned, session_request.session_id(), payload, before_response),
+                "repeated query should be answered from the cache");
+
+            AdvanceStateRequest advance_request;
+            init_valid_advance_state_request(advance_request, session_request.session_id(),
+                session_request.active_epoch_index(), 0);
+            status = tuned.advance_state(advance_request);
+            ASSERT_STATUS(status, "AdvanceState", true);
+            GetEpochStatusRequest status_request;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            GetEpochStatusResponse status_response;
+            wait_pending_inputs_to_be_processed(tuned, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+
+            // The input changed the machine hash, so the earlier result no longer applies
+            InspectStateResponse after_response;
+            ASSERT(!inspect_state_tuned(tuned, session_request.session_id(), payload, after_response),
+                "query after an input should run the machine");
+            ASSERT(after_response.processed_input_count() == 1, "query should see the processed input");
+            InspectStateResponse again_response;
+            ASSERT(inspect_state_tuned(tuned, session_request.session_id(), payload, again_response),
+                "repeated query after an input should be answered from the cache");
+            check_same_inspect_state_response(after_response, again_response);
+
+            end_session_after_processing_pending_inputs(tuned, session_request.session_id(),
+                session_request.active_epoch_index());
+        });
+
+    test("Should evict the least recently used query results past the inspect cache size",
+        [](ServerManagerClient & /*manager*/) {
+            auto &tuned = get_tuned_manager();
+            StartSessionRequest session_request = create_valid_start_session_request("inspect-state-machine");
+            StartSessionResponse session_response;
+            Status status = tuned.start_session(session_request, session_response);
+            ASSERT_STATUS(status, "StartSession", true);
+            const auto &id = session_request.session_id();
+
+            // Each result holds two reports echoing the payload, so two results fit in the cache and three do not
+            const auto fill_length = TUNED_INSPECT_CACHE_SIZE / 6 - id.size();
+            const std::string a = std::string(fill_length, 'a') + id;
+            const std::string b = std::string(fill_length, 'b') + id;
+            const std::string c = std::string(fill_length, 'c') + id;
+            InspectStateResponse response;
+            ASSERT(!inspect_state_tuned(tuned, id, a, response), "query a should run the machine");
+            ASSERT(!inspect_state_tuned(tuned, id, b, response), "query b should run the machine");
+            // Using a makes b the least recently used
+            ASSERT(inspect_state_tuned(tuned, id, a, response), "query a should be answered from the cache");
+            ASSERT(!inspect_state_tuned(tuned, id, c, response), "query c should run the machine");
+            ASSERT(response.reports_size() == 2 && response.reports(0).payload() == c,
+                "query c should echo its payload");
+            // Caching c evicted b but kept a
+            ASSERT(inspect_state_tuned(tuned, id, c, response), "query c should be answered from the cache");
+            ASSERT(inspect_state_tuned(tuned, id, a, response), "query a should still be answered from the cache");
+            ASSERT(!inspect_state_tuned(tuned, id, b, response), "query b should have been evicted");
+
+            EndSessionRequest end_session_request;
+            end_session_request.set_session_id(id);
+            status = tuned.end_session(end_session_request);
+            ASSERT_STATUS(status, "EndSession", true);
+        });
+
+    test("Should build the same proofs with proof threads as in place", [](ServerManagerClient &manager) {
+        // The default manager builds the proofs in place, and the tuned one with its proof threads
+        std::vector<managed_session_type> sessions;
+        sessions.emplace_back(&manager, create_valid_start_session_request());
+        sessions.emplace_back(&get_tuned_manager(), create_valid_start_session_request());
+        check_same_epoch_on_managers(sessions, 3);
+    });
+
+    test("Should process inputs with the adaptive Run increment as with a fixed one", [](ServerManagerClient &manager) {
+        // The default manager runs in fixed increments, and the tuned one grows them. A small first increment
+        // makes the tuned one grow it several times for each input
+        std::vector<managed_session_type> sessions;
+        sessions.emplace_back(&manager, create_valid_start_session_request());
+        sessions.emplace_back(&get_tuned_manager(), create_valid_start_session_request());
+        for (auto &[m, session_request] : sessions) {
+            session_request.mutable_server_cycles()->set_advance_state_increment(1 << 16);
+        }
+        check_same_epoch_on_managers(sessions, 3);
+    });
+
+    test("Should not run past the cycle limit while growing the Run increment", [](ServerManagerClient & /*manager*/) {
+        auto &tuned = get_tuned_manager();
+        // A limit that is not the sum of any number of doubling increments, so growing past it would show
+        const uint64_t first_increment = 1000;
+        const uint64_t max_cycles = 1000003;
+        StartSessionRequest session_request = create_valid_start_session_request("infinite-loop-machine");
+        CyclesConfig *server_cycles = session_request.mutable_server_cycles();
+        server_cycles->set_max_advance_state(max_cycles);
+        server_cycles->set_advance_state_increment(first_increment);
+        StartSessionResponse session_response;
+        Status status = tuned.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        // The metrics file tells how many cycles each input ran, and in how many Run requests. Wait for the
+        // inputs of earlier tests to be written to it
+        std::this_thread::sleep_for(500ms);
+        auto before = parse_prometheus_text(TUNED_METRICS_FILE);
+
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        status = tuned.advance_state(advance_request);
+        ASSERT_STATUS(status, "AdvanceState", true);
+        GetEpochStatusRequest status_request;
+        GetEpochStatusResponse status_response;
+        status_request.set_session_id(session_request.session_id());
+        status_request.set_epoch_index(session_request.active_epoch_index());
+        wait_pending_inputs_to_be_processed(tuned, status_request, status_response, false,
+            WAITING_PENDING_INPUT_MAX_RETRIES);
+        ASSERT(status_response.processed_inputs_size() == 1 &&
+                status_response.processed_inputs(0).status() == CompletionStatus::CYCLE_LIMIT_EXCEEDED,
+            "input should exceed the cycle limit");
+
+        const std::string count = "server_manager_mcycles_per_input_count";
+        std::map<std::string, double> after;
+        for (int retries = 0; retries < 50 && after[count] != before[count] + 1; ++retries) {
+            std::this_thread::sleep_for(100ms);
+            after = parse_prometheus_text(TUNED_METRICS_FILE);
+        }
+        ASSERT(after[count] == before[count] + 1, "metrics should observe the input");
+        const std::string mcycles = "server_manager_mcycles_per_input_sum";
+        ASSERT(after[mcycles] - before[mcycles] == static_cast<double>(max_cycles),
+            "input should run up to the cycle limit and no further");
+        const std::string run_requests = "server_manager_run_requests_per_input_sum";
+        ASSERT(after[run_requests] - before[run_requests] < static_cast<double>(max_cycles / first_increment),
+            "input should take fewer Run requests than with the fixed increment");
+
+        end_session_after_processing_pending_inputs(tuned, session_request.session_id(),
+            session_request.active_epoch_index(), false, true);
+    });
+
+    test("Should snapshot every input only while the rejection rate is above the threshold",
+        [](ServerManagerClient & /*manager*/) {
+            auto &tuned = get_tuned_manager();
+            // Without the threshold, the interval would leave a single snapshot, before the first input
+            StartSessionRequest session_request = create_valid_start_session_request();
+            StartSessionResponse session_response;
+            Status status = tuned.start_session(session_request, session_response,
+                {{"snapshot-interval", "100"}, {"snapshot-rejection-threshold", "10"}});
+            ASSERT_STATUS(status, "StartSession", true);
+
+            // The metrics file counts the snapshots. Wait for the inputs of earlier tests to be written to it
+            const std::string snapshots = "server_manager_phase_duration_seconds_count{phase=\"snapshot\"}";
+            const std::string count = "server_manager_mcycles_per_input_count";
+            std::this_thread::sleep_for(500ms);
+            auto before = parse_prometheus_text(TUNED_METRICS_FILE);
+
+            // Inputs too long for the rx buffer are skipped, and count as rejected, without touching the machine.
+            // The moving average of the rejection rate, with weight 1/16, goes from 0% to 6.25% and 12.1% over
+            // the two skipped inputs, then decays to 11.4%, 10.6% and 9.98% over the following accepted ones.
+            // So only inputs 3, 4 and 5 find it above 10%, and get a snapshot of their own
+            const std::vector<bool> skip{false, true, true, false, false, false, false, false};
+            for (uint64_t i = 0; i < skip.size(); ++i) {
+                AdvanceStateRequest advance_request;
+                init_valid_advance_state_request(advance_request, session_request.session_id(),
+                    session_request.active_epoch_index(), i);
+                if (skip[i]) {
+                    advance_request.mutable_input_payload()->resize(
+                        session_response.config().rollup().rx_buffer().length() + 1, 'x');
+                }
+                status = tuned.advance_state(advance_request);
+                ASSERT_STATUS(status, "AdvanceState", true);
+            }
+            GetEpochStatusRequest status_request;
+            GetEpochStatusResponse status_response;
+            status_request.set_session_id(session_request.session_id());
+            status_request.set_epoch_index(session_request.active_epoch_index());
+            wait_pending_inputs_to_be_processed(tuned, status_request, status_response, false,
+                WAITING_PENDING_INPUT_MAX_RETRIES);
+            ASSERT(static_cast<size_t>(status_response.processed_inputs_size()) == skip.size(),
+                "all inputs should be processed");
+            for (int i = 0; i < status_response.processed_inputs_size(); ++i) {
+                ASSERT(status_response.processed_inputs(i).status() ==
+                        (skip[i] ? CompletionStatus::PAYLOAD_LENGTH_LIMIT_EXCEEDED : CompletionStatus::ACCEPTED),
+                    "only the long inputs should be skipped");
+            }
+
+            std::map<std::string, double> after;
+            for (int retries = 0; retries < 50 && after[count] != before[count] + static_cast<double>(skip.size());
+                 ++retries) {
+                std::this_thread::sleep_for(100ms);
+                after = parse_prometheus_text(TUNED_METRICS_FILE);
+            }
+            ASSERT(after[count] == before[count] + static_cast<double>(skip.size()),
+                "metrics should observe all inputs");
+            ASSERT(after[snapshots] - before[snapshots] == 4,
+                "inputs 0, 3, 4 and 5 should be the only ones with a snapshot");
+
+            // The epoch still finishes with the outputs of the accepted inputs
+            FinishEpochRequest epoch_request;
+            FinishEpochResponse epoch_response;
+            init_valid_finish_epoch_request(epoch_request, session_request.session_id(),
+                session_request.active_epoch_index(), skip.size());
+            status = tuned.finish_epoch(epoch_request, epoch_response);
+            ASSERT_STATUS(status, "FinishEpoch", true);
+            ASSERT(epoch_response.proofs_size() == 6 * 4, "epoch should have proofs for the outputs of 6 inputs");
+
+            EndSessionRequest end_session_request;
+            end_session_request.set_session_id(session_request.session_id());
+            status = tuned.end_session(end_session_request);
+            ASSERT_STATUS(status, "EndSession", true);
+        });
+
+    test("Should write metrics in the Prometheus text format", [](ServerManagerClient & /*manager*/) {
+        auto &tuned = get_tuned_manager();
+        StartSessionRequest session_request = create_valid_start_session_request();
+        StartSessionResponse session_response;
+        Status status = tuned.start_session(session_request, session_response);
+        ASSERT_STATUS(status, "StartSession", true);
+
+        AdvanceStateRequest advance_request;
+        init_valid_advance_state_request(advance_request, session_request.session_id(),
+            session_request.active_epoch_index(), 0);
+        status = tuned.advance_state(advance_request);
+        ASSERT_STATUS(status, "AdvanceState", true);
+        GetEpochStatusRequest status_request;
+        GetEpochStatusResponse status_response;
+        status_request.set_session_id(session_request.session_id());
+        status_request.set_epoch_index(session_request.active_epoch_index());
+        wait_pending_inputs_to_be_processed(tuned, status_request, status_response, false,
+            WAITING_PENDING_INPUT_MAX_RETRIES);
+
+        // The file is rewritten every --metrics-interval, so wait until it counts the input
+        const auto inputs_processed =
+            "server_manager_inputs_processed_total{session_id=\"" + session_request.session_id() + "\"}";
+        std::map<std::string, double> samples;
+        for (int retries = 0; retries < 50 && samples[inputs_processed] != 1; ++retries) {
+            std::this_thread::sleep_for(100ms);
+            samples = parse_prometheus_text(TUNED_METRICS_FILE);
+        }
+        ASSERT(samples[inputs_processed] == 1, "metrics should count the processed input");
+        ASSERT(samples["server_manager_mcycles_per_input_count"] >= 1, "metrics should observe the input cycles");
+        ASSERT(samples["server_manager_run_requests_per_input_count"] ==
+                samples["server_manager_run_requests_per_input_bucket{le=\"+Inf\"}"],
+            "histogram count should match its unbounded bucket");
+
+        end_session_after_processing_pending_inputs(tuned, session_request.session_id(),
+            session_request.active_epoch_index());
+    });
+}
+
+static int run_tests(const char *address, const bool fast, const char *tuned_address) {
     ServerManagerClient manager(address);
+    if (tuned_address) {
+        tuned_manager = std::make_unique<ServerManagerClient>(tuned_address);
+    }
     test_suite suite(manager);
     suite.add_test_set("GetVersion", test_get_version);
     suite.add_test_set("HealthCheck", test_health_check);
@@ -4009,6 +5269,9 @@ static int run_tests(const char *address, const bool fast) {
         suite.add_test_set("DeleteEpoch", test_delete_epoch);
         suite.add_test_set("EndSession", test_end_session);
     }
+    if (tuned_manager) {
+        suite.add_test_set("Tuned Manager", test_tuned_manager);
+    }
     return suite.run();
 }
 
@@ -4018,7 +5281,7 @@ static void help(const char *name) {
     (void) fprintf(stderr,
         R"(Usage:
 
-    %s [-r] [--help] [--http] <manager-address>
+    %s [-r] [--help] [--http] [--tuned-manager-address=<address>] <manager-address>
 
 where
 
@@ -4031,6 +5294,11 @@ where
     --fast
       runs a minimal set of tests (default: false)
 
+    --tuned-manager-address=<address>
+      also runs the tests of the tuning options against a second server
+      manager at <address>, started with the options in TUNED_MANAGER_OPTS
+      of the Makefile (default: none)
+
     --help
       prints this message and exits
 
@@ -4041,6 +5309,7 @@ where
 
 int main(int argc, char *argv[]) try {
     const char *manager_address = nullptr;
+    const char *tuned_manager_address = nullptr;
     bool fast = false;
 
     for (int i = 1; i < argc; i++) {
@@ -4049,6 +5318,8 @@ int main(int argc, char *argv[]) try {
             exit(0);
         } else if (strcmp(argv[i], "--fast") == 0) {
             fast = true;
+        } else if (strncmp(argv[i], "--tuned-manager-address=", strlen("--tuned-manager-address=")) == 0) {
+            tuned_manager_address = argv[i] + strlen("--tuned-manager-address=");
         } else {
             manager_address = argv[i];
         }
@@ -4058,7 +5329,7 @@ int main(int argc, char *argv[]) try {
         std::cerr << "missing manager-address\n";
         exit(1);
     }
-    return run_tests(manager_address, fast);
+    return run_tests(manager_address, fast, tuned_manager_address);
 } catch (std::exception &e) {
     std::cerr << "Caught exception: " << e.what() << '\n';
     return 1;